@@ -0,0 +1,505 @@
+// Benchmarks of the extraction pipeline on synthetic images.
+//
+// Every stage is timed on its own, from the colour kernels to ProcessImageBatch, on
+// generated BGR images of several sizes and colour mixes. Results are written as JSON,
+// one object per measurement, so that runs on different machines or revisions can be
+// compared by a script.
+
+#include <cv.h> 			//OpenCV lib
+#include <highgui.h>		//OpenCV lib
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "../src/bmp_reader.h"
+#include "../src/color_classifier.h"
+#include "../src/color_features.h"
+#include "../src/cpu_features.h"
+#include "../src/extraction.h"
+#include "../src/feature_store.h"
+#include "../src/histogram.h"
+#include "../src/image_features.h"
+#include "../src/sampling.h"
+
+using namespace std;
+
+// One measurement; seconds is the best time of one iteration
+struct BenchResult {
+	string name;
+	string kernel;
+	string mix;
+	int width;
+	int height;
+	int nbImages;
+	double seconds;
+};
+
+struct BenchSettings {
+	double minTime;			// seconds spent on each measurement
+	string filter;			// only run the benchmarks whose name contains it
+	string directory;		// where the BMP files are written
+	bool quick;
+};
+
+// ---------------------------------------------------------------------------------------
+// Synthetic images
+// ---------------------------------------------------------------------------------------
+
+// xorshift32: fast, and the same images on every platform
+static uint32_t NextRandom(uint32_t &state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Fills a BGR image (3 bytes per pixel, rows of widthStep bytes) with a colour mix:
+//   noise    uniform random bytes: the kernels see few matches and no pattern
+//   cartoon  flat 16x16 tiles, half of them in one of the six feature colours, like
+//            the drawings of the dataset
+//   white    a blank page: every pixel matches White
+static void GenerateImage(const string &mix, int width, int height, int widthStep, unsigned char *pixels, uint32_t seed) {
+	uint32_t state = seed * 2654435761u + 1;
+
+	for (int h = 0; h < height; h++) {
+		unsigned char *row = pixels + (size_t)h * widthStep;
+
+		for (int w = 0; w < width; w++) {
+			unsigned char *pixel = row + 3 * w;
+
+			if (mix == "noise") {
+				uint32_t value = NextRandom(state);
+				pixel[0] = (unsigned char)value;
+				pixel[1] = (unsigned char)(value >> 8);
+				pixel[2] = (unsigned char)(value >> 16);
+			}
+			else if (mix == "white") {
+				pixel[0] = pixel[1] = pixel[2] = 255;
+			}
+			else {
+				// The colour of a tile only depends on its position and the seed
+				uint32_t tile = seed * 7919u + (uint32_t)(h / 16) * 65537u + (uint32_t)(w / 16) + 1;
+				uint32_t value = NextRandom(tile);
+				value = NextRandom(tile);
+
+				if (value % 2 == 0) {
+					const ColorBox &box = COLOR_BOXES[(value >> 8) % NUM_FEATURES];
+					pixel[0] = (unsigned char)((box.loB + box.hiB) / 2);
+					pixel[1] = (unsigned char)((box.loG + box.hiG) / 2);
+					pixel[2] = (unsigned char)((box.loR + box.hiR) / 2);
+				}
+				else {
+					pixel[0] = (unsigned char)(value >> 8);
+					pixel[1] = (unsigned char)(value >> 16);
+					pixel[2] = (unsigned char)(value >> 24);
+				}
+			}
+		}
+	}
+}
+
+static void PutU32(unsigned char *p, uint32_t value) {
+	p[0] = (unsigned char)value;
+	p[1] = (unsigned char)(value >> 8);
+	p[2] = (unsigned char)(value >> 16);
+	p[3] = (unsigned char)(value >> 24);
+}
+
+// Writes a bottom-up 24-bit BMP file
+static bool WriteBmp(const char *fileName, int width, int height, const unsigned char *pixels, int widthStep) {
+	int rowSize = (width * 3 + 3) & ~3;
+	unsigned char header[54] = { 'B', 'M' };
+
+	PutU32(header + 2, 54 + (uint32_t)rowSize * height);
+	PutU32(header + 10, 54);
+	PutU32(header + 14, 40);
+	PutU32(header + 18, (uint32_t)width);
+	PutU32(header + 22, (uint32_t)height);
+	header[26] = 1;		// planes
+	header[28] = 24;	// bits per pixel
+
+	FILE *fp = fopen(fileName, "wb");
+	if (fp == NULL) {
+		perror(fileName);
+		return false;
+	}
+
+	bool ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+	vector<unsigned char> row(rowSize, 0);
+
+	for (int h = height - 1; ok && h >= 0; h--) {
+		memcpy(&row[0], pixels + (size_t)h * widthStep, width * 3);
+		ok = fwrite(&row[0], 1, rowSize, fp) == (size_t)rowSize;
+	}
+
+	if (fclose(fp) != 0 || !ok) {
+		perror(fileName);
+		return false;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------
+// Timing
+// ---------------------------------------------------------------------------------------
+
+static double Now() {
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best time of one call of run. The number of calls per batch is doubled until a batch
+// lasts a fifth of minTime, then five batches are timed and the fastest one is kept,
+// which filters out the interruptions of the OS.
+template<class Run>
+static double TimeBest(Run run, double minTime) {
+	long nbCalls = 1;
+
+	for (;;) {
+		double start = Now();
+		for (long i = 0; i < nbCalls; i++) {
+			run();
+		}
+		if (Now() - start >= minTime / 5 || nbCalls >= (1L << 24)) {
+			break;
+		}
+		nbCalls *= 2;
+	}
+
+	double best = -1.0;
+	for (int batch = 0; batch < 5; batch++) {
+		double start = Now();
+		for (long i = 0; i < nbCalls; i++) {
+			run();
+		}
+		double perCall = (Now() - start) / nbCalls;
+		if (best < 0.0 || perCall < best) {
+			best = perCall;
+		}
+	}
+
+	return best;
+}
+
+static bool Selected(const BenchSettings &settings, const string &name) {
+	return settings.filter.empty() || name.find(settings.filter) != string::npos;
+}
+
+// The decode and batch benchmarks need BMP files on disk
+static bool UsesFiles(const BenchSettings &settings) {
+	const string &filter = settings.filter;
+	return filter.empty() || filter.find("decode") != string::npos || filter.find("batch") != string::npos
+		|| string("decode/ batch/").find(filter) != string::npos;
+}
+
+static void Report(vector<BenchResult> &results, const string &name, const string &kernel, const string &mix, int width, int height, int nbImages, double seconds) {
+	BenchResult result = { name, kernel, mix, width, height, nbImages, seconds };
+	results.push_back(result);
+
+	double pixels = (double)width * height * nbImages;
+	fprintf(stderr, "%-24s %-7s %-8s %5dx%-5d %10.1f Mpx/s %10.1f images/s\n", name.c_str(), kernel.c_str(), mix.c_str(), width, height,
+		pixels / seconds / 1e6, nbImages / seconds);
+}
+
+// ---------------------------------------------------------------------------------------
+// Benchmarks
+// ---------------------------------------------------------------------------------------
+
+struct ColorKernelSet {
+	const char *name;
+	CountColorPixelsFn (*table)(unsigned featureMask);
+	bool supported;
+};
+
+// Each colour kernel alone, then all six fused, then the lookup tables and the whole
+// pixel loop (LoopOverAllPixels) on an IplImage
+static void BenchPixelLoops(const BenchSettings &settings, const string &mix, int width, int height, vector<BenchResult> &results) {
+	int widthStep = (width * 3 + 3) & ~3;
+	vector<unsigned char> pixels((size_t)widthStep * height);
+	GenerateImage(mix, width, height, widthStep, &pixels[0], 1);
+
+	uint64_t counts[MAX_COLOR_RULES];
+
+	ColorKernelSet kernels[] = {
+		{ "scalar", ScalarColorKernel, true },
+		{ "sse42", Sse42ColorKernel, CpuSupportsSse42() },
+		{ "avx2", Avx2ColorKernel, CpuSupportsAvx2() }
+	};
+	static const char *FEATURE_NAMES[NUM_FEATURES] = { "orange", "white", "brown", "blue", "green", "red" };
+
+	for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+		if (!kernels[k].supported) {
+			continue;
+		}
+
+		for (int f = 0; f <= NUM_FEATURES; f++) {
+			string name = f < NUM_FEATURES ? string("feature/") + FEATURE_NAMES[f] : string("feature/all");
+			unsigned mask = f < NUM_FEATURES ? FEATURE_BIT(f) : ALL_FEATURES;
+			if (!Selected(settings, name)) {
+				continue;
+			}
+
+			CountColorPixelsFn kernel = kernels[k].table(mask);
+			double seconds = TimeBest([&]() { kernel(&pixels[0], width, height, widthStep, 3, counts); }, settings.minTime);
+			Report(results, name, kernels[k].name, mix, width, height, 1, seconds);
+		}
+	}
+
+	vector<ColorRule> rules = BuiltinColorRules();
+
+	if (Selected(settings, "lookup")) {
+		ColorClassifier lookup(rules, true);
+		double seconds = TimeBest([&]() { lookup.CountLookup(&pixels[0], width, height, widthStep, 3, counts); }, settings.minTime);
+		Report(results, "lookup", "lut", mix, width, height, 1, seconds);
+	}
+
+	if (Selected(settings, "pixel-loop")) {
+		ColorClassifier classifier(rules);
+		IplImage *img = cvCreateImageHeader(cvSize(width, height), IPL_DEPTH_8U, 3);
+		cvSetData(img, &pixels[0], widthStep);
+
+		double seconds = TimeBest([&]() { LoopOverAllPixels(classifier, img, NULL, counts); }, settings.minTime);
+		Report(results, "pixel-loop", ColorKernelName(), mix, width, height, 1, seconds);
+
+		cvReleaseImageHeader(&img);
+	}
+
+	// The six colour counts and a 512-bin histogram in the same pass, to compare with
+	// feature/all
+	if (Selected(settings, "histogram/8")) {
+		ColorClassifier classifier(rules);
+		ColorHistogram histogram(8);
+		PixelView image = { &pixels[0], width, height, widthStep, 3, NULL, 0 };
+
+		double seconds = TimeBest([&]() { CountColorsAndHistogram(classifier, image, histogram, counts); }, settings.minTime);
+		Report(results, "histogram/8", ColorKernelName(), mix, width, height, 1, seconds);
+	}
+}
+
+// Writes nbFiles BMP images of a size and mix; returns their names
+static bool WriteImages(const BenchSettings &settings, const string &mix, int width, int height, int nbFiles, vector<string> &fileNames) {
+	int widthStep = width * 3;
+	vector<unsigned char> pixels((size_t)widthStep * height);
+
+	fileNames.clear();
+	for (int i = 0; i < nbFiles; i++) {
+		char fileName[512];
+		sprintf(fileName, "%s/%s-%dx%d-%d.bmp", settings.directory.c_str(), mix.c_str(), width, height, i);
+
+		GenerateImage(mix, width, height, widthStep, &pixels[0], (uint32_t)i + 1);
+		if (!WriteBmp(fileName, width, height, &pixels[0], widthStep)) {
+			return false;
+		}
+		fileNames.push_back(fileName);
+	}
+	return true;
+}
+
+// Getting the pixels of a file: OpenCV decodes it into a new image, the native reader
+// maps it and points into it (the pages are touched once, as counting would)
+static void BenchDecode(const BenchSettings &settings, const string &mix, int width, int height, const vector<string> &fileNames, vector<BenchResult> &results) {
+	int nbFiles = (int)fileNames.size();
+
+	if (Selected(settings, "decode/opencv")) {
+		double seconds = TimeBest([&]() {
+			for (int i = 0; i < nbFiles; i++) {
+				IplImage *img = cvLoadImage(fileNames[i].c_str(), -1);
+				if (img != NULL) {
+					cvReleaseImage(&img);
+				}
+			}
+		}, settings.minTime);
+		Report(results, "decode/opencv", "-", mix, width, height, nbFiles, seconds);
+	}
+
+	if (Selected(settings, "decode/native")) {
+		volatile unsigned char sink = 0;
+		double seconds = TimeBest([&]() {
+			for (int i = 0; i < nbFiles; i++) {
+				MappedFile file;
+				BmpImage bmp;
+				if (file.Open(fileNames[i].c_str()) && ParseBmp(file.Data(), file.Size(), bmp)) {
+					unsigned char touched = 0;
+					for (size_t offset = 0; offset < file.Size(); offset += 4096) {
+						touched ^= file.Data()[offset];
+					}
+					sink ^= touched;
+				}
+			}
+		}, settings.minTime);
+		Report(results, "decode/native", "-", mix, width, height, nbFiles, seconds);
+	}
+}
+
+// ProcessImageBatch over the files, with each decoder, on one thread and on every core
+static void BenchBatch(const BenchSettings &settings, const string &mix, int width, int height, const vector<string> &fileNames, vector<BenchResult> &results) {
+	vector<ColorRule> rules = BuiltinColorRules();
+	ColorClassifier classifier(rules);
+
+	vector<string> featureNames;
+	for (size_t i = 0; i < rules.size(); i++) {
+		featureNames.push_back(rules[i].name);
+	}
+
+	int threadCounts[2] = { 1, ResolveThreadCount(0) };
+	const char *decoders[2] = { "native", "opencv" };
+
+	for (int d = 0; d < 2; d++) {
+		for (int t = 0; t < 2; t++) {
+			if (t == 1 && threadCounts[1] == 1) {
+				continue;
+			}
+
+			char name[64];
+			sprintf(name, "batch/%s/%dt", decoders[d], threadCounts[t]);
+			if (!Selected(settings, name)) {
+				continue;
+			}
+
+			ExtractionOptions options;
+			options.classifier = &classifier;
+			options.inspect = false;
+			options.threads = threadCounts[t];
+			options.nativeBmp = d == 0;
+			options.streamAbove = STREAM_ABOVE_BYTES;
+			options.sampling = NULL;
+			options.components = false;
+			options.histogramBins = 0;
+			options.cache = NULL;
+			options.readAhead = 0;
+			options.archive = NULL;
+
+			double seconds = TimeBest([&]() {
+				FeatureStore store(featureNames);
+				for (size_t i = 0; i < fileNames.size(); i++) {
+					store.AddSample(fileNames[i], mix, (int)i);
+				}
+				int nbFailed = 0;
+				ProcessImageBatch(store, options, nbFailed);
+			}, settings.minTime);
+			Report(results, name, ColorKernelName(), mix, width, height, (int)fileNames.size(), seconds);
+		}
+	}
+}
+
+static void PrintJson(FILE *out, const vector<BenchResult> &results) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"kernel\": \"%s\",\n", ColorKernelName());
+	fprintf(out, "  \"threads\": %d,\n", ResolveThreadCount(0));
+	fprintf(out, "  \"results\": [\n");
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult &r = results[i];
+		double pixels = (double)r.width * r.height * r.nbImages;
+
+		fprintf(out, "    { \"name\": \"%s\", \"kernel\": \"%s\", \"mix\": \"%s\", \"width\": %d, \"height\": %d, \"images\": %d, "
+			"\"seconds\": %.9g, \"pixels_per_second\": %.6g, \"images_per_second\": %.6g }%s\n",
+			r.name.c_str(), r.kernel.c_str(), r.mix.c_str(), r.width, r.height, r.nbImages,
+			r.seconds, pixels / r.seconds, r.nbImages / r.seconds, i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+}
+
+static void PrintUsage(const char *program) {
+	fprintf(stderr, "Usage: %s [--quick] [--filter TEXT] [--min-time S] [--dir DIR] [-o FILE]\n", program);
+	fprintf(stderr, "  --quick      one small and one medium size, shorter measurements\n");
+	fprintf(stderr, "  --filter T   only the benchmarks whose name contains T (feature/, lookup,\n");
+	fprintf(stderr, "               pixel-loop, histogram/, decode/, batch/)\n");
+	fprintf(stderr, "  --min-time S seconds spent on each measurement (default 0.5)\n");
+	fprintf(stderr, "  --dir DIR    directory for the generated BMP files (default bench-images)\n");
+	fprintf(stderr, "  -o FILE      write the JSON results to FILE instead of the standard output\n");
+}
+
+int main(int argc, char **argv) {
+	BenchSettings settings;
+	settings.minTime = 0.5;
+	settings.directory = "bench-images";
+	settings.quick = false;
+	const char *outputFileName = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--quick") {
+			settings.quick = true;
+			settings.minTime = 0.1;
+		}
+		else if (option == "--filter" && i + 1 < argc) {
+			settings.filter = argv[++i];
+		}
+		else if (option == "--min-time" && i + 1 < argc) {
+			settings.minTime = atof(argv[++i]);
+		}
+		else if (option == "--dir" && i + 1 < argc) {
+			settings.directory = argv[++i];
+		}
+		else if (option == "-o" && i + 1 < argc) {
+			outputFileName = argv[++i];
+		}
+		else {
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+#ifdef _WIN32
+	_mkdir(settings.directory.c_str());
+#else
+	mkdir(settings.directory.c_str(), 0777);
+#endif
+
+	// The dataset images are about 300x300; the larger sizes are video frames
+	int sizes[][2] = { { 320, 240 }, { 640, 480 }, { 1920, 1080 } };
+	int nbSizes = settings.quick ? 2 : 3;
+	const char *mixes[] = { "cartoon", "noise", "white" };
+	int nbMixes = settings.quick ? 1 : 3;
+
+	vector<BenchResult> results;
+
+	for (int s = 0; s < nbSizes; s++) {
+		int width = sizes[s][0];
+		int height = sizes[s][1];
+
+		for (int m = 0; m < nbMixes; m++) {
+			string mix = mixes[m];
+			BenchPixelLoops(settings, mix, width, height, results);
+
+			if (UsesFiles(settings)) {
+				vector<string> fileNames;
+				if (!WriteImages(settings, mix, width, height, 16, fileNames)) {
+					return EXIT_FAILURE;
+				}
+
+				BenchDecode(settings, mix, width, height, fileNames, results);
+				BenchBatch(settings, mix, width, height, fileNames, results);
+
+				for (size_t i = 0; i < fileNames.size(); i++) {
+					remove(fileNames[i].c_str());
+				}
+			}
+		}
+	}
+
+	FILE *out = outputFileName != NULL ? fopen(outputFileName, "w") : stdout;
+	if (out == NULL) {
+		perror(outputFileName);
+		return EXIT_FAILURE;
+	}
+
+	PrintJson(out, results);
+
+	if (out != stdout) {
+		fclose(out);
+	}
+	return 0;
+}
@@ -0,0 +1,333 @@
+#include "bmp_reader.h"
+#include "buffer_pool.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_COMPRESSION_RGB 0
+
+MappedFile::MappedFile() : data(NULL), size(0) {
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char *fileName) {
+	Close();
+
+	fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0 || (uint64_t)fileSize.QuadPart > (size_t)-1) {
+		Close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL) {
+		Close();
+		return false;
+	}
+
+	data = (const unsigned char *)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		Close();
+		return false;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data != NULL) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != NULL) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+	}
+
+	data = NULL;
+	size = 0;
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+}
+
+#else
+
+bool MappedFile::Open(const char *fileName) {
+	Close();
+
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+
+	// The pixels are read once, front to back
+	madvise(mapping, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	data = (const unsigned char *)mapping;
+	size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data != NULL) {
+		munmap((void *)data, size);
+	}
+
+	data = NULL;
+	size = 0;
+}
+
+#endif
+
+bool ReadWholeFile(const char *fileName, PooledBuffer &buffer, size_t &size) {
+	FILE *fp = fopen(fileName, "rb");
+
+	if (fp == NULL) {
+		return false;
+	}
+
+	// The size is not always known in advance: grow the buffer until the end of file
+	size = 0;
+	buffer.Reserve(MIN_POOLED_BUFFER);
+
+	for (;;) {
+		size_t nbRead = fread(buffer.Data() + size, 1, buffer.Capacity() - size, fp);
+		size += nbRead;
+
+		if (size < buffer.Capacity()) {
+			break;
+		}
+
+		PooledBuffer larger(2 * buffer.Capacity());
+		memcpy(larger.Data(), buffer.Data(), size);
+		buffer.Swap(larger);
+	}
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+}
+
+// BMP fields are little-endian
+static uint32_t ReadU32(const unsigned char *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ReadU16(const unsigned char *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+bool ParseBmpLayout(const unsigned char *header, size_t headerSize, uint64_t fileSize, BmpLayout &layout) {
+
+	if (headerSize < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || header[0] != 'B' || header[1] != 'M') {
+		return false;
+	}
+
+	// BITMAPFILEHEADER
+	uint32_t pixelOffset = ReadU32(header + 10);
+
+	// BITMAPINFOHEADER, or one of its larger successors (V4, V5)
+	const unsigned char *info = header + BMP_FILE_HEADER_SIZE;
+	uint32_t infoSize = ReadU32(info);
+	int32_t width = (int32_t)ReadU32(info + 4);
+	int32_t height = (int32_t)ReadU32(info + 8);
+	uint16_t planes = ReadU16(info + 12);
+	uint16_t bitsPerPixel = ReadU16(info + 14);
+	uint32_t compression = ReadU32(info + 16);
+	uint32_t colorsUsed = ReadU32(info + 32);
+
+	if (infoSize < BMP_INFO_HEADER_SIZE || infoSize > headerSize - BMP_FILE_HEADER_SIZE || planes != 1 || compression != BMP_COMPRESSION_RGB) {
+		return false;
+	}
+	if (bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32) {
+		return false;
+	}
+	if (width <= 0 || width > (1 << 24) || height == 0 || height > (1 << 24) || height < -(1 << 24)) {
+		return false;
+	}
+
+	uint32_t nbRows = height > 0 ? (uint32_t)height : (uint32_t)-height;
+
+	// Each row is padded to a multiple of 4 bytes
+	uint64_t rowSize = (((uint64_t)width * bitsPerPixel + 31) / 32) * 4;
+	if (rowSize > 0x7FFFFFFF || pixelOffset > fileSize || rowSize * nbRows > fileSize - pixelOffset) {
+		return false;
+	}
+
+	layout.paletteOffset = 0;
+	layout.paletteSize = 0;
+
+	if (bitsPerPixel == 8) {
+		uint32_t paletteOffset = BMP_FILE_HEADER_SIZE + infoSize;
+		uint32_t nbColors = colorsUsed == 0 ? 256 : colorsUsed;
+		if (nbColors > 256 || paletteOffset + 4 * nbColors > pixelOffset || paletteOffset + 4 * nbColors > headerSize) {
+			return false;
+		}
+		layout.paletteOffset = paletteOffset;
+		layout.paletteSize = (int)nbColors;
+	}
+
+	layout.width = width;
+	layout.height = (int)nbRows;
+	layout.bitsPerPixel = bitsPerPixel;
+	layout.bottomUp = height > 0;
+	layout.pixelOffset = pixelOffset;
+	layout.rowSize = (uint32_t)rowSize;
+
+	return true;
+}
+
+bool ParseBmp(const unsigned char *data, size_t size, BmpImage &bmp) {
+	BmpLayout layout;
+
+	if (!ParseBmpLayout(data, size, size, layout)) {
+		return false;
+	}
+
+	const unsigned char *firstRow = data + layout.pixelOffset;
+
+	bmp.width = layout.width;
+	bmp.height = layout.height;
+	bmp.bitsPerPixel = layout.bitsPerPixel;
+	bmp.palette = layout.paletteSize > 0 ? data + layout.paletteOffset : NULL;
+	bmp.paletteSize = layout.paletteSize;
+
+	if (layout.bottomUp) {
+		bmp.pixels = firstRow + (size_t)(layout.height - 1) * layout.rowSize;
+		bmp.widthStep = -(int)layout.rowSize;
+	}
+	else {
+		bmp.pixels = firstRow;
+		bmp.widthStep = (int)layout.rowSize;
+	}
+
+	return true;
+}
+
+// 64-bit offsets in files, for images over 2 GB
+static bool SeekFile(FILE *fp, uint64_t offset, int origin) {
+#ifdef _WIN32
+	return _fseeki64(fp, (__int64)offset, origin) == 0;
+#else
+	return fseeko(fp, (off_t)offset, origin) == 0;
+#endif
+}
+
+static bool TellFile(FILE *fp, uint64_t &offset) {
+#ifdef _WIN32
+	__int64 position = _ftelli64(fp);
+#else
+	off_t position = ftello(fp);
+#endif
+	offset = (uint64_t)position;
+	return position >= 0;
+}
+
+BmpStripReader::BmpStripReader() : fp(NULL), rowsLeft(0), rowsPerStrip(0) {
+}
+
+BmpStripReader::~BmpStripReader() {
+	Close();
+}
+
+void BmpStripReader::Close() {
+	if (fp != NULL) {
+		fclose(fp);
+	}
+	fp = NULL;
+	rowsLeft = 0;
+}
+
+bool BmpStripReader::Open(const char *fileName, size_t stripBytes) {
+	Close();
+
+	fp = fopen(fileName, "rb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	// The file size bounds the pixel array; the headers and the palette come first
+	uint64_t fileSize;
+	if (!SeekFile(fp, 0, SEEK_END) || !TellFile(fp, fileSize) || !SeekFile(fp, 0, SEEK_SET)) {
+		Close();
+		return false;
+	}
+
+	size_t headerSize = fread(header, 1, sizeof(header), fp);
+	if (!ParseBmpLayout(header, headerSize, fileSize, layout) || !SeekFile(fp, layout.pixelOffset, SEEK_SET)) {
+		Close();
+		return false;
+	}
+
+	// Whole rows only; a row wider than the strip gets a strip of its own
+	rowsPerStrip = (int)(stripBytes / layout.rowSize);
+	if (rowsPerStrip < 1) {
+		rowsPerStrip = 1;
+	}
+	if (rowsPerStrip > layout.height) {
+		rowsPerStrip = layout.height;
+	}
+	strip.Reserve((size_t)rowsPerStrip * layout.rowSize);
+
+	rowsLeft = layout.height;
+	return true;
+}
+
+int BmpStripReader::ReadStrip(const unsigned char *&rows) {
+	if (fp == NULL || rowsLeft == 0) {
+		return 0;
+	}
+
+	int nbRows = rowsLeft < rowsPerStrip ? rowsLeft : rowsPerStrip;
+	size_t size = (size_t)nbRows * layout.rowSize;
+
+	if (fread(strip.Data(), 1, size, fp) != size) {
+		return -1;
+	}
+
+	rowsLeft -= nbRows;
+	rows = strip.Data();
+	return nbRows;
+}
@@ -0,0 +1,113 @@
+#ifndef LABPRIMITIVE_BMP_READER_H
+#define LABPRIMITIVE_BMP_READER_H
+
+#include "buffer_pool.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Maps fileName; returns false (with errno set on POSIX) if it cannot be opened or mapped
+	bool Open(const char *fileName);
+	void Close();
+
+	const unsigned char *Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	void *fileHandle;
+	void *mappingHandle;
+#endif
+};
+
+// Reads a whole file into buffer, for files that cannot be mapped.
+// Returns false (with errno set) on error.
+bool ReadWholeFile(const char *fileName, PooledBuffer &buffer, size_t &size);
+
+// Pixels of an uncompressed BMP, pointing straight into the file bytes
+struct BmpImage {
+	int width;
+	int height;
+
+	// First (top) row and distance from one row to the next. BMP rows are stored
+	// bottom-up unless the height is negative, so widthStep is usually negative.
+	const unsigned char *pixels;
+	int widthStep;
+
+	// 24 (BGR), 32 (BGRX) or 8 (index in the palette)
+	int bitsPerPixel;
+
+	// 8-bit images: paletteSize entries of 4 bytes (B, G, R, reserved)
+	const unsigned char *palette;
+	int paletteSize;
+};
+
+// Where the pixels of an uncompressed BMP are in its file
+struct BmpLayout {
+	int width;
+	int height;				// number of rows
+	int bitsPerPixel;		// 24 (BGR), 32 (BGRX) or 8 (index in the palette)
+	bool bottomUp;			// rows stored from the bottom one up (positive height)
+	uint32_t pixelOffset;	// first stored row
+	uint32_t rowSize;		// bytes per stored row, padding included
+	uint32_t paletteOffset;	// 8-bit images: paletteSize entries of 4 bytes
+	int paletteSize;
+};
+
+// Validates the headers of a BMP file of fileSize bytes from its first headerSize
+// bytes, which must hold the palette. Same formats as ParseBmp.
+bool ParseBmpLayout(const unsigned char *header, size_t headerSize, uint64_t fileSize, BmpLayout &layout);
+
+// Validates the headers of a BMP file held in memory and locates its pixels.
+// Returns false for anything but uncompressed 8, 24 and 32-bit images (or a truncated
+// file); the caller can then fall back to OpenCV.
+bool ParseBmp(const unsigned char *data, size_t size, BmpImage &bmp);
+
+// Headers of a BMP read ahead by BmpStripReader: the V5 info header and a full palette fit
+#define BMP_MAX_HEADER_SIZE 2048
+
+// Reads the pixels of an uncompressed BMP a strip of rows at a time, in the order they
+// are stored in the file, into one buffer of about stripBytes. The memory used stays
+// the same whatever the size of the image.
+class BmpStripReader {
+public:
+	BmpStripReader();
+	~BmpStripReader();
+
+	// Opens fileName and reads its headers; returns false if it cannot be read or is not
+	// a BMP ParseBmpLayout handles (with a palette within the first BMP_MAX_HEADER_SIZE bytes)
+	bool Open(const char *fileName, size_t stripBytes);
+	void Close();
+
+	const BmpLayout &Layout() const { return layout; }
+	const unsigned char *Palette() const { return layout.paletteSize > 0 ? header + layout.paletteOffset : NULL; }
+
+	// Reads the next strip: rows points to its first stored row, the next ones follow
+	// every rowSize bytes. Returns the number of rows, 0 after the last one, -1 on error.
+	int ReadStrip(const unsigned char *&rows);
+
+private:
+	BmpStripReader(const BmpStripReader &);
+	BmpStripReader &operator=(const BmpStripReader &);
+
+	FILE *fp;
+	unsigned char header[BMP_MAX_HEADER_SIZE];
+	BmpLayout layout;
+	PooledBuffer strip;
+	int rowsLeft;
+	int rowsPerStrip;
+};
+
+#endif
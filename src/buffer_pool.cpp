@@ -0,0 +1,146 @@
+#include "buffer_pool.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+// Size class of a request: the smallest power of two holding it
+static int SizeClass(size_t size) {
+	int sizeClass = 0;
+	while (((size_t)1 << sizeClass) < size || ((size_t)1 << sizeClass) < MIN_POOLED_BUFFER) {
+		sizeClass++;
+	}
+	return sizeClass;
+}
+
+BufferPool::BufferPool() : bytesAllocated(0), peakBytesAllocated(0), nbBuffers(0) {
+}
+
+BufferPool::~BufferPool() {
+	for (size_t i = 0; i < sizeof(freeBuffers) / sizeof(freeBuffers[0]); i++) {
+		for (size_t j = 0; j < freeBuffers[i].size(); j++) {
+			free(freeBuffers[i][j]);
+		}
+	}
+}
+
+unsigned char *BufferPool::Acquire(size_t size, size_t &capacity) {
+	int sizeClass = SizeClass(size);
+	capacity = (size_t)1 << sizeClass;
+
+	{
+		lock_guard<mutex> lock(poolMutex);
+
+		if (!freeBuffers[sizeClass].empty()) {
+			unsigned char *buffer = freeBuffers[sizeClass].back();
+			freeBuffers[sizeClass].pop_back();
+			return buffer;
+		}
+
+		bytesAllocated += capacity;
+		nbBuffers++;
+		if (bytesAllocated > peakBytesAllocated) {
+			peakBytesAllocated = bytesAllocated;
+		}
+	}
+
+	unsigned char *buffer = (unsigned char *)malloc(capacity);
+	if (buffer == NULL) {
+		lock_guard<mutex> lock(poolMutex);
+		bytesAllocated -= capacity;
+		nbBuffers--;
+		throw bad_alloc();
+	}
+	return buffer;
+}
+
+void BufferPool::Release(unsigned char *buffer, size_t capacity) {
+	if (buffer == NULL) {
+		return;
+	}
+
+	lock_guard<mutex> lock(poolMutex);
+	freeBuffers[SizeClass(capacity)].push_back(buffer);
+}
+
+size_t BufferPool::BytesAllocated() const {
+	lock_guard<mutex> lock(poolMutex);
+	return bytesAllocated;
+}
+
+size_t BufferPool::PeakBytesAllocated() const {
+	lock_guard<mutex> lock(poolMutex);
+	return peakBytesAllocated;
+}
+
+size_t BufferPool::NbBuffers() const {
+	lock_guard<mutex> lock(poolMutex);
+	return nbBuffers;
+}
+
+BufferPool &BufferPool::Shared() {
+	static BufferPool pool;
+	return pool;
+}
+
+PooledBuffer::PooledBuffer(BufferPool &pool) : pool(pool), data(NULL), capacity(0) {
+}
+
+PooledBuffer::PooledBuffer(size_t size, BufferPool &pool) : pool(pool), data(NULL), capacity(0) {
+	Reserve(size);
+}
+
+PooledBuffer::~PooledBuffer() {
+	pool.Release(data, capacity);
+}
+
+void PooledBuffer::Reserve(size_t size) {
+	if (data != NULL && size <= capacity) {
+		return;
+	}
+
+	pool.Release(data, capacity);
+	data = NULL;
+	capacity = 0;
+
+	data = pool.Acquire(size, capacity);
+}
+
+void PooledBuffer::Swap(PooledBuffer &other) {
+	unsigned char *otherData = other.data;
+	size_t otherCapacity = other.capacity;
+
+	other.data = data;
+	other.capacity = capacity;
+	data = otherData;
+	capacity = otherCapacity;
+}
+
+size_t PeakResidentBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;		// bytes
+#else
+	return (size_t)usage.ru_maxrss * 1024;	// kilobytes
+#endif
+#endif
+}
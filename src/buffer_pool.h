@@ -0,0 +1,73 @@
+#ifndef LABPRIMITIVE_BUFFER_POOL_H
+#define LABPRIMITIVE_BUFFER_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Thread-safe pool of byte buffers reused from one image to the next, so the working
+// memory of a run stays flat whatever the number of images. Capacities are powers of
+// two (at least MIN_POOLED_BUFFER bytes) and a request takes a free buffer of its size
+// class, so an image only allocates when it is larger than every image seen before on
+// as many threads.
+class BufferPool {
+public:
+	BufferPool();
+	~BufferPool();
+
+	// Returns a buffer of at least size bytes; capacity receives its actual size
+	unsigned char *Acquire(size_t size, size_t &capacity);
+
+	// Gives back a buffer obtained from Acquire
+	void Release(unsigned char *buffer, size_t capacity);
+
+	// Bytes held by the pool (in use and free), now and at most
+	size_t BytesAllocated() const;
+	size_t PeakBytesAllocated() const;
+	size_t NbBuffers() const;
+
+	// Pool shared by the whole process
+	static BufferPool &Shared();
+
+private:
+	BufferPool(const BufferPool &);
+	BufferPool &operator=(const BufferPool &);
+
+	mutable std::mutex poolMutex;
+	std::vector<unsigned char *> freeBuffers[sizeof(size_t) * 8];
+	size_t bytesAllocated;
+	size_t peakBytesAllocated;
+	size_t nbBuffers;
+};
+
+#define MIN_POOLED_BUFFER (64 * 1024)
+
+// A buffer of a pool, given back when it goes out of scope
+class PooledBuffer {
+public:
+	explicit PooledBuffer(BufferPool &pool = BufferPool::Shared());
+	PooledBuffer(size_t size, BufferPool &pool = BufferPool::Shared());
+	~PooledBuffer();
+
+	// Makes room for size bytes; the content is not kept
+	void Reserve(size_t size);
+
+	// Exchanges the buffers of two handles of the same pool
+	void Swap(PooledBuffer &other);
+
+	unsigned char *Data() const { return data; }
+	size_t Capacity() const { return capacity; }
+
+private:
+	PooledBuffer(const PooledBuffer &);
+	PooledBuffer &operator=(const PooledBuffer &);
+
+	BufferPool &pool;
+	unsigned char *data;
+	size_t capacity;
+};
+
+// Peak resident set size of the process in bytes (0 when unknown)
+size_t PeakResidentBytes();
+
+#endif
@@ -0,0 +1,178 @@
+#include "commands.h"
+#include "cross_validation.h"
+#include "dataset.h"
+#include "extraction.h"
+#include "feature_store.h"
+#include "feature_writer.h"
+#include "learning.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// Loads a feature file, or extracts the features of the training or validation images
+static bool GetFeatures(const char *fileName, bool training, const vector<string> &featureNames, const DatasetOptions &dataset,
+	const ExtractionOptions &options, FeatureStore &store) {
+
+	if (fileName != NULL) {
+		return LoadFeatures(fileName, store);
+	}
+
+	store = FeatureStore(featureNames);
+	if (!AddDatasetImages(store, training, dataset)) {
+		return false;
+	}
+
+	// Images that cannot be loaded are reported and left out of the set
+	int nbFailed = 0;
+	ProcessImageBatch(store, options, nbFailed);
+	return true;
+}
+
+static bool SameFeatures(const FeatureStore &a, const FeatureStore &b) {
+	if (a.NbFeatures() != b.NbFeatures()) {
+		return false;
+	}
+	for (int f = 0; f < a.NbFeatures(); f++) {
+		if (a.FeatureName(f) != b.FeatureName(f)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Predicts every extracted validation sample and returns the confusion matrix
+template<class Classifier>
+static ConfusionMatrix Evaluate(const Classifier &classifier, const FeatureStore &training, const FeatureStore &validation) {
+	ConfusionMatrix matrix(training.Labels());
+	vector<float> fVector(validation.NbFeatures());
+
+	for (size_t i = 0; i < validation.NbSamples(); i++) {
+		if (!validation.Extracted(i)) {
+			continue;
+		}
+		for (int f = 0; f < validation.NbFeatures(); f++) {
+			fVector[f] = validation.Value(i, f);
+		}
+		int actual = matrix.LabelIndex(validation.Label(i));
+		matrix.Add(actual, classifier.Predict(fVector.empty() ? NULL : &fVector[0]));
+	}
+
+	return matrix;
+}
+
+int RunClassify(const char *trainFileName, const char *validFileName, int k, const vector<string> &featureNames,
+	const DatasetOptions &dataset, const ExtractionOptions &options) {
+
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	FeatureStore training, validation;
+	if (!GetFeatures(trainFileName, true, featureNames, dataset, options, training)
+		|| !GetFeatures(validFileName, false, featureNames, dataset, options, validation)) {
+		return EXIT_FAILURE;
+	}
+	if (!SameFeatures(training, validation)) {
+		fprintf(stderr, "The training and validation sets do not have the same features\n");
+		return EXIT_FAILURE;
+	}
+	if (training.NbExtracted() == 0) {
+		fprintf(stderr, "The training set is empty\n");
+		return EXIT_FAILURE;
+	}
+
+	double loadTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	printf("%d training and %d validation samples, %d features (%.3f s)\n", (int)training.NbExtracted(), (int)validation.NbExtracted(), training.NbFeatures(), loadTime);
+
+	startTime = chrono::steady_clock::now();
+	KnnClassifier knn(k);
+	knn.Train(training);
+	ConfusionMatrix knnMatrix = Evaluate(knn, training, validation);
+	double knnTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+	startTime = chrono::steady_clock::now();
+	GaussianNaiveBayes bayes;
+	bayes.Train(training);
+	ConfusionMatrix bayesMatrix = Evaluate(bayes, training, validation);
+	double bayesTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+	char title[64];
+	sprintf(title, "\n%d-NN (%.3f s)", knn.K(), knnTime);
+	knnMatrix.Print(stdout, title);
+	sprintf(title, "\nGaussian naive Bayes (%.3f s)", bayesTime);
+	bayesMatrix.Print(stdout, title);
+
+	return 0;
+}
+
+int RunEvaluate(const char *trainFileName, const char *validFileName, const vector<string> &featureNames, const DatasetOptions &dataset,
+	const ExtractionOptions &options, const EvaluationGrid &grid, int nbRows, const char *leaderboardFileName) {
+
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	FeatureStore training, validation;
+	if (!GetFeatures(trainFileName, true, featureNames, dataset, options, training)
+		|| !GetFeatures(validFileName, false, featureNames, dataset, options, validation)) {
+		return EXIT_FAILURE;
+	}
+	if (!SameFeatures(training, validation)) {
+		fprintf(stderr, "The training and validation sets do not have the same features\n");
+		return EXIT_FAILURE;
+	}
+
+	// Both sets in one: the folds give every sample its turn in the test part
+	vector<string> names;
+	for (int f = 0; f < training.NbFeatures(); f++) {
+		names.push_back(training.FeatureName(f));
+	}
+	FeatureStore samples(names);
+	vector<float> fVector(names.size());
+	const FeatureStore *sets[2] = { &training, &validation };
+	for (int s = 0; s < 2; s++) {
+		for (size_t l = 0; l < sets[s]->Labels().size(); l++) {
+			samples.AddLabel(sets[s]->Labels()[l]);
+		}
+	}
+	samples.Reserve(training.NbExtracted() + validation.NbExtracted());
+	for (int s = 0; s < 2; s++) {
+		const FeatureStore &set = *sets[s];
+		for (size_t i = 0; i < set.NbSamples(); i++) {
+			if (!set.Extracted(i)) {
+				continue;
+			}
+			for (int f = 0; f < set.NbFeatures(); f++) {
+				fVector[f] = set.Value(i, f);
+			}
+			size_t sample = samples.AddSample(set.Path(i), set.Label(i), set.Number(i));
+			samples.SetFeatures(sample, fVector.empty() ? NULL : &fVector[0]);
+		}
+	}
+	if ((int)samples.NbSamples() < grid.nbFolds) {
+		fprintf(stderr, "%d samples cannot be split into %d folds\n", (int)samples.NbSamples(), grid.nbFolds);
+		return EXIT_FAILURE;
+	}
+
+	double loadTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	printf("%d samples (%d training, %d validation), %d features, %d classes (%.3f s)\n", (int)samples.NbSamples(), (int)training.NbExtracted(),
+		(int)validation.NbExtracted(), samples.NbFeatures(), (int)samples.Labels().size(), loadTime);
+
+	EvaluationGrid sweep = grid;
+	if (sweep.featureSubsets.empty()) {
+		sweep.featureSubsets = DefaultFeatureSubsets(names);
+	}
+	int nbClassifiers = (int)sweep.neighbourCounts.size() + (sweep.naiveBayes ? 1 : 0);
+
+	startTime = chrono::steady_clock::now();
+	vector<CandidateScore> leaderboard = CrossValidate(samples, sweep);
+	double evaluationTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+	printf("%d candidates (%d classifiers x %d feature subsets), %d-fold cross-validation in %.3f s\n\n", (int)leaderboard.size(),
+		nbClassifiers, (int)sweep.featureSubsets.size(), sweep.nbFolds, evaluationTime);
+	PrintLeaderboard(leaderboard, samples, nbRows, stdout);
+
+	if (leaderboardFileName != NULL && !WriteLeaderboard(leaderboard, samples, leaderboardFileName)) {
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
@@ -0,0 +1,339 @@
+#include "color_classifier.h"
+
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+static const char *BUILTIN_COLOR_NAMES[NUM_FEATURES] = { "Orange", "White", "Brown", "Blue", "Green", "Red" };
+
+vector<ColorRule> BuiltinColorRules() {
+	vector<ColorRule> rules;
+
+	for (int i = 0; i < NUM_FEATURES; i++) {
+		ColorRule rule;
+		rule.name = BUILTIN_COLOR_NAMES[i];
+		rule.box = COLOR_BOXES[i];
+		rule.highlight = false;
+		rule.highlightColor[0] = rule.highlightColor[1] = rule.highlightColor[2] = 0;
+		rules.push_back(rule);
+	}
+
+	// The red pixels are painted green [R=0, G=255, B=0] in the processed image
+	rules[FEATURE_RED].highlight = true;
+	rules[FEATURE_RED].highlightColor[1] = 255;
+
+	return rules;
+}
+
+// Parses "lo-hi" or a single value "v" into [lo, hi]
+static bool ParseRange(const char *text, unsigned char &lo, unsigned char &hi) {
+	char *end;
+	long first = strtol(text, &end, 10);
+	long last = first;
+
+	if (end == text) {
+		return false;
+	}
+	if (*end == '-') {
+		const char *second = end + 1;
+		last = strtol(second, &end, 10);
+		if (end == second) {
+			return false;
+		}
+	}
+	if (*end != '\0' || first < 0 || last > 255 || first > last) {
+		return false;
+	}
+
+	lo = (unsigned char)first;
+	hi = (unsigned char)last;
+	return true;
+}
+
+// Parses "B,G,R"
+static bool ParseColor(const char *text, unsigned char color[3]) {
+	int blue, green, red;
+	char extra;
+
+	if (sscanf(text, "%d,%d,%d%c", &blue, &green, &red, &extra) != 3) {
+		return false;
+	}
+	if (blue < 0 || blue > 255 || green < 0 || green > 255 || red < 0 || red > 255) {
+		return false;
+	}
+
+	color[0] = (unsigned char)blue;
+	color[1] = (unsigned char)green;
+	color[2] = (unsigned char)red;
+	return true;
+}
+
+bool LoadColorRules(const char *fileName, vector<ColorRule> &rules) {
+	FILE *fp = fopen(fileName, "r");
+
+	if (fp == NULL) {
+		perror(fileName);
+		return false;
+	}
+
+	rules.clear();
+
+	char line[512];
+	int lineNb = 0;
+	bool ok = true;
+
+	while (ok && fgets(line, sizeof(line), fp) != NULL) {
+		lineNb++;
+
+		char *comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+
+		char name[128], blue[32], green[32], red[32], highlight[32];
+		int nbFields = sscanf(line, "%127s %31s %31s %31s %31s", name, blue, green, red, highlight);
+
+		if (nbFields <= 0) {
+			continue;	// blank line
+		}
+
+		ColorRule rule;
+		rule.name = name;
+		rule.highlight = nbFields == 5;
+		rule.highlightColor[0] = rule.highlightColor[1] = rule.highlightColor[2] = 0;
+
+		if (nbFields < 4
+			|| !ParseRange(blue, rule.box.loB, rule.box.hiB)
+			|| !ParseRange(green, rule.box.loG, rule.box.hiG)
+			|| !ParseRange(red, rule.box.loR, rule.box.hiR)) {
+			fprintf(stderr, "%s:%d: expected \"name blue green red [highlight]\" with ranges lo-hi in 0-255\n", fileName, lineNb);
+			ok = false;
+		}
+		else if (rule.highlight && !ParseColor(highlight, rule.highlightColor)) {
+			fprintf(stderr, "%s:%d: highlight colour must be B,G,R\n", fileName, lineNb);
+			ok = false;
+		}
+		else if (rules.size() == MAX_COLOR_RULES) {
+			fprintf(stderr, "%s:%d: more than %d colour rules\n", fileName, lineNb, MAX_COLOR_RULES);
+			ok = false;
+		}
+		else {
+			rules.push_back(rule);
+		}
+	}
+
+	fclose(fp);
+
+	if (ok && rules.empty()) {
+		fprintf(stderr, "%s: no colour rule\n", fileName);
+		ok = false;
+	}
+
+	return ok;
+}
+
+static bool SameName(const string &a, const string &b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++) {
+		if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SelectColorRules(const char *featureList, vector<ColorRule> &rules) {
+	vector<bool> selected(rules.size(), false);
+	string list = featureList;
+	bool ok = true;
+
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t end = list.find(',', start);
+		if (end == string::npos) {
+			end = list.size();
+		}
+		string name = list.substr(start, end - start);
+
+		bool found = false;
+		for (size_t i = 0; i < rules.size(); i++) {
+			if (SameName(rules[i].name, name)) {
+				selected[i] = true;
+				found = true;
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "Unknown feature: %s\n", name.c_str());
+			ok = false;
+		}
+
+		start = end + 1;
+	}
+
+	vector<ColorRule> kept;
+	for (size_t i = 0; i < rules.size(); i++) {
+		if (selected[i]) {
+			kept.push_back(rules[i]);
+		}
+	}
+	rules.swap(kept);
+
+	return ok;
+}
+
+static bool SameBox(const ColorBox &a, const ColorBox &b) {
+	return a.loB == b.loB && a.hiB == b.hiB && a.loG == b.loG && a.hiG == b.hiG && a.loR == b.loR && a.hiR == b.hiR;
+}
+
+ColorClassifier::ColorClassifier(const vector<ColorRule> &rules, bool forceLookup) : rules(rules) {
+
+	if (this->rules.size() > MAX_COLOR_RULES) {
+		this->rules.resize(MAX_COLOR_RULES);
+	}
+
+	// Each rule must be a different built-in colour for the fused kernel to apply
+	builtinMask = 0;
+	for (size_t i = 0; !forceLookup && i < this->rules.size(); i++) {
+		int feature = -1;
+		for (int k = 0; k < NUM_FEATURES && feature < 0; k++) {
+			if (SameBox(this->rules[i].box, COLOR_BOXES[k]) && !(builtinMask & FEATURE_BIT(k))) {
+				feature = k;
+			}
+		}
+		if (feature < 0 || i >= NUM_FEATURES) {
+			builtinMask = 0;
+			break;
+		}
+		builtinFeature[i] = feature;
+		builtinMask |= FEATURE_BIT(feature);
+	}
+
+	highlightMask = 0;
+	for (int v = 0; v < 256; v++) {
+		blueMask[v] = greenMask[v] = redMask[v] = 0;
+	}
+
+	for (size_t i = 0; i < this->rules.size(); i++) {
+		const ColorBox &box = this->rules[i].box;
+		uint64_t bit = (uint64_t)1 << i;
+
+		for (int v = box.loB; v <= box.hiB; v++) blueMask[v] |= bit;
+		for (int v = box.loG; v <= box.hiG; v++) greenMask[v] |= bit;
+		for (int v = box.loR; v <= box.hiR; v++) redMask[v] |= bit;
+
+		if (this->rules[i].highlight) {
+			highlightMask |= bit;
+		}
+	}
+}
+
+void ColorClassifier::CountLookup(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t *counts) const {
+
+	for (size_t i = 0; i < rules.size(); i++) {
+		counts[i] = 0;
+	}
+
+	// A gray level image has the same value in the three channels
+	int greenOffset = nChannels >= 3 ? 1 : 0;
+	int redOffset = nChannels >= 3 ? 2 : 0;
+
+	for (int h = 0; h < height; h++) // rows
+	{
+		const unsigned char *row = data + (ptrdiff_t)h * widthStep;
+
+		for (int w = 0; w < width; w++) // columns
+		{
+			const unsigned char *pixel = row + w * nChannels;
+			uint64_t mask = Classify(pixel[0], pixel[greenOffset], pixel[redOffset]);
+
+			// Most pixels match no rule, and few match more than one
+			while (mask != 0) {
+				counts[LowestBit(mask)]++;
+				mask &= mask - 1;
+			}
+		}
+	}
+}
+
+void ColorClassifier::Count(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t *counts) const {
+	if (builtinMask != 0) {
+		uint64_t builtinCounts[NUM_FEATURES];
+		CountColorPixels(builtinMask, data, width, height, widthStep, nChannels, builtinCounts);
+		for (size_t i = 0; i < rules.size(); i++) {
+			counts[i] = builtinCounts[builtinFeature[i]];
+		}
+	}
+	else {
+		CountLookup(data, width, height, widthStep, nChannels, counts);
+	}
+}
+
+void ColorClassifier::CountPalette(const uint64_t histogram[256], const unsigned char *palette, int paletteSize, uint64_t *counts) const {
+
+	for (size_t i = 0; i < rules.size(); i++) {
+		counts[i] = 0;
+	}
+
+	for (int index = 0; index < 256; index++) {
+		if (histogram[index] == 0) {
+			continue;
+		}
+
+		const unsigned char *color = index < paletteSize ? palette + 4 * index : NULL;
+		uint64_t mask = color != NULL ? Classify(color[0], color[1], color[2]) : Classify(0, 0, 0);
+
+		while (mask != 0) {
+			counts[LowestBit(mask)] += histogram[index];
+			mask &= mask - 1;
+		}
+	}
+}
+
+void ColorClassifier::Highlight(const unsigned char *data, int width, int height, int widthStep, int nChannels,
+	unsigned char *out, int outStep, int outChannels) const {
+
+	if (highlightMask == 0 || outChannels < 3) {
+		return;
+	}
+
+	int greenOffset = nChannels >= 3 ? 1 : 0;
+	int redOffset = nChannels >= 3 ? 2 : 0;
+
+	for (int h = 0; h < height; h++) // rows
+	{
+		const unsigned char *row = data + (ptrdiff_t)h * widthStep;
+		unsigned char *outRow = out + (ptrdiff_t)h * outStep;
+
+		for (int w = 0; w < width; w++) // columns
+		{
+			const unsigned char *pixel = row + w * nChannels;
+			uint64_t mask = Classify(pixel[0], pixel[greenOffset], pixel[redOffset]) & highlightMask;
+
+			// The first highlighted rule containing the pixel gives its colour
+			if (mask != 0)
+			{
+				const unsigned char *color = rules[LowestBit(mask)].highlightColor;
+				outRow[w * outChannels + 0] = color[0];
+				outRow[w * outChannels + 1] = color[1];
+				outRow[w * outChannels + 2] = color[2];
+			}
+		}
+	}
+}
+
+void NormalizeFeatures(const uint64_t *counts, int nbFeatures, int width, int height, float *fVector) {
+
+	// Compute the percentage of pixels of a given colour.
+	// Normalize the feature by the image size
+	float nbPixels = (float)((int64_t)height * width);
+
+	for (int i = 0; i < nbFeatures; i++) {
+		fVector[i] = (float)counts[i] / nbPixels;
+	}
+}
@@ -0,0 +1,113 @@
+#ifndef LABPRIMITIVE_COLOR_CLASSIFIER_H
+#define LABPRIMITIVE_COLOR_CLASSIFIER_H
+
+#include "color_features.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A pixel class is recorded as one bit of a 64-bit mask
+#define MAX_COLOR_RULES 64
+
+// One colour feature: a named BGR box, and the colour its pixels are painted with
+// in the processed image when highlight is set.
+struct ColorRule {
+	std::string name;
+	ColorBox box;
+	bool highlight;
+	unsigned char highlightColor[3];	// B, G, R
+};
+
+// The six built-in colours of COLOR_BOXES (Orange, White, Brown, Blue, Green, Red),
+// with the red pixels highlighted in green
+std::vector<ColorRule> BuiltinColorRules();
+
+// Reads colour rules from a text file, one rule per line:
+//     name  blue  green  red  [highlight]
+// where each channel is a range "lo-hi" or a single value, and the optional highlight
+// is "B,G,R". Blank lines and text after '#' are ignored.
+// Errors are reported on stderr with the line number; returns false on any error.
+bool LoadColorRules(const char *fileName, std::vector<ColorRule> &rules);
+
+// Colour rules compiled for classification. A BGR box is the intersection of one
+// interval per channel, so the set of rules containing a pixel is
+//     blueMask[b] & greenMask[g] & redMask[r]
+// which costs the same whatever the number of rules. The three 256-entry tables
+// (6 KB) stay in L1, where a table over all 2^24 packed BGR values would not.
+// When every rule is one of the built-in colours, counting goes through the fused
+// SIMD kernel specialized for exactly this subset instead (see CountColorPixels),
+// unless forceLookup is set.
+class ColorClassifier {
+public:
+	explicit ColorClassifier(const std::vector<ColorRule> &rules, bool forceLookup = false);
+
+	const std::vector<ColorRule> &Rules() const { return rules; }
+	int NbFeatures() const { return (int)rules.size(); }
+
+	// Mask of the rules containing a pixel (bit i = rule i)
+	uint64_t Classify(unsigned char blue, unsigned char green, unsigned char red) const {
+		return blueMask[blue] & greenMask[green] & redMask[red];
+	}
+
+	// Counts, for each rule, the pixels of a BGR image that have its colour
+	void Count(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t *counts) const;
+
+	// Same, always with the lookup tables
+	void CountLookup(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t *counts) const;
+
+	// Counts, for each rule, the pixels of a palette image from the histogram of its
+	// palette indices: each palette colour (B, G, R, reserved) is classified once.
+	// Indices past paletteSize are black.
+	void CountPalette(const uint64_t histogram[256], const unsigned char *palette, int paletteSize, uint64_t *counts) const;
+
+	// Paints the pixels of the highlighted rules of a BGR image in out, an image of the
+	// same size with outChannels (at least 3) channels and outStep bytes per row
+	void Highlight(const unsigned char *data, int width, int height, int widthStep, int nChannels,
+		unsigned char *out, int outStep, int outChannels) const;
+
+private:
+	std::vector<ColorRule> rules;
+
+	// Built-in subset: builtinMask of the fused kernel, and the built-in feature of each
+	// rule. builtinMask is 0 when the lookup tables are used.
+	unsigned builtinMask;
+	int builtinFeature[NUM_FEATURES];
+
+	uint64_t highlightMask;
+	uint64_t blueMask[256];
+	uint64_t greenMask[256];
+	uint64_t redMask[256];
+};
+
+// Index of the lowest set bit of a non-zero mask
+inline int LowestBit(uint64_t mask) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)mask)) {
+		return (int)index;
+	}
+	_BitScanForward(&index, (unsigned long)(mask >> 32));
+	return (int)index + 32;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+// Keeps the rules named in a comma-separated list (case does not matter), in rule order.
+// Unknown names are reported on stderr; returns false on any error.
+bool SelectColorRules(const char *featureList, std::vector<ColorRule> &rules);
+
+// Lets make our counting somewhat independent on the image size...
+// Stores in fVector the percentage of pixels of each colour.
+void NormalizeFeatures(const uint64_t *counts, int nbFeatures, int width, int height, float *fVector);
+
+#endif
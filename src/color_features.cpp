@@ -0,0 +1,154 @@
+#include "color_features.h"
+#include "color_kernel_table.h"
+#include "cpu_features.h"
+#include "histogram.h"
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// True when the pixel has the colour K of COLOR_BOXES. The bounds are compile-time
+// constants, so the comparisons against 0 and 255 disappear.
+template<int K>
+static inline bool InColorBox(unsigned char blue, unsigned char green, unsigned char red) {
+	return blue >= COLOR_BOXES[K].loB && blue <= COLOR_BOXES[K].hiB
+		&& green >= COLOR_BOXES[K].loG && green <= COLOR_BOXES[K].hiG
+		&& red >= COLOR_BOXES[K].loR && red <= COLOR_BOXES[K].hiR;
+}
+
+// Fused scalar kernel for the features of Mask
+template<unsigned Mask>
+struct ScalarKernel {
+	static void Count(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+
+		uint64_t nOrange = 0;
+		uint64_t nWhite = 0;
+		uint64_t nBrown = 0;
+		uint64_t nBlue = 0;
+		uint64_t nGreen = 0;
+		uint64_t nRed = 0;
+
+		// A gray level image has the same value in the three channels
+		int greenOffset = nChannels >= 3 ? 1 : 0;
+		int redOffset = nChannels >= 3 ? 2 : 0;
+
+		// Loop that reads each image pixel
+		for (int h = 0; h < height; h++) // rows
+		{
+			const unsigned char *row = data + (ptrdiff_t)h * widthStep;
+
+			for (int w = 0; w < width; w++) // columns
+			{
+				// Read each channel. Notice that OpenCV considers BGR
+				const unsigned char *pixel = row + w * nChannels;
+				unsigned char blue = pixel[0];
+				unsigned char green = pixel[greenOffset];
+				unsigned char red = pixel[redOffset];
+
+				if (Mask & FEATURE_BIT(FEATURE_ORANGE)) nOrange += InColorBox<FEATURE_ORANGE>(blue, green, red);
+				if (Mask & FEATURE_BIT(FEATURE_WHITE)) nWhite += InColorBox<FEATURE_WHITE>(blue, green, red);
+				if (Mask & FEATURE_BIT(FEATURE_BROWN)) nBrown += InColorBox<FEATURE_BROWN>(blue, green, red);
+				if (Mask & FEATURE_BIT(FEATURE_BLUE)) nBlue += InColorBox<FEATURE_BLUE>(blue, green, red);
+				if (Mask & FEATURE_BIT(FEATURE_GREEN)) nGreen += InColorBox<FEATURE_GREEN>(blue, green, red);
+				if (Mask & FEATURE_BIT(FEATURE_RED)) nRed += InColorBox<FEATURE_RED>(blue, green, red);
+			}
+		}
+
+		counts[FEATURE_ORANGE] = nOrange;
+		counts[FEATURE_WHITE] = nWhite;
+		counts[FEATURE_BROWN] = nBrown;
+		counts[FEATURE_BLUE] = nBlue;
+		counts[FEATURE_GREEN] = nGreen;
+		counts[FEATURE_RED] = nRed;
+	}
+};
+
+void CountColorPixelsScalar(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+	ScalarKernel<ALL_FEATURES>::Count(data, width, height, widthStep, nChannels, counts);
+}
+
+CountColorPixelsFn ScalarColorKernel(unsigned featureMask) {
+	static CountColorPixelsFn table[ALL_FEATURES + 1];
+	static bool filled = (ColorKernelTable<ScalarKernel, ALL_FEATURES>::Fill(table), true);
+
+	(void)filled;
+	return table[featureMask & ALL_FEATURES];
+}
+
+// Kernel table of the instruction set picked by SetColorKernel, NULL until then, and
+// the histogram kernel of the same instruction set
+static CountColorPixelsFn (*colorKernelTable)(unsigned featureMask) = NULL;
+static const char *colorKernelName = NULL;
+static HistogramRowFn histogramKernel = NULL;
+
+static void UseBestColorKernel() {
+	if (CpuSupportsAvx2()) {
+		colorKernelTable = Avx2ColorKernel;
+		colorKernelName = "avx2";
+		histogramKernel = AddHistogramRowAvx2;
+	}
+	else if (CpuSupportsSse42()) {
+		colorKernelTable = Sse42ColorKernel;
+		colorKernelName = "sse42";
+		histogramKernel = AddHistogramRowSse42;
+	}
+	else {
+		colorKernelTable = ScalarColorKernel;
+		colorKernelName = "scalar";
+		histogramKernel = AddHistogramRowScalar;
+	}
+}
+
+bool SetColorKernel(const char *name) {
+	string kernel = name;
+
+	if (kernel == "auto") {
+		UseBestColorKernel();
+	}
+	else if (kernel == "scalar") {
+		colorKernelTable = ScalarColorKernel;
+		colorKernelName = "scalar";
+		histogramKernel = AddHistogramRowScalar;
+	}
+	else if (kernel == "sse42" && CpuSupportsSse42()) {
+		colorKernelTable = Sse42ColorKernel;
+		colorKernelName = "sse42";
+		histogramKernel = AddHistogramRowSse42;
+	}
+	else if (kernel == "avx2" && CpuSupportsAvx2()) {
+		colorKernelTable = Avx2ColorKernel;
+		colorKernelName = "avx2";
+		histogramKernel = AddHistogramRowAvx2;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+const char *ColorKernelName() {
+	if (colorKernelTable == NULL) {
+		UseBestColorKernel();
+	}
+	return colorKernelName;
+}
+
+CountColorPixelsFn SelectedColorKernel(unsigned featureMask) {
+	if (colorKernelTable == NULL) {
+		UseBestColorKernel();
+	}
+	return colorKernelTable(featureMask);
+}
+
+HistogramRowFn SelectedHistogramKernel() {
+	if (colorKernelTable == NULL) {
+		UseBestColorKernel();
+	}
+	return histogramKernel;
+}
+
+void CountColorPixels(unsigned featureMask, const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+	SelectedColorKernel(featureMask)(data, width, height, widthStep, nChannels, counts);
+}
@@ -0,0 +1,76 @@
+#ifndef LABPRIMITIVE_COLOR_FEATURES_H
+#define LABPRIMITIVE_COLOR_FEATURES_H
+
+#include <stdint.h>
+
+#define NUM_FEATURES 6
+
+// Column of each feature in the feature vector
+enum {
+	FEATURE_ORANGE = 0,
+	FEATURE_WHITE = 1,
+	FEATURE_BROWN = 2,
+	FEATURE_BLUE = 3,
+	FEATURE_GREEN = 4,
+	FEATURE_RED = 5
+};
+
+// A set of features is a mask with bit i for the feature i
+#define FEATURE_BIT(feature) (1u << (feature))
+#define ALL_FEATURES ((1u << NUM_FEATURES) - 1)
+
+// A colour is a box in BGR space: a pixel has the colour when each channel is within [lo, hi]
+struct ColorBox {
+	unsigned char loB, hiB;
+	unsigned char loG, hiG;
+	unsigned char loR, hiR;
+};
+
+// The six colours of the feature vector, in feature order
+constexpr ColorBox COLOR_BOXES[NUM_FEATURES] = {
+	// Orange, defined as R[240-255], G[85-105], B[11-22]
+	{ 11, 22, 85, 105, 240, 255 },
+	// White, defined as R[253-255], G[253-255], B[253-255] (just a dummy feature...)
+	{ 253, 255, 253, 255, 253, 255 },
+	// Brown, defined as R[180-210], G[168-178], B[102-112]
+	{ 102, 112, 168, 178, 180, 210 },
+	// Blue, defined as R[0-25], G[0-130], B[100-255]
+	{ 100, 255, 0, 130, 0, 25 },
+	// Green, defined as R[70-90], G[130-150], B[14-34]
+	{ 14, 34, 130, 150, 70, 90 },
+	// Red, defined as R[190-255], G[0-50], B[0-50]
+	{ 0, 50, 0, 50, 190, 255 }
+};
+
+// Counts, for every colour of COLOR_BOXES, the pixels of an image that have this colour.
+// data points to the first row of a BGR image (nChannels >= 3, or 1 for gray levels)
+// and widthStep is the distance in bytes from one row to the next.
+typedef void (*CountColorPixelsFn)(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]);
+
+// Fused kernels: one pass over the pixels checks all six colours with integer counters.
+// The SIMD kernels classify 16 (SSE4.2) or 32 (AVX2) 3-channel pixels per iteration and
+// give exactly the counts of the scalar kernel.
+void CountColorPixelsScalar(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]);
+void CountColorPixelsSse42(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]);
+void CountColorPixelsAvx2(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]);
+
+// The same kernels, specialized at compile time for each of the 64 subsets of the six
+// colours: a colour missing from featureMask costs no instruction in the pixel loop,
+// and its count is left at zero.
+CountColorPixelsFn ScalarColorKernel(unsigned featureMask);
+CountColorPixelsFn Sse42ColorKernel(unsigned featureMask);
+CountColorPixelsFn Avx2ColorKernel(unsigned featureMask);
+
+// Instruction set of the kernels used by CountColorPixels: "auto" (best one supported by
+// the CPU), "scalar", "sse42" or "avx2". Returns false if the name is unknown or the CPU
+// lacks the instructions.
+bool SetColorKernel(const char *name);
+const char *ColorKernelName();
+
+// Kernel of the selected instruction set specialized for featureMask
+CountColorPixelsFn SelectedColorKernel(unsigned featureMask);
+
+// Counts the colour pixels of the features in featureMask with the selected kernel
+void CountColorPixels(unsigned featureMask, const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef LABPRIMITIVE_COLOR_KERNEL_TABLE_H
+#define LABPRIMITIVE_COLOR_KERNEL_TABLE_H
+
+#include "color_features.h"
+
+// Fills table[mask] with Kernel<mask>::Count for every mask from 0 to Mask, so that a
+// kernel specialized for a set of features can be picked at runtime.
+template<template<unsigned> class Kernel, unsigned Mask>
+struct ColorKernelTable {
+	static void Fill(CountColorPixelsFn table[]) {
+		table[Mask] = Kernel<Mask>::Count;
+		ColorKernelTable<Kernel, Mask - 1>::Fill(table);
+	}
+};
+
+template<template<unsigned> class Kernel>
+struct ColorKernelTable<Kernel, 0> {
+	static void Fill(CountColorPixelsFn table[]) {
+		table[0] = Kernel<0>::Count;
+	}
+};
+
+#endif
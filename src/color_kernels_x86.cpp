@@ -0,0 +1,430 @@
+#include "color_features.h"
+#include "color_kernel_table.h"
+#include "cpu_features.h"
+#include "histogram.h"
+
+#include <cstddef>
+
+#ifdef LABPRIMITIVE_X86
+
+#include <immintrin.h>
+
+// pshufb controls gathering the blue, green and red bytes of 16 interleaved BGR pixels
+// loaded in three 16-byte registers: one control per register, -1 clears the byte.
+static const signed char SHUFFLE_BLUE[3][16] = {
+	{ 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13 }
+};
+static const signed char SHUFFLE_GREEN[3][16] = {
+	{ 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14 }
+};
+static const signed char SHUFFLE_RED[3][16] = {
+	{ 2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1 },
+	{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15 }
+};
+
+// The SIMD kernels count in 8-bit lanes (subtracting the 0xFF match masks) and drain
+// the lanes into the 64-bit counters before they can wrap.
+#define MAX_PENDING_ITERATIONS 255
+
+// ---------------------------------------------------------------------------------------
+// SSE4.2: 16 pixels per iteration
+// ---------------------------------------------------------------------------------------
+
+static inline LABPRIMITIVE_TARGET_SSE42 __m128i LoadShuffle(const signed char control[16]) {
+	return _mm_loadu_si128((const __m128i *)control);
+}
+
+static inline LABPRIMITIVE_TARGET_SSE42 __m128i Gather(__m128i a, __m128i b, __m128i c, const __m128i control[3]) {
+	return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, control[0]), _mm_shuffle_epi8(b, control[1])), _mm_shuffle_epi8(c, control[2]));
+}
+
+// 0xFF in the lanes of the pixels having the colour K, 0 elsewhere.
+// A channel is out of [lo, hi] when (lo -sat x) or (x -sat hi) is not zero.
+template<int K>
+static inline LABPRIMITIVE_TARGET_SSE42 __m128i InColorBoxSse42(__m128i blue, __m128i green, __m128i red) {
+	__m128i outside = _mm_setzero_si128();
+
+	if (COLOR_BOXES[K].loB > 0) outside = _mm_or_si128(outside, _mm_subs_epu8(_mm_set1_epi8((char)COLOR_BOXES[K].loB), blue));
+	if (COLOR_BOXES[K].hiB < 255) outside = _mm_or_si128(outside, _mm_subs_epu8(blue, _mm_set1_epi8((char)COLOR_BOXES[K].hiB)));
+	if (COLOR_BOXES[K].loG > 0) outside = _mm_or_si128(outside, _mm_subs_epu8(_mm_set1_epi8((char)COLOR_BOXES[K].loG), green));
+	if (COLOR_BOXES[K].hiG < 255) outside = _mm_or_si128(outside, _mm_subs_epu8(green, _mm_set1_epi8((char)COLOR_BOXES[K].hiG)));
+	if (COLOR_BOXES[K].loR > 0) outside = _mm_or_si128(outside, _mm_subs_epu8(_mm_set1_epi8((char)COLOR_BOXES[K].loR), red));
+	if (COLOR_BOXES[K].hiR < 255) outside = _mm_or_si128(outside, _mm_subs_epu8(red, _mm_set1_epi8((char)COLOR_BOXES[K].hiR)));
+
+	return _mm_cmpeq_epi8(outside, _mm_setzero_si128());
+}
+
+static inline LABPRIMITIVE_TARGET_SSE42 uint64_t SumBytes(__m128i acc) {
+	__m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+	return (uint64_t)(unsigned int)_mm_cvtsi128_si32(sums) + (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+
+// Fused SSE4.2 kernel for the features of Mask
+template<unsigned Mask>
+struct Sse42Kernel {
+	static LABPRIMITIVE_TARGET_SSE42 void Count(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+
+		if (nChannels != 3) {
+			ScalarColorKernel(Mask)(data, width, height, widthStep, nChannels, counts);
+			return;
+		}
+
+		const __m128i blueControl[3] = { LoadShuffle(SHUFFLE_BLUE[0]), LoadShuffle(SHUFFLE_BLUE[1]), LoadShuffle(SHUFFLE_BLUE[2]) };
+		const __m128i greenControl[3] = { LoadShuffle(SHUFFLE_GREEN[0]), LoadShuffle(SHUFFLE_GREEN[1]), LoadShuffle(SHUFFLE_GREEN[2]) };
+		const __m128i redControl[3] = { LoadShuffle(SHUFFLE_RED[0]), LoadShuffle(SHUFFLE_RED[1]), LoadShuffle(SHUFFLE_RED[2]) };
+
+		for (int i = 0; i < NUM_FEATURES; i++) {
+			counts[i] = 0;
+		}
+
+		int vectorWidth = width & ~15;
+
+		for (int h = 0; h < height; h++) {
+			const unsigned char *row = data + (ptrdiff_t)h * widthStep;
+
+			__m128i accOrange = _mm_setzero_si128();
+			__m128i accWhite = _mm_setzero_si128();
+			__m128i accBrown = _mm_setzero_si128();
+			__m128i accBlue = _mm_setzero_si128();
+			__m128i accGreen = _mm_setzero_si128();
+			__m128i accRed = _mm_setzero_si128();
+			int pending = 0;
+
+			for (int w = 0; w < vectorWidth; w += 16) {
+				const unsigned char *pixels = row + 3 * w;
+				__m128i a = _mm_loadu_si128((const __m128i *)pixels);
+				__m128i b = _mm_loadu_si128((const __m128i *)(pixels + 16));
+				__m128i c = _mm_loadu_si128((const __m128i *)(pixels + 32));
+
+				__m128i blue = Gather(a, b, c, blueControl);
+				__m128i green = Gather(a, b, c, greenControl);
+				__m128i red = Gather(a, b, c, redControl);
+
+				if (Mask & FEATURE_BIT(FEATURE_ORANGE)) accOrange = _mm_sub_epi8(accOrange, InColorBoxSse42<FEATURE_ORANGE>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_WHITE)) accWhite = _mm_sub_epi8(accWhite, InColorBoxSse42<FEATURE_WHITE>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_BROWN)) accBrown = _mm_sub_epi8(accBrown, InColorBoxSse42<FEATURE_BROWN>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_BLUE)) accBlue = _mm_sub_epi8(accBlue, InColorBoxSse42<FEATURE_BLUE>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_GREEN)) accGreen = _mm_sub_epi8(accGreen, InColorBoxSse42<FEATURE_GREEN>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_RED)) accRed = _mm_sub_epi8(accRed, InColorBoxSse42<FEATURE_RED>(blue, green, red));
+
+				if (++pending == MAX_PENDING_ITERATIONS || w + 16 >= vectorWidth) {
+					if (Mask & FEATURE_BIT(FEATURE_ORANGE)) counts[FEATURE_ORANGE] += SumBytes(accOrange);
+					if (Mask & FEATURE_BIT(FEATURE_WHITE)) counts[FEATURE_WHITE] += SumBytes(accWhite);
+					if (Mask & FEATURE_BIT(FEATURE_BROWN)) counts[FEATURE_BROWN] += SumBytes(accBrown);
+					if (Mask & FEATURE_BIT(FEATURE_BLUE)) counts[FEATURE_BLUE] += SumBytes(accBlue);
+					if (Mask & FEATURE_BIT(FEATURE_GREEN)) counts[FEATURE_GREEN] += SumBytes(accGreen);
+					if (Mask & FEATURE_BIT(FEATURE_RED)) counts[FEATURE_RED] += SumBytes(accRed);
+
+					accOrange = accWhite = accBrown = accBlue = accGreen = accRed = _mm_setzero_si128();
+					pending = 0;
+				}
+			}
+
+			// Last pixels of the row, fewer than 16
+			if (vectorWidth < width) {
+				uint64_t tail[NUM_FEATURES];
+				ScalarColorKernel(Mask)(row + 3 * vectorWidth, width - vectorWidth, 1, widthStep, 3, tail);
+				for (int i = 0; i < NUM_FEATURES; i++) {
+					counts[i] += tail[i];
+				}
+			}
+		}
+	}
+};
+
+void CountColorPixelsSse42(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+	Sse42Kernel<ALL_FEATURES>::Count(data, width, height, widthStep, nChannels, counts);
+}
+
+CountColorPixelsFn Sse42ColorKernel(unsigned featureMask) {
+	static CountColorPixelsFn table[ALL_FEATURES + 1];
+	static bool filled = (ColorKernelTable<Sse42Kernel, ALL_FEATURES>::Fill(table), true);
+
+	(void)filled;
+	return table[featureMask & ALL_FEATURES];
+}
+
+// ---------------------------------------------------------------------------------------
+// AVX2: 32 pixels per iteration. Each 128-bit lane holds 16 consecutive pixels, so the
+// in-lane vpshufb uses the same controls as the SSE4.2 kernel.
+// ---------------------------------------------------------------------------------------
+
+static inline LABPRIMITIVE_TARGET_AVX2 __m256i LoadLanes(const unsigned char *low, const unsigned char *high) {
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)low)), _mm_loadu_si128((const __m128i *)high), 1);
+}
+
+static inline LABPRIMITIVE_TARGET_AVX2 __m256i BroadcastShuffle(const signed char control[16]) {
+	return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)control));
+}
+
+static inline LABPRIMITIVE_TARGET_AVX2 __m256i Gather(__m256i a, __m256i b, __m256i c, const __m256i control[3]) {
+	return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, control[0]), _mm256_shuffle_epi8(b, control[1])), _mm256_shuffle_epi8(c, control[2]));
+}
+
+template<int K>
+static inline LABPRIMITIVE_TARGET_AVX2 __m256i InColorBoxAvx2(__m256i blue, __m256i green, __m256i red) {
+	__m256i outside = _mm256_setzero_si256();
+
+	if (COLOR_BOXES[K].loB > 0) outside = _mm256_or_si256(outside, _mm256_subs_epu8(_mm256_set1_epi8((char)COLOR_BOXES[K].loB), blue));
+	if (COLOR_BOXES[K].hiB < 255) outside = _mm256_or_si256(outside, _mm256_subs_epu8(blue, _mm256_set1_epi8((char)COLOR_BOXES[K].hiB)));
+	if (COLOR_BOXES[K].loG > 0) outside = _mm256_or_si256(outside, _mm256_subs_epu8(_mm256_set1_epi8((char)COLOR_BOXES[K].loG), green));
+	if (COLOR_BOXES[K].hiG < 255) outside = _mm256_or_si256(outside, _mm256_subs_epu8(green, _mm256_set1_epi8((char)COLOR_BOXES[K].hiG)));
+	if (COLOR_BOXES[K].loR > 0) outside = _mm256_or_si256(outside, _mm256_subs_epu8(_mm256_set1_epi8((char)COLOR_BOXES[K].loR), red));
+	if (COLOR_BOXES[K].hiR < 255) outside = _mm256_or_si256(outside, _mm256_subs_epu8(red, _mm256_set1_epi8((char)COLOR_BOXES[K].hiR)));
+
+	return _mm256_cmpeq_epi8(outside, _mm256_setzero_si256());
+}
+
+static inline LABPRIMITIVE_TARGET_AVX2 uint64_t SumBytes(__m256i acc) {
+	__m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+	__m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+	return (uint64_t)(unsigned int)_mm_cvtsi128_si32(halves) + (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(halves, 8));
+}
+
+// Fused AVX2 kernel for the features of Mask
+template<unsigned Mask>
+struct Avx2Kernel {
+	static LABPRIMITIVE_TARGET_AVX2 void Count(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+
+		if (nChannels != 3) {
+			ScalarColorKernel(Mask)(data, width, height, widthStep, nChannels, counts);
+			return;
+		}
+
+		const __m256i blueControl[3] = { BroadcastShuffle(SHUFFLE_BLUE[0]), BroadcastShuffle(SHUFFLE_BLUE[1]), BroadcastShuffle(SHUFFLE_BLUE[2]) };
+		const __m256i greenControl[3] = { BroadcastShuffle(SHUFFLE_GREEN[0]), BroadcastShuffle(SHUFFLE_GREEN[1]), BroadcastShuffle(SHUFFLE_GREEN[2]) };
+		const __m256i redControl[3] = { BroadcastShuffle(SHUFFLE_RED[0]), BroadcastShuffle(SHUFFLE_RED[1]), BroadcastShuffle(SHUFFLE_RED[2]) };
+
+		for (int i = 0; i < NUM_FEATURES; i++) {
+			counts[i] = 0;
+		}
+
+		int vectorWidth = width & ~31;
+
+		for (int h = 0; h < height; h++) {
+			const unsigned char *row = data + (ptrdiff_t)h * widthStep;
+
+			__m256i accOrange = _mm256_setzero_si256();
+			__m256i accWhite = _mm256_setzero_si256();
+			__m256i accBrown = _mm256_setzero_si256();
+			__m256i accBlue = _mm256_setzero_si256();
+			__m256i accGreen = _mm256_setzero_si256();
+			__m256i accRed = _mm256_setzero_si256();
+			int pending = 0;
+
+			for (int w = 0; w < vectorWidth; w += 32) {
+				// Pixels w..w+15 in the low lanes, w+16..w+31 in the high lanes
+				const unsigned char *pixels = row + 3 * w;
+				__m256i a = LoadLanes(pixels, pixels + 48);
+				__m256i b = LoadLanes(pixels + 16, pixels + 64);
+				__m256i c = LoadLanes(pixels + 32, pixels + 80);
+
+				__m256i blue = Gather(a, b, c, blueControl);
+				__m256i green = Gather(a, b, c, greenControl);
+				__m256i red = Gather(a, b, c, redControl);
+
+				if (Mask & FEATURE_BIT(FEATURE_ORANGE)) accOrange = _mm256_sub_epi8(accOrange, InColorBoxAvx2<FEATURE_ORANGE>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_WHITE)) accWhite = _mm256_sub_epi8(accWhite, InColorBoxAvx2<FEATURE_WHITE>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_BROWN)) accBrown = _mm256_sub_epi8(accBrown, InColorBoxAvx2<FEATURE_BROWN>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_BLUE)) accBlue = _mm256_sub_epi8(accBlue, InColorBoxAvx2<FEATURE_BLUE>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_GREEN)) accGreen = _mm256_sub_epi8(accGreen, InColorBoxAvx2<FEATURE_GREEN>(blue, green, red));
+				if (Mask & FEATURE_BIT(FEATURE_RED)) accRed = _mm256_sub_epi8(accRed, InColorBoxAvx2<FEATURE_RED>(blue, green, red));
+
+				if (++pending == MAX_PENDING_ITERATIONS || w + 32 >= vectorWidth) {
+					if (Mask & FEATURE_BIT(FEATURE_ORANGE)) counts[FEATURE_ORANGE] += SumBytes(accOrange);
+					if (Mask & FEATURE_BIT(FEATURE_WHITE)) counts[FEATURE_WHITE] += SumBytes(accWhite);
+					if (Mask & FEATURE_BIT(FEATURE_BROWN)) counts[FEATURE_BROWN] += SumBytes(accBrown);
+					if (Mask & FEATURE_BIT(FEATURE_BLUE)) counts[FEATURE_BLUE] += SumBytes(accBlue);
+					if (Mask & FEATURE_BIT(FEATURE_GREEN)) counts[FEATURE_GREEN] += SumBytes(accGreen);
+					if (Mask & FEATURE_BIT(FEATURE_RED)) counts[FEATURE_RED] += SumBytes(accRed);
+
+					accOrange = accWhite = accBrown = accBlue = accGreen = accRed = _mm256_setzero_si256();
+					pending = 0;
+				}
+			}
+
+			// Last pixels of the row, fewer than 32
+			if (vectorWidth < width) {
+				uint64_t tail[NUM_FEATURES];
+				Sse42Kernel<Mask>::Count(row + 3 * vectorWidth, width - vectorWidth, 1, widthStep, 3, tail);
+				for (int i = 0; i < NUM_FEATURES; i++) {
+					counts[i] += tail[i];
+				}
+			}
+		}
+	}
+};
+
+void CountColorPixelsAvx2(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+	Avx2Kernel<ALL_FEATURES>::Count(data, width, height, widthStep, nChannels, counts);
+}
+
+CountColorPixelsFn Avx2ColorKernel(unsigned featureMask) {
+	static CountColorPixelsFn table[ALL_FEATURES + 1];
+	static bool filled = (ColorKernelTable<Avx2Kernel, ALL_FEATURES>::Fill(table), true);
+
+	(void)filled;
+	return table[featureMask & ALL_FEATURES];
+}
+
+// ---------------------------------------------------------------------------------------
+// Histogram bins: the channels are gathered as above, quantized in 8-bit lanes, then
+// widened to 16-bit bin indices. Pixels of the same tile of a flat region share a bin,
+// so a group of 16 in one bin is counted with a single addition; other groups are
+// scattered over the sub-histograms from the stored indices.
+// ---------------------------------------------------------------------------------------
+
+// Pixels first..width-1, left over by the vector loop
+static void AddHistogramTail(const unsigned char *row, int first, int width, int shift, int bits, uint32_t *lanes) {
+	for (int w = first; w < width; w++) {
+		const unsigned char *pixel = row + 3 * w;
+		lanes[((uint32_t)(pixel[0] >> shift) << (2 * bits)) | ((uint32_t)(pixel[1] >> shift) << bits) | (uint32_t)(pixel[2] >> shift)]++;
+	}
+}
+
+// Scatters 8 bin indices, the pixel i going to the sub-histogram i % HISTOGRAM_LANES
+static inline void ScatterBins(const uint16_t bins[8], uint32_t *lanes, size_t nbBins) {
+	uint32_t *h0 = lanes;
+	uint32_t *h1 = lanes + nbBins;
+	uint32_t *h2 = lanes + 2 * nbBins;
+	uint32_t *h3 = lanes + 3 * nbBins;
+
+	for (int i = 0; i < 8; i += 4) {
+		h0[bins[i]]++;
+		h1[bins[i + 1]]++;
+		h2[bins[i + 2]]++;
+		h3[bins[i + 3]]++;
+	}
+}
+
+void LABPRIMITIVE_TARGET_SSE42 AddHistogramRowSse42(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins) {
+	const __m128i blueControl[3] = { LoadShuffle(SHUFFLE_BLUE[0]), LoadShuffle(SHUFFLE_BLUE[1]), LoadShuffle(SHUFFLE_BLUE[2]) };
+	const __m128i greenControl[3] = { LoadShuffle(SHUFFLE_GREEN[0]), LoadShuffle(SHUFFLE_GREEN[1]), LoadShuffle(SHUFFLE_GREEN[2]) };
+	const __m128i redControl[3] = { LoadShuffle(SHUFFLE_RED[0]), LoadShuffle(SHUFFLE_RED[1]), LoadShuffle(SHUFFLE_RED[2]) };
+
+	// Shifting 16-bit lanes moves bits across the bytes: the mask keeps the quantized ones
+	const __m128i levels = _mm_set1_epi8((char)(0xFF >> shift));
+	const __m128i quantizeShift = _mm_cvtsi32_si128(shift);
+	const __m128i greenShift = _mm_cvtsi32_si128(bits);
+	const __m128i blueShift = _mm_cvtsi32_si128(2 * bits);
+	const __m128i zero = _mm_setzero_si128();
+
+	uint16_t bins[16];
+	int vectorWidth = width & ~15;
+
+	for (int w = 0; w < vectorWidth; w += 16) {
+		const unsigned char *pixels = row + 3 * w;
+		__m128i a = _mm_loadu_si128((const __m128i *)pixels);
+		__m128i b = _mm_loadu_si128((const __m128i *)(pixels + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(pixels + 32));
+
+		__m128i blue = _mm_and_si128(_mm_srl_epi16(Gather(a, b, c, blueControl), quantizeShift), levels);
+		__m128i green = _mm_and_si128(_mm_srl_epi16(Gather(a, b, c, greenControl), quantizeShift), levels);
+		__m128i red = _mm_and_si128(_mm_srl_epi16(Gather(a, b, c, redControl), quantizeShift), levels);
+
+		// Pixels 0..7, then 8..15
+		__m128i low = _mm_or_si128(_mm_or_si128(_mm_sll_epi16(_mm_unpacklo_epi8(blue, zero), blueShift),
+			_mm_sll_epi16(_mm_unpacklo_epi8(green, zero), greenShift)), _mm_unpacklo_epi8(red, zero));
+		__m128i high = _mm_or_si128(_mm_or_si128(_mm_sll_epi16(_mm_unpackhi_epi8(blue, zero), blueShift),
+			_mm_sll_epi16(_mm_unpackhi_epi8(green, zero), greenShift)), _mm_unpackhi_epi8(red, zero));
+
+		__m128i first = _mm_shuffle_epi32(_mm_shufflelo_epi16(low, 0), 0);
+		if (_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi16(low, first), _mm_cmpeq_epi16(high, first))) == 0xFFFF) {
+			lanes[_mm_cvtsi128_si32(low) & 0xFFFF] += 16;
+			continue;
+		}
+
+		_mm_storeu_si128((__m128i *)bins, low);
+		_mm_storeu_si128((__m128i *)(bins + 8), high);
+		ScatterBins(bins, lanes, nbBins);
+		ScatterBins(bins + 8, lanes, nbBins);
+	}
+
+	AddHistogramTail(row, vectorWidth, width, shift, bits, lanes);
+}
+
+void LABPRIMITIVE_TARGET_AVX2 AddHistogramRowAvx2(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins) {
+	const __m256i blueControl[3] = { BroadcastShuffle(SHUFFLE_BLUE[0]), BroadcastShuffle(SHUFFLE_BLUE[1]), BroadcastShuffle(SHUFFLE_BLUE[2]) };
+	const __m256i greenControl[3] = { BroadcastShuffle(SHUFFLE_GREEN[0]), BroadcastShuffle(SHUFFLE_GREEN[1]), BroadcastShuffle(SHUFFLE_GREEN[2]) };
+	const __m256i redControl[3] = { BroadcastShuffle(SHUFFLE_RED[0]), BroadcastShuffle(SHUFFLE_RED[1]), BroadcastShuffle(SHUFFLE_RED[2]) };
+
+	const __m256i levels = _mm256_set1_epi8((char)(0xFF >> shift));
+	const __m128i quantizeShift = _mm_cvtsi32_si128(shift);
+	const __m128i greenShift = _mm_cvtsi32_si128(bits);
+	const __m128i blueShift = _mm_cvtsi32_si128(2 * bits);
+	const __m256i zero = _mm256_setzero_si256();
+
+	uint16_t bins[32];
+	int vectorWidth = width & ~31;
+
+	for (int w = 0; w < vectorWidth; w += 32) {
+		const unsigned char *pixels = row + 3 * w;
+		__m256i a = LoadLanes(pixels, pixels + 48);
+		__m256i b = LoadLanes(pixels + 16, pixels + 64);
+		__m256i c = LoadLanes(pixels + 32, pixels + 80);
+
+		__m256i blue = _mm256_and_si256(_mm256_srl_epi16(Gather(a, b, c, blueControl), quantizeShift), levels);
+		__m256i green = _mm256_and_si256(_mm256_srl_epi16(Gather(a, b, c, greenControl), quantizeShift), levels);
+		__m256i red = _mm256_and_si256(_mm256_srl_epi16(Gather(a, b, c, redControl), quantizeShift), levels);
+
+		// low holds the pixels 0..7 and 16..23, high 8..15 and 24..31: each 128-bit lane of
+		// the two is one group of 16
+		__m256i low = _mm256_or_si256(_mm256_or_si256(_mm256_sll_epi16(_mm256_unpacklo_epi8(blue, zero), blueShift),
+			_mm256_sll_epi16(_mm256_unpacklo_epi8(green, zero), greenShift)), _mm256_unpacklo_epi8(red, zero));
+		__m256i high = _mm256_or_si256(_mm256_or_si256(_mm256_sll_epi16(_mm256_unpackhi_epi8(blue, zero), blueShift),
+			_mm256_sll_epi16(_mm256_unpackhi_epi8(green, zero), greenShift)), _mm256_unpackhi_epi8(red, zero));
+
+		// Bin of the first pixel of each group, in every 16-bit lane of its half
+		__m256i first = _mm256_shuffle_epi32(_mm256_shufflelo_epi16(low, 0), 0);
+		unsigned same = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi16(low, first), _mm256_cmpeq_epi16(high, first)));
+
+		_mm256_storeu_si256((__m256i *)bins, low);
+		_mm256_storeu_si256((__m256i *)(bins + 16), high);
+
+		for (int group = 0; group < 2; group++) {
+			if (((same >> (16 * group)) & 0xFFFF) == 0xFFFF) {
+				lanes[bins[8 * group]] += 16;
+			}
+			else {
+				ScatterBins(bins + 8 * group, lanes, nbBins);
+				ScatterBins(bins + 16 + 8 * group, lanes, nbBins);
+			}
+		}
+	}
+
+	AddHistogramTail(row, vectorWidth, width, shift, bits, lanes);
+}
+
+#else
+
+// No SIMD kernel outside x86: SetColorKernel never selects these
+void CountColorPixelsSse42(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+	CountColorPixelsScalar(data, width, height, widthStep, nChannels, counts);
+}
+
+void CountColorPixelsAvx2(const unsigned char *data, int width, int height, int widthStep, int nChannels, uint64_t counts[NUM_FEATURES]) {
+	CountColorPixelsScalar(data, width, height, widthStep, nChannels, counts);
+}
+
+CountColorPixelsFn Sse42ColorKernel(unsigned featureMask) {
+	return ScalarColorKernel(featureMask);
+}
+
+CountColorPixelsFn Avx2ColorKernel(unsigned featureMask) {
+	return ScalarColorKernel(featureMask);
+}
+
+void AddHistogramRowSse42(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins) {
+	AddHistogramRowScalar(row, width, shift, bits, lanes, nbBins);
+}
+
+void AddHistogramRowAvx2(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins) {
+	AddHistogramRowScalar(row, width, shift, bits, lanes, nbBins);
+}
+
+#endif
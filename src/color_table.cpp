@@ -0,0 +1,62 @@
+#include "color_table.h"
+
+using namespace std;
+
+ColorBoxTable::ColorBoxTable(int binsPerChannel, size_t nbImages)
+	: bins(binsPerChannel), side(binsPerChannel + 1), nbImages(nbImages), sums((size_t)side * side * side * nbImages, 0.0) {
+}
+
+void ColorBoxTable::SetBin(int bin, const float *fractions) {
+	int b = bin / (bins * bins);
+	int g = bin / bins % bins;
+	int r = bin % bins;
+
+	double *entry = &sums[(((size_t)(b + 1) * side + g + 1) * side + r + 1) * nbImages];
+	for (size_t i = 0; i < nbImages; i++) {
+		entry[i] = fractions[i];
+	}
+}
+
+void ColorBoxTable::Build() {
+	// One running sum along each axis in turn: after the three passes, entry (b, g, r)
+	// holds the sum of the bins below it on every axis
+	size_t strides[3] = { (size_t)side * side * nbImages, (size_t)side * nbImages, nbImages };
+
+	for (int axis = 0; axis < 3; axis++) {
+		size_t stride = strides[axis];
+		for (int b = 0; b < side; b++) {
+			for (int g = 0; g < side; g++) {
+				for (int r = 0; r < side; r++) {
+					int position = axis == 0 ? b : (axis == 1 ? g : r);
+					if (position == 0) {
+						continue;
+					}
+					double *entry = &sums[(((size_t)b * side + g) * side + r) * nbImages];
+					const double *before = entry - stride;
+					for (size_t i = 0; i < nbImages; i++) {
+						entry[i] += before[i];
+					}
+				}
+			}
+		}
+	}
+}
+
+void ColorBoxTable::BoxFractions(const int lo[3], const int hi[3], double *fractions) const {
+	int b0 = lo[0], g0 = lo[1], r0 = lo[2];
+	int b1 = hi[0] + 1, g1 = hi[1] + 1, r1 = hi[2] + 1;
+
+	// Inclusion-exclusion over the 8 corners of the box
+	const double *s111 = Corner(b1, g1, r1);
+	const double *s011 = Corner(b0, g1, r1);
+	const double *s101 = Corner(b1, g0, r1);
+	const double *s110 = Corner(b1, g1, r0);
+	const double *s001 = Corner(b0, g0, r1);
+	const double *s010 = Corner(b0, g1, r0);
+	const double *s100 = Corner(b1, g0, r0);
+	const double *s000 = Corner(b0, g0, r0);
+
+	for (size_t i = 0; i < nbImages; i++) {
+		fractions[i] = s111[i] - s011[i] - s101[i] - s110[i] + s001[i] + s010[i] + s100[i] - s000[i];
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef LABPRIMITIVE_COLOR_TABLE_H
+#define LABPRIMITIVE_COLOR_TABLE_H
+
+#include <cstddef>
+#include <vector>
+
+// 3D summed-area tables of the colour histograms of a set of images (see histogram.h).
+// Once built, the fraction of the pixels of every image inside a BGR box aligned on
+// the bins is 8 lookups per image, whatever the size of the box, so that millions of
+// candidate boxes can be scored without going back to the pixels.
+// The tables are stored bin-major: the entries of all the images for one corner are
+// contiguous, and a box query reads 8 arrays of NbImages() values.
+class ColorBoxTable {
+public:
+	ColorBoxTable(int binsPerChannel, size_t nbImages);
+
+	int BinsPerChannel() const { return bins; }
+	size_t NbImages() const { return nbImages; }
+
+	// Sets bin (b, g, r), bin = (b * bins + g) * bins + r, for every image: fractions
+	// holds NbImages() values, like a FeatureStore column
+	void SetBin(int bin, const float *fractions);
+
+	// Turns the histograms into summed-area tables, after the last SetBin
+	void Build();
+
+	// Fraction of the pixels of each image whose bins are within lo..hi (inclusive,
+	// B, G, R) for each channel; fractions gets NbImages() values
+	void BoxFractions(const int lo[3], const int hi[3], double *fractions) const;
+
+private:
+	const double *Corner(int b, int g, int r) const { return &sums[(((size_t)b * side + g) * side + r) * nbImages]; }
+
+	int bins;
+	int side;		// bins + 1: row and column 0 of each axis are zero
+	size_t nbImages;
+	std::vector<double> sums;
+};
+
+#endif
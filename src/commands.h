@@ -0,0 +1,50 @@
+#ifndef LABPRIMITIVE_COMMANDS_H
+#define LABPRIMITIVE_COMMANDS_H
+
+#include <string>
+#include <vector>
+
+struct DatasetOptions;
+struct EvaluationGrid;
+struct ExtractionOptions;
+struct FeatureFormat;
+
+// classify: trains a k-NN and a Gaussian naive Bayes classifier on the training set
+// and prints their accuracy and confusion matrix on the validation set. Each set is
+// loaded from a feature file (.arff or raw) when its name is given, and otherwise
+// extracted from the images of dataset with options.
+int RunClassify(const char *trainFileName, const char *validFileName, int k, const std::vector<std::string> &featureNames,
+	const DatasetOptions &dataset, const ExtractionOptions &options);
+
+// evaluate: pools the training and validation sets (loaded or extracted as by
+// classify) and ranks the classifiers and feature subsets of grid (the default
+// subsets of cross_validation.h when it has none) by stratified cross-validation.
+// Prints the first nbRows rows of the leaderboard, and writes all of it to
+// leaderboardFileName as CSV when it is not NULL.
+int RunEvaluate(const char *trainFileName, const char *validFileName, const std::vector<std::string> &featureNames,
+	const DatasetOptions &dataset, const ExtractionOptions &options, const EvaluationGrid &grid, int nbRows, const char *leaderboardFileName);
+
+// serve: extracts the images of the requests received on a Unix domain socket
+// (see serve_protocol.h) with a pool of options.threads workers kept for the whole
+// run, until SIGINT or SIGTERM. Prints the request statistics when it stops.
+int RunServe(const char *socketPath, const ExtractionOptions &options);
+
+// tune: searches, for each class of the training set of dataset, the BGR box whose pixel ratio
+// best separates its images from the others, and writes the boxes to outputFileName
+// as colour rules (see LoadColorRules). The boxes are aligned on the bins of the colour
+// histogram (options.histogramBins, or MAX_HISTOGRAM_BINS when 0); every box is scored
+// from the summed-area tables of the histograms (see color_table.h).
+int RunTune(const char *outputFileName, const DatasetOptions &dataset, const ExtractionOptions &options);
+
+// pack: decodes the images of the training and validation sets of dataset (with the
+// decoder of options) into one archive, outputFileName (see packed_dataset.h), which
+// train, valid, classify and tune then read with --archive instead of the image files.
+int RunPack(const char *outputFileName, const DatasetOptions &dataset, const ExtractionOptions &options);
+
+// merge: puts the shard files of a run split with --shard back together, in the order
+// of the unsharded run, and writes them to outputFileName in format. Fails, saying
+// why, if a shard file comes from another run, or if a shard or a sample is missing
+// or there twice.
+int RunMerge(const char *outputFileName, const FeatureFormat &format, const std::vector<std::string> &shardFileNames);
+
+#endif
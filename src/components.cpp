@@ -0,0 +1,265 @@
+#include "components.h"
+#include "histogram.h"
+#include "sampling.h"
+
+#include <cstddef>
+
+using namespace std;
+
+const char *COMPONENT_FEATURE_SUFFIXES[NUM_COMPONENT_FEATURES] = { "Blobs", "Largest", "CenterX", "CenterY", "Width", "Height" };
+
+ComponentLabeler::ComponentLabeler(const ColorClassifier &classifier, int width, int height, int nChannels, const unsigned char *palette, int paletteSize)
+	: classifier(classifier), width(width), height(height), nChannels(nChannels), nbRules(classifier.NbFeatures()), indexed(palette != NULL),
+	masks(width), runStarts(classifier.NbFeatures(), 0), previous(classifier.NbFeatures()), current(classifier.NbFeatures()),
+	cursors(classifier.NbFeatures(), 0), counts(classifier.NbFeatures(), 0), nbBlobs(classifier.NbFeatures(), 0), largest(classifier.NbFeatures()) {
+
+	// Each palette colour is classified once
+	if (indexed) {
+		for (int index = 0; index < 256; index++) {
+			const unsigned char *color = index < paletteSize ? palette + 4 * index : NULL;
+			paletteMasks[index] = color != NULL ? classifier.Classify(color[0], color[1], color[2]) : classifier.Classify(0, 0, 0);
+		}
+	}
+
+	for (int r = 0; r < nbRules; r++) {
+		largest[r].area = 0;
+	}
+}
+
+int ComponentLabeler::Find(int label) {
+	while (parents[label] != label) {
+		parents[label] = parents[parents[label]];
+		label = parents[label];
+	}
+	return label;
+}
+
+// Merges the blobs of two labels; returns the label of the result
+int ComponentLabeler::Union(int a, int b) {
+	a = Find(a);
+	b = Find(b);
+
+	if (a != b) {
+		Blob &into = blobs[a];
+		const Blob &from = blobs[b];
+		into.area += from.area;
+		into.sumX += from.sumX;
+		into.sumY += from.sumY;
+		into.minX = from.minX < into.minX ? from.minX : into.minX;
+		into.maxX = from.maxX > into.maxX ? from.maxX : into.maxX;
+		if (from.minY < into.minY || (from.minY == into.minY && from.topX < into.topX)) {
+			into.topX = from.topX;
+		}
+		into.minY = from.minY < into.minY ? from.minY : into.minY;
+		into.maxY = from.maxY > into.maxY ? from.maxY : into.maxY;
+		parents[b] = a;
+	}
+	return a;
+}
+
+// Links the run [start, end) of a rule to the runs of the previous row it touches,
+// diagonals included, and adds its pixels to their blob
+void ComponentLabeler::AddRun(int rule, int start, int end, int y) {
+	const vector<Run> &above = previous[rule];
+	size_t &cursor = cursors[rule];
+
+	// The runs of a row come left to right: those ending before this one cannot touch
+	// the next ones either
+	while (cursor < above.size() && above[cursor].end < start) {
+		cursor++;
+	}
+
+	int label = -1;
+	for (size_t j = cursor; j < above.size() && above[j].start <= end; j++) {
+		label = label < 0 ? Find(above[j].label) : Union(label, above[j].label);
+	}
+
+	if (label < 0) {
+		label = (int)blobs.size();
+		parents.push_back(label);
+
+		Blob blob;
+		blob.rule = rule;
+		blob.area = blob.sumX = blob.sumY = 0;
+		blob.minX = start;
+		blob.maxX = end - 1;
+		blob.minY = blob.maxY = y;
+		blob.topX = start;
+		blobs.push_back(blob);
+	}
+
+	Blob &blob = blobs[label];
+	uint64_t length = (uint64_t)(end - start);
+	blob.area += length;
+	blob.sumX += length * (uint64_t)(start + end - 1) / 2;
+	blob.sumY += length * (uint64_t)y;
+	blob.minX = start < blob.minX ? start : blob.minX;
+	blob.maxX = end - 1 > blob.maxX ? end - 1 : blob.maxX;
+	if (y < blob.minY || (y == blob.minY && start < blob.topX)) {
+		blob.topX = start;
+	}
+	blob.minY = y < blob.minY ? y : blob.minY;
+	blob.maxY = y > blob.maxY ? y : blob.maxY;
+
+	counts[rule] += length;
+
+	Run run = { start, end, label };
+	current[rule].push_back(run);
+}
+
+// Closes the blobs of the previous row that the current row did not extend, then
+// renumbers the blobs left from 0 so that the labels never outgrow a row
+void ComponentLabeler::CloseBlobs() {
+	alive.assign(blobs.size(), 0);
+
+	for (int r = 0; r < nbRules; r++) {
+		for (size_t i = 0; i < current[r].size(); i++) {
+			alive[Find(current[r][i].label)] = 1;
+		}
+	}
+
+	for (int r = 0; r < nbRules; r++) {
+		for (size_t i = 0; i < previous[r].size(); i++) {
+			int root = Find(previous[r][i].label);
+			if (alive[root] != 0) {
+				continue;
+			}
+
+			// Closed once, whatever the number of its runs
+			alive[root] = 1;
+			const Blob &blob = blobs[root];
+			nbBlobs[r]++;
+			// Of blobs of the same area, the first one in raster order, whatever the order
+			// of the rows
+			const Blob &best = largest[r];
+			if (blob.area > best.area || (blob.area == best.area
+				&& (blob.minY < best.minY || (blob.minY == best.minY && blob.topX < best.topX)))) {
+				largest[r] = blob;
+			}
+		}
+	}
+
+	relabels.assign(blobs.size(), -1);
+	nextBlobs.clear();
+
+	for (int r = 0; r < nbRules; r++) {
+		for (size_t i = 0; i < current[r].size(); i++) {
+			int root = Find(current[r][i].label);
+			if (relabels[root] < 0) {
+				relabels[root] = (int)nextBlobs.size();
+				nextBlobs.push_back(blobs[root]);
+			}
+			current[r][i].label = relabels[root];
+		}
+
+		previous[r].swap(current[r]);
+		current[r].clear();
+		cursors[r] = 0;
+	}
+
+	blobs.swap(nextBlobs);
+	parents.resize(blobs.size());
+	for (size_t i = 0; i < parents.size(); i++) {
+		parents[i] = (int)i;
+	}
+}
+
+void ComponentLabeler::AddRow(const unsigned char *row, int y) {
+
+	// A gray level image has the same value in the three channels
+	int greenOffset = nChannels >= 3 ? 1 : 0;
+	int redOffset = nChannels >= 3 ? 2 : 0;
+
+	if (indexed) {
+		for (int w = 0; w < width; w++) {
+			masks[w] = paletteMasks[row[w]];
+		}
+	}
+	else {
+		for (int w = 0; w < width; w++) {
+			const unsigned char *pixel = row + w * nChannels;
+			masks[w] = classifier.Classify(pixel[0], pixel[greenOffset], pixel[redOffset]);
+		}
+	}
+
+	// A run of a rule starts where its bit turns on and ends where it turns off
+	uint64_t before = 0;
+	for (int w = 0; w < width; w++) {
+		uint64_t mask = masks[w];
+		for (uint64_t changed = mask ^ before; changed != 0; changed &= changed - 1) {
+			int rule = LowestBit(changed);
+			if ((mask >> rule) & 1) {
+				runStarts[rule] = w;
+			}
+			else {
+				AddRun(rule, runStarts[rule], w, y);
+			}
+		}
+		before = mask;
+	}
+	for (; before != 0; before &= before - 1) {
+		int rule = LowestBit(before);
+		AddRun(rule, runStarts[rule], width, y);
+	}
+
+	CloseBlobs();
+}
+
+void ComponentLabeler::Finish(uint64_t *pixelCounts, float *features) {
+
+	// An empty row closes every blob left
+	CloseBlobs();
+
+	for (int r = 0; r < nbRules; r++) {
+		float *f = features + r * NUM_COMPONENT_FEATURES;
+		const Blob &blob = largest[r];
+
+		pixelCounts[r] = counts[r];
+		f[COMPONENT_BLOBS] = (float)nbBlobs[r];
+
+		if (blob.area == 0) {
+			for (int k = COMPONENT_LARGEST; k < NUM_COMPONENT_FEATURES; k++) {
+				f[k] = 0.0f;
+			}
+			continue;
+		}
+
+		f[COMPONENT_LARGEST] = (float)((double)blob.area / ((double)width * height));
+		f[COMPONENT_CENTER_X] = (float)(((double)blob.sumX / blob.area + 0.5) / width);
+		f[COMPONENT_CENTER_Y] = (float)(((double)blob.sumY / blob.area + 0.5) / height);
+		f[COMPONENT_WIDTH] = (float)(blob.maxX - blob.minX + 1) / width;
+		f[COMPONENT_HEIGHT] = (float)(blob.maxY - blob.minY + 1) / height;
+	}
+}
+
+void ExtractComponentFeatures(const ColorClassifier &classifier, const PixelView &image, ColorHistogram *histogram, float *fVector) {
+	ComponentLabeler labeler(classifier, image.width, image.height, image.nChannels, image.palette, image.paletteSize);
+	uint64_t indexHistogram[256] = { 0 };
+
+	for (int h = 0; h < image.height; h++) {
+		const unsigned char *row = image.pixels + (ptrdiff_t)h * image.widthStep;
+		labeler.AddRow(row, h);
+
+		if (histogram == NULL) {
+			continue;
+		}
+		if (image.palette == NULL) {
+			histogram->Add(row, image.width, 1, image.widthStep, image.nChannels);
+		}
+		else {
+			for (int w = 0; w < image.width; w++) {
+				indexHistogram[row[w]]++;
+			}
+		}
+	}
+
+	if (histogram != NULL && image.palette != NULL) {
+		histogram->AddPalette(indexHistogram, image.palette, image.paletteSize);
+	}
+
+	int nbFeatures = classifier.NbFeatures();
+	uint64_t counts[MAX_COLOR_RULES];
+	labeler.Finish(counts, fVector + nbFeatures);
+
+	NormalizeFeatures(counts, nbFeatures, image.width, image.height, fVector);
+}
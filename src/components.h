@@ -0,0 +1,98 @@
+#ifndef LABPRIMITIVE_COMPONENTS_H
+#define LABPRIMITIVE_COMPONENTS_H
+
+#include "color_classifier.h"
+
+#include <stdint.h>
+#include <vector>
+
+class ColorHistogram;
+struct PixelView;
+
+// Spatial features of each colour rule, from the 8-connected components (blobs) of its
+// pixels. With components, the feature vector holds the pixel ratio of every rule, then
+// NUM_COMPONENT_FEATURES values per rule in this order.
+enum {
+	COMPONENT_BLOBS,		// number of blobs
+	COMPONENT_LARGEST,		// area of the largest blob, as a fraction of the image
+	COMPONENT_CENTER_X,		// centroid of the largest blob, as fractions of the width
+	COMPONENT_CENTER_Y,		// and of the height (0 without blob)
+	COMPONENT_WIDTH,		// bounding box of the largest blob, as fractions of the width
+	COMPONENT_HEIGHT,		// and of the height
+	NUM_COMPONENT_FEATURES
+};
+
+// Attribute name of a component feature: the rule name followed by this suffix
+extern const char *COMPONENT_FEATURE_SUFFIXES[NUM_COMPONENT_FEATURES];
+
+// Streaming union-find labeling of the colour masks. The rows are classified one at a
+// time, in order; the pixels of each rule are cut into runs, linked to the runs of the
+// previous row they touch, and each blob is closed as soon as a row no longer extends
+// it. Only the runs of two rows are kept, so the memory depends on the width alone.
+class ComponentLabeler {
+public:
+	// Pixels of nChannels bytes (BGR(X), or gray levels), or indices into a palette of
+	// paletteSize (B, G, R, reserved) entries when palette is not NULL
+	ComponentLabeler(const ColorClassifier &classifier, int width, int height, int nChannels, const unsigned char *palette, int paletteSize);
+
+	// Adds the next row, at row y of the image (0 = top). The rows may come from the
+	// top or from the bottom, as long as each one is next to the one before.
+	void AddRow(const unsigned char *row, int y);
+
+	// Closes the last blobs, and stores the pixel count of each rule in counts and its
+	// NUM_COMPONENT_FEATURES features in features
+	void Finish(uint64_t *counts, float *features);
+
+private:
+	struct Run {
+		int start;
+		int end;		// past the last pixel
+		int label;
+	};
+
+	struct Blob {
+		int rule;
+		uint64_t area;
+		uint64_t sumX;
+		uint64_t sumY;
+		int minX, maxX;
+		int minY, maxY;
+		int topX;		// leftmost pixel of row minY: orders blobs of the same area
+	};
+
+	int Find(int label);
+	int Union(int a, int b);
+	void AddRun(int rule, int start, int end, int y);
+	void CloseBlobs();
+
+	const ColorClassifier &classifier;
+	int width;
+	int height;
+	int nChannels;
+	int nbRules;
+	uint64_t paletteMasks[256];
+	bool indexed;
+
+	std::vector<uint64_t> masks;
+	std::vector<int> runStarts;
+	std::vector<std::vector<Run> > previous;	// runs of the previous row, per rule
+	std::vector<std::vector<Run> > current;
+	std::vector<size_t> cursors;				// first run of previous that can touch the next run
+
+	// Union-find over the labels of the runs of the two rows
+	std::vector<int> parents;
+	std::vector<Blob> blobs;
+	std::vector<char> alive;
+	std::vector<int> relabels;
+	std::vector<Blob> nextBlobs;
+
+	std::vector<uint64_t> counts;
+	std::vector<uint64_t> nbBlobs;
+	std::vector<Blob> largest;
+};
+
+// Pixel ratios and component features of every rule, in one pass over the rows of image.
+// Each row is also added to histogram, when not NULL (without normalizing it).
+void ExtractComponentFeatures(const ColorClassifier &classifier, const PixelView &image, ColorHistogram *histogram, float *fVector);
+
+#endif
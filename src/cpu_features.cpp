@@ -0,0 +1,55 @@
+#include "cpu_features.h"
+
+#if defined(LABPRIMITIVE_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(LABPRIMITIVE_X86) && defined(_MSC_VER)
+
+static bool CpuidBit(int leaf, int reg, int bit) {
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < leaf) {
+		return false;
+	}
+	__cpuidex(info, leaf, 0);
+	return (info[reg] >> bit) & 1;
+}
+
+bool CpuSupportsSse42() {
+	// CPUID.1:ECX.SSE4_2[bit 20]
+	return CpuidBit(1, 2, 20);
+}
+
+bool CpuSupportsAvx2() {
+	// CPUID.1:ECX.OSXSAVE[bit 27] and the OS saves the YMM state, then CPUID.7:EBX.AVX2[bit 5]
+	if (!CpuidBit(1, 2, 27) || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	return CpuidBit(7, 1, 5);
+}
+
+#elif defined(LABPRIMITIVE_X86)
+
+bool CpuSupportsSse42() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+
+bool CpuSupportsAvx2() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool CpuSupportsSse42() {
+	return false;
+}
+
+bool CpuSupportsAvx2() {
+	return false;
+}
+
+#endif
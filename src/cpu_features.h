@@ -0,0 +1,23 @@
+#ifndef LABPRIMITIVE_CPU_FEATURES_H
+#define LABPRIMITIVE_CPU_FEATURES_H
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LABPRIMITIVE_X86 1
+#endif
+
+// Functions using SSE/AVX intrinsics are compiled for their instruction set one by
+// one, so the rest of the program still runs on any x86 CPU. MSVC needs no flag.
+#if defined(LABPRIMITIVE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define LABPRIMITIVE_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define LABPRIMITIVE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LABPRIMITIVE_TARGET_SSE42
+#define LABPRIMITIVE_TARGET_AVX2
+#endif
+
+// Runtime detection of the instruction sets used by the SIMD kernels.
+// Always false on non-x86 builds.
+bool CpuSupportsSse42();
+bool CpuSupportsAvx2();
+
+#endif
@@ -0,0 +1,508 @@
+#include "cross_validation.h"
+#include "distance_kernels.h"
+#include "extraction.h"
+#include "feature_store.h"
+#include "learning.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+// Samples of one fold, and the statistics of its training part shared by every candidate
+struct FoldData {
+	vector<size_t> training;			// indices in the extracted samples
+	vector<size_t> test;
+	vector<int> trainingClasses;		// class of each training sample
+
+	// The training samples then the test samples, scaled to [0, 1] with the minimum and
+	// maximum of the training part, one column per feature (see KnnClassifier): the
+	// distances to the training samples read contiguous values
+	vector<vector<float> > scaled;
+
+	// Per class and feature of the training part: [class * nbFeatures + feature]
+	vector<double> logPriors;			// -HUGE_VAL for a class without training sample
+	vector<double> means;
+	vector<double> variances;			// not smoothed: that depends on the subset
+	vector<double> totalVariances;		// per feature, of the whole training part
+};
+
+// Groups of DefaultFeatureSubsets, in the order of their first feature, with their
+// names: the prefix of the group, or the name of the feature alone
+static void GroupFeatures(const vector<string> &featureNames, vector<string> &groupNames, vector<vector<int> > &groups) {
+	for (size_t f = 0; f < featureNames.size(); f++) {
+		size_t underscore = featureNames[f].find('_');
+		string name = underscore != string::npos && underscore > 0 ? featureNames[f].substr(0, underscore) : featureNames[f];
+
+		size_t g = find(groupNames.begin(), groupNames.end(), name) - groupNames.begin();
+		if (g == groupNames.size()) {
+			groupNames.push_back(name);
+			groups.push_back(vector<int>());
+		}
+		groups[g].push_back((int)f);
+	}
+}
+
+// Features of a set of groups, in feature order
+static vector<int> JoinGroups(const vector<vector<int> > &groups, const vector<int> &groupSubset) {
+	vector<int> features;
+	for (size_t g = 0; g < groupSubset.size(); g++) {
+		features.insert(features.end(), groups[groupSubset[g]].begin(), groups[groupSubset[g]].end());
+	}
+	sort(features.begin(), features.end());
+	return features;
+}
+
+vector<vector<int> > DefaultFeatureSubsets(const vector<string> &featureNames) {
+	vector<string> groupNames;
+	vector<vector<int> > groups;
+	GroupFeatures(featureNames, groupNames, groups);
+	int nbGroups = (int)groups.size();
+	vector<vector<int> > subsets;
+
+	if (nbGroups <= MAX_EXHAUSTIVE_GROUPS) {
+		for (int size = 1; size <= nbGroups; size++) {
+			// Combinations of size groups in lexicographic order
+			vector<int> subset(size);
+			for (int i = 0; i < size; i++) {
+				subset[i] = i;
+			}
+			for (;;) {
+				subsets.push_back(JoinGroups(groups, subset));
+				int i = size - 1;
+				while (i >= 0 && subset[i] == nbGroups - size + i) {
+					i--;
+				}
+				if (i < 0) {
+					break;
+				}
+				subset[i]++;
+				for (int j = i + 1; j < size; j++) {
+					subset[j] = subset[j - 1] + 1;
+				}
+			}
+		}
+		return subsets;
+	}
+
+	vector<int> all(nbGroups);
+	for (int g = 0; g < nbGroups; g++) {
+		all[g] = g;
+	}
+	subsets.push_back(JoinGroups(groups, all));
+	for (int g = 0; g < nbGroups; g++) {
+		vector<int> allButOne = all;
+		allButOne.erase(allButOne.begin() + g);
+		subsets.push_back(JoinGroups(groups, allButOne));
+	}
+	for (int g = 0; g < nbGroups; g++) {
+		subsets.push_back(groups[g]);
+	}
+	return subsets;
+}
+
+vector<int> StratifiedFolds(const FeatureStore &store, int nbFolds, unsigned int seed) {
+	vector<int> folds(store.NbSamples(), -1);
+
+	// mt19937 gives the same numbers everywhere; std::shuffle does not
+	mt19937 random(seed);
+	int nextFold = 0;
+	for (int c = 0; c < (int)store.Labels().size(); c++) {
+		vector<size_t> samples;
+		for (size_t i = 0; i < store.NbSamples(); i++) {
+			if (store.Extracted(i) && store.LabelIndex(i) == c) {
+				samples.push_back(i);
+			}
+		}
+		for (size_t i = samples.size(); i > 1; i--) {
+			swap(samples[i - 1], samples[random() % i]);
+		}
+		for (size_t i = 0; i < samples.size(); i++) {
+			folds[samples[i]] = nextFold;
+			nextFold = (nextFold + 1) % nbFolds;
+		}
+	}
+	return folds;
+}
+
+// Splits the extracted samples into a fold and computes the statistics of its training part
+static void PrepareFold(const vector<vector<float> > &columns, const vector<int> &classes, int nbClasses, const vector<int> &folds,
+	int fold, FoldData &data) {
+
+	size_t nbSamples = classes.size();
+	int nbFeatures = (int)columns.size();
+
+	for (size_t j = 0; j < nbSamples; j++) {
+		(folds[j] == fold ? data.test : data.training).push_back(j);
+	}
+
+	vector<size_t> classSizes(nbClasses, 0);
+	data.trainingClasses.resize(data.training.size());
+	for (size_t n = 0; n < data.training.size(); n++) {
+		data.trainingClasses[n] = classes[data.training[n]];
+		classSizes[data.trainingClasses[n]]++;
+	}
+	data.logPriors.assign(nbClasses, -HUGE_VAL);
+	for (int c = 0; c < nbClasses; c++) {
+		if (classSizes[c] > 0) {
+			data.logPriors[c] = log((double)classSizes[c] / (double)data.training.size());
+		}
+	}
+
+	data.scaled.assign(nbFeatures, vector<float>());
+	data.means.assign((size_t)nbClasses * nbFeatures, 0.0);
+	data.variances.assign((size_t)nbClasses * nbFeatures, 0.0);
+	data.totalVariances.assign(nbFeatures, 0.0);
+
+	for (int f = 0; f < nbFeatures; f++) {
+		const vector<float> &column = columns[f];
+
+		float low = 0.0f, high = 0.0f;
+		double sum = 0.0, sumSquares = 0.0;
+		for (size_t n = 0; n < data.training.size(); n++) {
+			size_t j = data.training[n];
+			float value = column[j];
+			low = n == 0 || value < low ? value : low;
+			high = n == 0 || value > high ? value : high;
+			data.means[(size_t)classes[j] * nbFeatures + f] += value;
+			sum += value;
+			sumSquares += (double)value * value;
+		}
+
+		float scale = high > low ? 1.0f / (high - low) : 0.0f;
+		data.scaled[f].reserve(nbSamples);
+		for (size_t n = 0; n < data.training.size(); n++) {
+			data.scaled[f].push_back((column[data.training[n]] - low) * scale);
+		}
+		for (size_t t = 0; t < data.test.size(); t++) {
+			data.scaled[f].push_back((column[data.test[t]] - low) * scale);
+		}
+
+		for (int c = 0; c < nbClasses; c++) {
+			if (classSizes[c] > 0) {
+				data.means[(size_t)c * nbFeatures + f] /= (double)classSizes[c];
+			}
+		}
+		for (size_t n = 0; n < data.training.size(); n++) {
+			size_t j = data.training[n];
+			size_t index = (size_t)classes[j] * nbFeatures + f;
+			double difference = column[j] - data.means[index];
+			data.variances[index] += difference * difference;
+		}
+		for (int c = 0; c < nbClasses; c++) {
+			if (classSizes[c] > 0) {
+				data.variances[(size_t)c * nbFeatures + f] /= (double)classSizes[c];
+			}
+		}
+
+		if (!data.training.empty()) {
+			double mean = sum / (double)data.training.size();
+			data.totalVariances[f] = sumSquares / (double)data.training.size() - mean * mean;
+		}
+	}
+}
+
+// Scratch space of a worker
+struct FoldScratch {
+	vector<const float *> columns;		// scaled training columns of the subset
+	vector<float> query;
+	vector<float> distances;
+	vector<size_t> order;
+	vector<int> votes;
+	vector<double> means;				// [class * subset size + feature of the subset]
+	vector<double> variances;			// smoothed
+	vector<double> logNormalizers;
+	vector<float> values;				// of the test sample, for the subset
+};
+
+// Counts the correct predictions of every classifier of the grid on the test part
+// of a fold, for a subset of the features: correct[c] for the c-th classifier (the
+// k-NN in grid order, then naive Bayes). columns holds the values of the samples.
+static void EvaluateFold(const FoldData &data, const vector<int> &classes, int nbClasses, int nbFeatures, const vector<int> &subset,
+	const EvaluationGrid &grid, FoldScratch &scratch, const vector<vector<float> > &columns, int *correct) {
+
+	size_t nbTraining = data.training.size();
+	size_t nbKnn = grid.neighbourCounts.size();
+	if (nbTraining == 0) {
+		return;
+	}
+
+	if (nbKnn > 0) {
+		size_t maxNeighbours = (size_t)*max_element(grid.neighbourCounts.begin(), grid.neighbourCounts.end());
+		maxNeighbours = maxNeighbours < nbTraining ? maxNeighbours : nbTraining;
+		scratch.distances.resize(nbTraining);
+		scratch.order.resize(nbTraining);
+		scratch.votes.resize(nbClasses);
+
+		// The training part of the scaled columns, with the distance kernel of KnnClassifier
+		scratch.columns.resize(subset.size());
+		scratch.query.resize(subset.size());
+		for (size_t s = 0; s < subset.size(); s++) {
+			scratch.columns[s] = &data.scaled[subset[s]][0];
+		}
+
+		for (size_t t = 0; t < data.test.size(); t++) {
+			size_t query = data.test[t];
+			for (size_t s = 0; s < subset.size(); s++) {
+				scratch.query[s] = data.scaled[subset[s]][nbTraining + t];
+			}
+			SelectedDistanceKernel()(subset.empty() ? NULL : &scratch.columns[0], (int)subset.size(), nbTraining,
+				subset.empty() ? NULL : &scratch.query[0], &scratch.distances[0]);
+
+			// Ranked once for every k, then voted on as in KnnClassifier
+			RankNeighbours(&scratch.distances[0], nbTraining, maxNeighbours, scratch.order);
+			for (size_t c = 0; c < nbKnn; c++) {
+				size_t nbNeighbours = (size_t)grid.neighbourCounts[c] < nbTraining ? (size_t)grid.neighbourCounts[c] : nbTraining;
+				if (VoteNeighbours(&scratch.order[0], nbNeighbours, &data.trainingClasses[0], scratch.votes) == classes[query]) {
+					correct[c]++;
+				}
+			}
+		}
+	}
+
+	if (grid.naiveBayes && !subset.empty()) {
+		// The model of GaussianNaiveBayes on the features of the subset, smoothed with
+		// the largest variance among them
+		size_t subsetSize = subset.size();
+		double largestVariance = 0.0;
+		for (size_t s = 0; s < subsetSize; s++) {
+			largestVariance = max(largestVariance, data.totalVariances[subset[s]]);
+		}
+		double smoothing = NaiveBayesSmoothing(largestVariance);
+
+		scratch.means.resize((size_t)nbClasses * subsetSize);
+		scratch.variances.resize((size_t)nbClasses * subsetSize);
+		scratch.logNormalizers.resize((size_t)nbClasses * subsetSize);
+		for (int c = 0; c < nbClasses; c++) {
+			for (size_t s = 0; s < subsetSize; s++) {
+				size_t index = (size_t)c * nbFeatures + subset[s];
+				scratch.means[c * subsetSize + s] = data.means[index];
+				scratch.variances[c * subsetSize + s] = data.variances[index] + smoothing;
+				scratch.logNormalizers[c * subsetSize + s] = GaussianLogNormalizer(scratch.variances[c * subsetSize + s]);
+			}
+		}
+
+		scratch.values.resize(subsetSize);
+		for (size_t t = 0; t < data.test.size(); t++) {
+			size_t query = data.test[t];
+			for (size_t s = 0; s < subsetSize; s++) {
+				scratch.values[s] = columns[subset[s]][query];
+			}
+			int predicted = MostLikelyClass(data.logPriors, &scratch.means[0], &scratch.variances[0], &scratch.logNormalizers[0],
+				(int)subsetSize, &scratch.values[0]);
+			if (predicted == classes[query]) {
+				correct[nbKnn]++;
+			}
+		}
+	}
+}
+
+vector<CandidateScore> CrossValidate(const FeatureStore &store, const EvaluationGrid &grid) {
+	int nbFeatures = store.NbFeatures();
+	int nbClasses = (int)store.Labels().size();
+	int nbFolds = grid.nbFolds;
+	int nbClassifiers = (int)grid.neighbourCounts.size() + (grid.naiveBayes ? 1 : 0);
+	size_t nbSubsets = grid.featureSubsets.size();
+
+	// The extracted samples, one column per feature
+	vector<int> allFolds = StratifiedFolds(store, nbFolds, grid.seed);
+	vector<int> classes, folds;
+	vector<vector<float> > columns(nbFeatures);
+	for (size_t i = 0; i < store.NbSamples(); i++) {
+		if (!store.Extracted(i)) {
+			continue;
+		}
+		classes.push_back(store.LabelIndex(i));
+		folds.push_back(allFolds[i]);
+		for (int f = 0; f < nbFeatures; f++) {
+			columns[f].push_back(store.Value(i, f));
+		}
+	}
+
+	vector<FoldData> foldData(nbFolds);
+	for (int fold = 0; fold < nbFolds; fold++) {
+		PrepareFold(columns, classes, nbClasses, folds, fold, foldData[fold]);
+	}
+
+	// One task per subset and fold, the largest subsets first so that the last tasks
+	// are the short ones. Each task counts into its own slots.
+	vector<size_t> subsetOrder(nbSubsets);
+	for (size_t s = 0; s < nbSubsets; s++) {
+		subsetOrder[s] = s;
+	}
+	stable_sort(subsetOrder.begin(), subsetOrder.end(), [&](size_t a, size_t b) {
+		return grid.featureSubsets[a].size() > grid.featureSubsets[b].size();
+	});
+	size_t nbTasks = nbSubsets * nbFolds;
+	vector<int> correct(nbTasks * nbClassifiers, 0);	// [(subset * nbFolds + fold) * nbClassifiers + classifier]
+
+	auto runTask = [&](size_t task, FoldScratch &scratch) {
+		size_t subset = subsetOrder[task / nbFolds];
+		int fold = (int)(task % nbFolds);
+		EvaluateFold(foldData[fold], classes, nbClasses, nbFeatures, grid.featureSubsets[subset], grid, scratch, columns,
+			&correct[(subset * nbFolds + fold) * nbClassifiers]);
+	};
+
+	int nbThreads = ResolveThreadCount(grid.threads);
+	if ((size_t)nbThreads > nbTasks) {
+		nbThreads = (int)nbTasks;
+	}
+	if (nbThreads <= 1) {
+		FoldScratch scratch;
+		for (size_t task = 0; task < nbTasks; task++) {
+			runTask(task, scratch);
+		}
+	}
+	else {
+		// Workers take the next task
+		atomic<size_t> nextTask(0);
+		vector<thread> workers;
+		for (int t = 0; t < nbThreads; t++) {
+			workers.push_back(thread([&]() {
+				FoldScratch scratch;
+				for (size_t task = nextTask++; task < nbTasks; task = nextTask++) {
+					runTask(task, scratch);
+				}
+			}));
+		}
+		for (size_t t = 0; t < workers.size(); t++) {
+			workers[t].join();
+		}
+	}
+
+	vector<CandidateScore> leaderboard;
+	for (size_t subset = 0; subset < nbSubsets; subset++) {
+		for (int c = 0; c < nbClassifiers; c++) {
+			CandidateScore score;
+			score.k = c < (int)grid.neighbourCounts.size() ? grid.neighbourCounts[c] : 0;
+			score.features = grid.featureSubsets[subset];
+			score.nbCorrect = 0;
+			score.nbTotal = 0;
+
+			// Folds without test sample (more folds than samples of a class) do not count
+			vector<double> foldAccuracies;
+			for (int fold = 0; fold < nbFolds; fold++) {
+				int foldCorrect = correct[(subset * nbFolds + fold) * nbClassifiers + c];
+				int foldTotal = (int)foldData[fold].test.size();
+				score.nbCorrect += foldCorrect;
+				score.nbTotal += foldTotal;
+				if (foldTotal > 0) {
+					foldAccuracies.push_back((double)foldCorrect / foldTotal);
+				}
+			}
+			score.accuracy = score.nbTotal > 0 ? (double)score.nbCorrect / score.nbTotal : 0.0;
+
+			double sumSquares = 0.0;
+			for (size_t fold = 0; fold < foldAccuracies.size(); fold++) {
+				double difference = foldAccuracies[fold] - score.accuracy;
+				sumSquares += difference * difference;
+			}
+			score.foldDeviation = foldAccuracies.size() > 1 ? sqrt(sumSquares / (foldAccuracies.size() - 1)) : 0.0;
+			leaderboard.push_back(score);
+		}
+	}
+
+	// Every candidate is tested on the same samples: the counts compare directly
+	stable_sort(leaderboard.begin(), leaderboard.end(), [](const CandidateScore &a, const CandidateScore &b) {
+		if (a.nbCorrect != b.nbCorrect) {
+			return a.nbCorrect > b.nbCorrect;
+		}
+		return a.features.size() < b.features.size();
+	});
+	return leaderboard;
+}
+
+string CandidateName(const CandidateScore &score) {
+	if (score.k == 0) {
+		return "naive Bayes";
+	}
+	char name[32];
+	sprintf(name, "%d-NN", score.k);
+	return name;
+}
+
+// Features of a candidate, comma-separated, a whole group by its name (Hist for the
+// histogram): "all", the features used, or "all but" the others when that is shorter
+static string FeatureList(const CandidateScore &score, const FeatureStore &store) {
+	vector<string> featureNames;
+	for (int f = 0; f < store.NbFeatures(); f++) {
+		featureNames.push_back(store.FeatureName(f));
+	}
+	vector<string> groupNames;
+	vector<vector<int> > groups;
+	GroupFeatures(featureNames, groupNames, groups);
+
+	vector<char> used(featureNames.size(), 0);
+	for (size_t f = 0; f < score.features.size(); f++) {
+		used[score.features[f]] = 1;
+	}
+
+	// Terms naming the features used, and the others
+	vector<string> terms[2];
+	for (size_t g = 0; g < groups.size(); g++) {
+		int nbUsed = 0;
+		for (size_t f = 0; f < groups[g].size(); f++) {
+			nbUsed += used[groups[g][f]];
+		}
+		for (int u = 0; u < 2; u++) {
+			int nbInTerm = u == 1 ? nbUsed : (int)groups[g].size() - nbUsed;
+			if (nbInTerm == (int)groups[g].size()) {
+				terms[u].push_back(groupNames[g]);
+			}
+			else if (nbInTerm > 0) {
+				for (size_t f = 0; f < groups[g].size(); f++) {
+					if (used[groups[g][f]] == u) {
+						terms[u].push_back(featureNames[groups[g][f]]);
+					}
+				}
+			}
+		}
+	}
+
+	if (terms[0].empty()) {
+		return "all";
+	}
+	bool allBut = terms[0].size() < terms[1].size();
+	string list = allBut ? "all but " : "";
+	const vector<string> &named = terms[allBut ? 0 : 1];
+	for (size_t t = 0; t < named.size(); t++) {
+		list += (t > 0 ? "," : "") + named[t];
+	}
+	return list;
+}
+
+void PrintLeaderboard(const vector<CandidateScore> &leaderboard, const FeatureStore &store, int nbRows, FILE *out) {
+	size_t nbPrinted = nbRows > 0 && (size_t)nbRows < leaderboard.size() ? (size_t)nbRows : leaderboard.size();
+
+	fprintf(out, "rank  accuracy  +/- (folds)  classifier   features\n");
+	for (size_t i = 0; i < nbPrinted; i++) {
+		const CandidateScore &score = leaderboard[i];
+		fprintf(out, "%4d  %7.2f %%  %7.2f %%    %-12s %s\n", (int)i + 1, 100.0 * score.accuracy, 100.0 * score.foldDeviation,
+			CandidateName(score).c_str(), FeatureList(score, store).c_str());
+	}
+}
+
+bool WriteLeaderboard(const vector<CandidateScore> &leaderboard, const FeatureStore &store, const char *fileName) {
+	FILE *fp = fopen(fileName, "w");
+	if (fp == NULL) {
+		perror(fileName);
+		return false;
+	}
+
+	fprintf(fp, "rank,accuracy,fold_deviation,correct,total,classifier,k,features\n");
+	for (size_t i = 0; i < leaderboard.size(); i++) {
+		const CandidateScore &score = leaderboard[i];
+		fprintf(fp, "%d,%.6f,%.6f,%d,%d,%s,%d,\"%s\"\n", (int)i + 1, score.accuracy, score.foldDeviation, score.nbCorrect, score.nbTotal,
+			score.k == 0 ? "bayes" : "knn", score.k, FeatureList(score, store).c_str());
+	}
+
+	bool written = ferror(fp) == 0;
+	if (fclose(fp) != 0 || !written) {
+		perror(fileName);
+		return false;
+	}
+	return true;
+}
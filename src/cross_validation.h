@@ -0,0 +1,69 @@
+#ifndef LABPRIMITIVE_CROSS_VALIDATION_H
+#define LABPRIMITIVE_CROSS_VALIDATION_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class FeatureStore;
+
+// Default number of folds, as in Weka
+#define DEFAULT_FOLDS 10
+
+// Up to this many groups of features, every non-empty subset of them is a candidate
+#define MAX_EXHAUSTIVE_GROUPS 10
+
+// Classifiers and feature subsets compared by CrossValidate: every classifier is
+// evaluated on every subset
+struct EvaluationGrid {
+	int nbFolds;
+	unsigned int seed;						// of the shuffle of each class before the folds are dealt
+	std::vector<int> neighbourCounts;		// k of each k-NN candidate
+	bool naiveBayes;						// add a Gaussian naive Bayes candidate
+	std::vector<std::vector<int> > featureSubsets;	// indices of the features of each subset
+	int threads;							// 0 = one per core
+};
+
+// Cross-validated accuracy of one candidate
+struct CandidateScore {
+	int k;							// neighbours of the k-NN, 0 for naive Bayes
+	std::vector<int> features;		// subset of the features it uses
+	int nbCorrect;					// over the test samples of every fold
+	int nbTotal;
+	double accuracy;				// nbCorrect / nbTotal
+	double foldDeviation;			// standard deviation of the accuracy of the folds
+};
+
+// Subsets of the features, made of whole groups: the features whose names start with
+// the same prefix followed by '_' (the bins of the histogram, Hist_b_g_r) form one
+// group, and each other feature its own. Every non-empty subset of the groups when
+// there are at most MAX_EXHAUSTIVE_GROUPS, the smallest first; otherwise every group,
+// then every group but one, then each group alone.
+std::vector<std::vector<int> > DefaultFeatureSubsets(const std::vector<std::string> &featureNames);
+
+// Fold of each sample of store for stratified cross-validation, -1 for the samples
+// not extracted: the samples of each class are shuffled with seed, then dealt to the
+// folds in turn, one class after the other, so that every fold has the class
+// proportions of the whole set.
+std::vector<int> StratifiedFolds(const FeatureStore &store, int nbFolds, unsigned int seed);
+
+// Evaluates every candidate of grid by stratified cross-validation on the extracted
+// samples of store: each is trained on all folds but one and tested on that one, in
+// turn. The classifiers are those of learning.h (same scaling, smoothing and ties).
+// What depends only on the fold (the scaling of the k-NN, the per-class statistics of
+// naive Bayes) is computed once per fold for all the candidates, and the neighbours
+// of a test sample are ranked once for every k. Returns the leaderboard: best
+// accuracy first, then fewer features, then grid order.
+std::vector<CandidateScore> CrossValidate(const FeatureStore &store, const EvaluationGrid &grid);
+
+// Name of the classifier of a candidate: "3-NN", "naive Bayes"
+std::string CandidateName(const CandidateScore &score);
+
+// Prints the first nbRows rows of a leaderboard (all if nbRows <= 0)
+void PrintLeaderboard(const std::vector<CandidateScore> &leaderboard, const FeatureStore &store, int nbRows, FILE *out);
+
+// Writes a whole leaderboard as comma-separated values, one candidate per line.
+// Returns false, with the error reported on stderr, if the file cannot be written.
+bool WriteLeaderboard(const std::vector<CandidateScore> &leaderboard, const FeatureStore &store, const char *fileName);
+
+#endif
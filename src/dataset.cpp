@@ -0,0 +1,253 @@
+#include "dataset.h"
+#include "feature_store.h"
+#include "packed_dataset.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+using namespace std;
+
+// Extensions read by cvLoadImage
+static const char *IMAGE_EXTENSIONS[] = { ".bmp", ".dib", ".jpg", ".jpeg", ".jpe", ".png", ".tif", ".tiff", ".pbm", ".pgm", ".ppm" };
+
+// One image of a directory
+struct DatasetImage {
+	string name;		// file name, in the directory (path of the file, in an archive)
+	string label;
+	int number;
+	uint64_t size;		// bytes, 0 if the file is missing
+	int classRank;		// index of the label in the classes kept
+};
+
+DatasetOptions DefaultDatasetOptions() {
+	DatasetOptions dataset;
+#ifdef __linux__
+	dataset.trainDirectory = "../Train";
+	dataset.validDirectory = "../Valid";
+#else
+	dataset.trainDirectory = "Train";
+	dataset.validDirectory = "Valid";
+#endif
+	dataset.classes.push_back("homer");
+	dataset.classes.push_back("bart");
+	dataset.classes.push_back("lisa");
+	dataset.archive = NULL;
+	return dataset;
+}
+
+static bool IsImageFile(const string &name) {
+	size_t dot = name.rfind('.');
+	if (dot == string::npos) {
+		return false;
+	}
+
+	string extension = name.substr(dot);
+	for (size_t i = 0; i < extension.size(); i++) {
+		extension[i] = (char)tolower((unsigned char)extension[i]);
+	}
+	for (size_t i = 0; i < sizeof(IMAGE_EXTENSIONS) / sizeof(IMAGE_EXTENSIONS[0]); i++) {
+		if (extension == IMAGE_EXTENSIONS[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Label and number of an image from its file name: homer12.bmp is image 12 of homer.
+// A name without a number is image 0.
+static void SplitFileName(const string &name, string &label, int &number) {
+	size_t end = name.rfind('.');
+	if (end == string::npos) {
+		end = name.size();
+	}
+
+	size_t digits = end;
+	while (digits > 0 && isdigit((unsigned char)name[digits - 1])) {
+		digits--;
+	}
+
+	label = name.substr(0, digits);
+	number = digits < end ? atoi(name.substr(digits, end - digits).c_str()) : 0;
+}
+
+// Names of the entries of a directory, hidden ones excepted
+static bool ListDirectory(const string &directory, vector<string> &names) {
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &entry);
+	if (search == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "%s: cannot list the directory\n", directory.c_str());
+		return false;
+	}
+	do {
+		if ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+			names.push_back(entry.cFileName);
+		}
+	} while (FindNextFileA(search, &entry));
+	FindClose(search);
+#else
+	DIR *dir = opendir(directory.c_str());
+	if (dir == NULL) {
+		perror(directory.c_str());
+		return false;
+	}
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] != '.') {
+			names.push_back(entry->d_name);
+		}
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+// Reads the manifest of a directory, if it has one (found is then true).
+// Errors are reported on stderr with the line number.
+static bool ReadManifest(const string &fileName, vector<DatasetImage> &images, bool &found) {
+	FILE *fp = fopen(fileName.c_str(), "r");
+	found = fp != NULL;
+	if (fp == NULL) {
+		if (errno == ENOENT) {
+			return true;
+		}
+		perror(fileName.c_str());
+		return false;
+	}
+
+	char line[1024];
+	int lineNb = 0;
+	bool ok = true;
+
+	while (ok && fgets(line, sizeof(line), fp) != NULL) {
+		lineNb++;
+
+		char *comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+
+		char name[512], label[128], extra[2];
+		int nbFields = sscanf(line, "%511s %127s %1s", name, label, extra);
+		if (nbFields <= 0) {
+			continue;
+		}
+		if (nbFields != 2) {
+			fprintf(stderr, "%s:%d: expected \"file label\"\n", fileName.c_str(), lineNb);
+			ok = false;
+			break;
+		}
+
+		DatasetImage image;
+		string prefix;
+		image.name = name;
+		image.label = label;
+		SplitFileName(image.name, prefix, image.number);
+		images.push_back(image);
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+static bool ImageOrder(const DatasetImage &a, const DatasetImage &b) {
+	if (a.classRank != b.classRank) {
+		return a.classRank < b.classRank;
+	}
+	if (a.number != b.number) {
+		return a.number < b.number;
+	}
+	return a.name < b.name;
+}
+
+bool AddDatasetImages(FeatureStore &store, bool training, const DatasetOptions &dataset) {
+	const string &directory = training ? dataset.trainDirectory : dataset.validDirectory;
+
+	vector<DatasetImage> images;
+	string prefix = directory + "/";
+	bool hasManifest = false;
+	if (dataset.archive != NULL) {
+		prefix.clear();
+		for (size_t i = 0; i < dataset.archive->NbImages(); i++) {
+			const PackedImage &packed = dataset.archive->Image(i);
+			if (packed.training != training) {
+				continue;
+			}
+			DatasetImage image;
+			image.name = packed.path;
+			image.label = packed.label;
+			image.number = packed.number;
+			image.size = (uint64_t)packed.width * packed.height * 3;
+			images.push_back(image);
+		}
+	}
+	else if (!ReadManifest(prefix + MANIFEST_FILE_NAME, images, hasManifest)) {
+		return false;
+	}
+
+	if (dataset.archive == NULL && !hasManifest) {
+		vector<string> names;
+		if (!ListDirectory(directory, names)) {
+			return false;
+		}
+		for (size_t i = 0; i < names.size(); i++) {
+			if (!IsImageFile(names[i])) {
+				continue;
+			}
+			DatasetImage image;
+			image.name = names[i];
+			SplitFileName(image.name, image.label, image.number);
+			images.push_back(image);
+		}
+	}
+
+	// Without a list of classes, every label, in alphabetical order
+	vector<string> classes = dataset.classes;
+	if (classes.empty()) {
+		for (size_t i = 0; i < images.size(); i++) {
+			classes.push_back(images[i].label);
+		}
+		sort(classes.begin(), classes.end());
+		classes.erase(unique(classes.begin(), classes.end()), classes.end());
+	}
+
+	vector<DatasetImage> kept;
+	for (size_t i = 0; i < images.size(); i++) {
+		DatasetImage &image = images[i];
+		image.classRank = (int)(find(classes.begin(), classes.end(), image.label) - classes.begin());
+		if (image.classRank == (int)classes.size()) {
+			continue;
+		}
+
+		// The size only orders the work: a missing file is reported by the extraction
+		if (dataset.archive == NULL) {
+			struct stat info;
+			string path = prefix + image.name;
+			image.size = stat(path.c_str(), &info) == 0 ? (uint64_t)info.st_size : 0;
+		}
+		kept.push_back(image);
+	}
+	sort(kept.begin(), kept.end(), ImageOrder);
+
+	// Every class goes into the .arff header, even without images
+	for (size_t i = 0; i < classes.size(); i++) {
+		store.AddLabel(classes[i]);
+	}
+	store.Reserve(store.NbSamples() + kept.size());
+	for (size_t i = 0; i < kept.size(); i++) {
+		store.AddSample(prefix + kept[i].name, kept[i].label, kept[i].number, kept[i].size);
+	}
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef LABPRIMITIVE_DATASET_H
+#define LABPRIMITIVE_DATASET_H
+
+#include <string>
+#include <vector>
+
+class FeatureStore;
+class PackedDataset;
+
+// Name of the file listing the images of a directory, when it has one
+#define MANIFEST_FILE_NAME "manifest.txt"
+
+// Where the images of the training and validation sets are, and which classes to keep
+struct DatasetOptions {
+	std::string trainDirectory;
+	std::string validDirectory;
+
+	// Labels kept, in the order of the .arff header; empty = every label found, in
+	// alphabetical order
+	std::vector<std::string> classes;
+
+	// Images packed by RunPack, taken instead of the directories (NULL = none)
+	const PackedDataset *archive;
+};
+
+// Train/ and Valid/ next to the program (one level up on Linux), with homer, bart and lisa
+DatasetOptions DefaultDatasetOptions();
+
+// Appends the images of the training or the validation directory to the samples of
+// store, sorted by class (in the order of dataset.classes), then by number.
+// The images are the files listed by the MANIFEST_FILE_NAME of the directory, one
+// "file label" per line ('#' starts a comment), or else every file with an image
+// extension, whose label is the name up to the number before the extension
+// (homer12.bmp: homer). Other files, such as Thumbs.db, are skipped.
+// With an archive, the images are those packed from the directory, with the labels and
+// numbers they were packed with.
+// Returns false (with a message on stderr) if the directory or its manifest cannot
+// be read.
+bool AddDatasetImages(FeatureStore &store, bool training, const DatasetOptions &dataset);
+
+#endif
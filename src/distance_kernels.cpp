@@ -0,0 +1,32 @@
+#include "distance_kernels.h"
+#include "color_features.h"
+
+#include <string>
+
+using namespace std;
+
+void SquaredDistancesScalar(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances) {
+
+	for (size_t i = 0; i < nbSamples; i++) {
+		float distance = 0.0f;
+
+		for (int f = 0; f < nbFeatures; f++) {
+			float difference = columns[f][i] - query[f];
+			distance += difference * difference;
+		}
+
+		distances[i] = distance;
+	}
+}
+
+SquaredDistancesFn SelectedDistanceKernel() {
+	string kernel = ColorKernelName();
+
+	if (kernel == "avx2") {
+		return SquaredDistancesAvx2;
+	}
+	if (kernel == "sse42") {
+		return SquaredDistancesSse42;
+	}
+	return SquaredDistancesScalar;
+}
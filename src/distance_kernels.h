@@ -0,0 +1,20 @@
+#ifndef LABPRIMITIVE_DISTANCE_KERNELS_H
+#define LABPRIMITIVE_DISTANCE_KERNELS_H
+
+#include <cstddef>
+
+// Squared Euclidean distance from query to every sample of a column-major matrix:
+// columns[f][i] is feature f of sample i, for nbFeatures features and nbSamples samples.
+// distances receives nbSamples values.
+typedef void (*SquaredDistancesFn)(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances);
+
+// The SIMD kernels handle 4 (SSE4.2) or 8 (AVX2) samples per iteration and add the
+// features in the same order as the scalar kernel, so all three give the same floats.
+void SquaredDistancesScalar(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances);
+void SquaredDistancesSse42(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances);
+void SquaredDistancesAvx2(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances);
+
+// Kernel of the instruction set selected for the colour kernels (see SetColorKernel)
+SquaredDistancesFn SelectedDistanceKernel();
+
+#endif
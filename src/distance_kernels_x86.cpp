@@ -0,0 +1,71 @@
+#include "distance_kernels.h"
+#include "cpu_features.h"
+
+#ifdef LABPRIMITIVE_X86
+
+#include <immintrin.h>
+
+// Each lane accumulates one sample over all the features, in feature order: the
+// multiplications and additions are the ones of the scalar kernel (no FMA, which
+// would round differently).
+
+// Samples first..nbSamples-1, left over by the vector loop
+static void SquaredDistancesTail(const float *const *columns, int nbFeatures, size_t first, size_t nbSamples, const float *query, float *distances) {
+	for (size_t i = first; i < nbSamples; i++) {
+		float distance = 0.0f;
+
+		for (int f = 0; f < nbFeatures; f++) {
+			float difference = columns[f][i] - query[f];
+			distance += difference * difference;
+		}
+
+		distances[i] = distance;
+	}
+}
+
+void LABPRIMITIVE_TARGET_SSE42 SquaredDistancesSse42(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances) {
+	size_t vectorSamples = nbSamples & ~(size_t)3;
+
+	for (size_t i = 0; i < vectorSamples; i += 4) {
+		__m128 distance = _mm_setzero_ps();
+
+		for (int f = 0; f < nbFeatures; f++) {
+			__m128 difference = _mm_sub_ps(_mm_loadu_ps(columns[f] + i), _mm_set1_ps(query[f]));
+			distance = _mm_add_ps(distance, _mm_mul_ps(difference, difference));
+		}
+
+		_mm_storeu_ps(distances + i, distance);
+	}
+
+	SquaredDistancesTail(columns, nbFeatures, vectorSamples, nbSamples, query, distances);
+}
+
+void LABPRIMITIVE_TARGET_AVX2 SquaredDistancesAvx2(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances) {
+	size_t vectorSamples = nbSamples & ~(size_t)7;
+
+	for (size_t i = 0; i < vectorSamples; i += 8) {
+		__m256 distance = _mm256_setzero_ps();
+
+		for (int f = 0; f < nbFeatures; f++) {
+			__m256 difference = _mm256_sub_ps(_mm256_loadu_ps(columns[f] + i), _mm256_set1_ps(query[f]));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(difference, difference));
+		}
+
+		_mm256_storeu_ps(distances + i, distance);
+	}
+
+	SquaredDistancesTail(columns, nbFeatures, vectorSamples, nbSamples, query, distances);
+}
+
+#else
+
+// No SIMD kernel outside x86: SelectedDistanceKernel never selects these
+void SquaredDistancesSse42(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances) {
+	SquaredDistancesScalar(columns, nbFeatures, nbSamples, query, distances);
+}
+
+void SquaredDistancesAvx2(const float *const *columns, int nbFeatures, size_t nbSamples, const float *query, float *distances) {
+	SquaredDistancesScalar(columns, nbFeatures, nbSamples, query, distances);
+}
+
+#endif
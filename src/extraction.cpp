@@ -0,0 +1,559 @@
+#include "extraction.h"
+#include "bmp_reader.h"
+#include "buffer_pool.h"
+#include "color_classifier.h"
+#include "components.h"
+#include "feature_cache.h"
+#include "feature_store.h"
+#include "histogram.h"
+#include "image_features.h"
+#include "packed_dataset.h"
+#include "read_ahead.h"
+#include "sampling.h"
+#include "trace.h"
+
+#include <highgui.h>		//OpenCV lib
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+int ResolveThreadCount(int threads) {
+	if (threads > 0) {
+		return threads;
+	}
+
+	unsigned int cores = thread::hardware_concurrency();
+	return cores > 0 ? (int)cores : 1;
+}
+
+// Longest feature vector of an image
+#define MAX_IMAGE_FEATURES (MAX_COLOR_RULES * (1 + NUM_COMPONENT_FEATURES) + MAX_HISTOGRAM_FEATURES)
+
+// Where the histogram goes in the feature vector: after the colour and blob features
+static int HistogramOffset(const ExtractionOptions &options) {
+	int nbRules = options.classifier->NbFeatures();
+	return options.components ? nbRules * (1 + NUM_COMPONENT_FEATURES) : nbRules;
+}
+
+int NbImageFeatures(const ExtractionOptions &options) {
+	int bins = options.histogramBins;
+	return HistogramOffset(options) + bins * bins * bins;
+}
+
+vector<string> ImageFeatureNames(const ExtractionOptions &options) {
+	const vector<ColorRule> &rules = options.classifier->Rules();
+	vector<string> names;
+
+	for (size_t i = 0; i < rules.size(); i++) {
+		names.push_back(rules[i].name);
+	}
+	if (options.components) {
+		for (size_t i = 0; i < rules.size(); i++) {
+			for (int k = 0; k < NUM_COMPONENT_FEATURES; k++) {
+				names.push_back(rules[i].name + COMPONENT_FEATURE_SUFFIXES[k]);
+			}
+		}
+	}
+	if (options.histogramBins > 0) {
+		AddHistogramFeatureNames(options.histogramBins, names);
+	}
+	return names;
+}
+
+uint64_t FeatureConfigHash(const ExtractionOptions &options) {
+	const vector<ColorRule> &rules = options.classifier->Rules();
+	vector<int> config;
+
+	// The rule names only label the columns: renaming a rule keeps its rows
+	config.push_back((int)rules.size());
+	for (size_t i = 0; i < rules.size(); i++) {
+		const ColorBox &box = rules[i].box;
+		config.push_back(box.loB);
+		config.push_back(box.hiB);
+		config.push_back(box.loG);
+		config.push_back(box.hiG);
+		config.push_back(box.loR);
+		config.push_back(box.hiR);
+	}
+	config.push_back(options.components ? 1 : 0);
+	config.push_back(options.histogramBins);
+
+	return HashBytes(&config[0], config.size() * sizeof(int), 0);
+}
+
+void ExtractPixels(const ExtractionOptions &options, const PixelView &image, float *fVector) {
+
+	const ColorClassifier &classifier = *options.classifier;
+	int nbFeatures = classifier.NbFeatures();
+	uint64_t nbPixels = (uint64_t)image.width * image.height;
+
+	unique_ptr<ColorHistogram> histogram;
+	if (options.histogramBins > 0) {
+		histogram.reset(new ColorHistogram(options.histogramBins));
+	}
+
+	TraceCount(COUNTER_PIXELS, nbPixels);
+
+	if (options.components) {
+		TraceScope trace(STAGE_EXTRACT);
+		ExtractComponentFeatures(classifier, image, histogram.get(), fVector);
+	}
+	else {
+		uint64_t counts[MAX_COLOR_RULES];
+		{
+			TraceScope trace(STAGE_EXTRACT);
+			if (histogram) {
+				CountColorsAndHistogram(classifier, image, *histogram, counts);
+			}
+			else if (image.palette == NULL) {
+				classifier.Count(image.pixels, image.width, image.height, image.widthStep, image.nChannels, counts);
+			}
+			else {
+				// 8-bit images only need the histogram of their palette indices, then each
+				// palette colour is classified once
+				uint64_t indexHistogram[256] = { 0 };
+				for (int h = 0; h < image.height; h++) {
+					const unsigned char *row = image.pixels + (ptrdiff_t)h * image.widthStep;
+					for (int w = 0; w < image.width; w++) {
+						indexHistogram[row[w]]++;
+					}
+				}
+				classifier.CountPalette(indexHistogram, image.palette, image.paletteSize, counts);
+			}
+		}
+
+		TraceScope trace(STAGE_NORMALIZE);
+		NormalizeFeatures(counts, nbFeatures, image.width, image.height, fVector);
+	}
+
+	if (histogram) {
+		TraceScope trace(STAGE_NORMALIZE);
+		histogram->Normalize(nbPixels, fVector + HistogramOffset(options));
+	}
+}
+
+// Computes the feature vector of a BMP file a strip at a time, with the memory of one
+// strip whatever the size of the image. The counts do not depend on the order of the
+// rows, so the strips are classified in the order they are stored.
+static bool ExtractStreamedBmp(const ExtractionOptions &options, const char *fileName, float *fVector) {
+
+	const ColorClassifier &classifier = *options.classifier;
+
+	BmpStripReader reader;
+	{
+		TraceScope trace(STAGE_DECODE);
+		if (!reader.Open(fileName, STRIP_BYTES)) {
+			return false;
+		}
+	}
+
+	const BmpLayout &layout = reader.Layout();
+	int nbFeatures = classifier.NbFeatures();
+	uint64_t counts[MAX_COLOR_RULES] = { 0 };
+	uint64_t indexHistogram[256] = { 0 };
+
+	unique_ptr<ColorHistogram> histogram;
+	if (options.histogramBins > 0) {
+		histogram.reset(new ColorHistogram(options.histogramBins));
+	}
+
+	// The labeler only keeps the runs of two rows, so it streams as well
+	unique_ptr<ComponentLabeler> labeler;
+	if (options.components) {
+		labeler.reset(new ComponentLabeler(classifier, layout.width, layout.height, layout.bitsPerPixel / 8, reader.Palette(), layout.paletteSize));
+	}
+	int rowNb = 0;
+
+	for (;;) {
+		const unsigned char *rows;
+		int nbRows;
+		{
+			TraceScope trace(STAGE_DECODE);
+			nbRows = reader.ReadStrip(rows);
+		}
+
+		if (nbRows < 0) {
+			return false;
+		}
+		if (nbRows == 0) {
+			break;
+		}
+		TraceCount(COUNTER_BYTES_READ, (uint64_t)nbRows * layout.rowSize);
+		TraceCount(COUNTER_PIXELS, (uint64_t)nbRows * layout.width);
+
+		TraceScope trace(STAGE_EXTRACT);
+
+		if (labeler) {
+			for (int h = 0; h < nbRows; h++, rowNb++) {
+				labeler->AddRow(rows + (size_t)h * layout.rowSize, layout.bottomUp ? layout.height - 1 - rowNb : rowNb);
+			}
+		}
+
+		// 8-bit images: the histogram of the palette indices is classified at the end
+		if (layout.bitsPerPixel == 8) {
+			if (!labeler || histogram) {
+				for (int h = 0; h < nbRows; h++) {
+					const unsigned char *row = rows + (size_t)h * layout.rowSize;
+					for (int w = 0; w < layout.width; w++) {
+						indexHistogram[row[w]]++;
+					}
+				}
+			}
+			continue;
+		}
+
+		if (histogram) {
+			histogram->Add(rows, layout.width, nbRows, (int)layout.rowSize, layout.bitsPerPixel / 8);
+		}
+		if (!labeler) {
+			uint64_t stripCounts[MAX_COLOR_RULES];
+			classifier.Count(rows, layout.width, nbRows, (int)layout.rowSize, layout.bitsPerPixel / 8, stripCounts);
+			for (int i = 0; i < nbFeatures; i++) {
+				counts[i] += stripCounts[i];
+			}
+		}
+	}
+
+	{
+		TraceScope trace(STAGE_EXTRACT);
+		if (labeler) {
+			labeler->Finish(counts, fVector + nbFeatures);
+		}
+		else if (layout.bitsPerPixel == 8) {
+			classifier.CountPalette(indexHistogram, reader.Palette(), layout.paletteSize, counts);
+		}
+		if (histogram && layout.bitsPerPixel == 8) {
+			histogram->AddPalette(indexHistogram, reader.Palette(), layout.paletteSize);
+		}
+	}
+
+	TraceScope trace(STAGE_NORMALIZE);
+	NormalizeFeatures(counts, nbFeatures, layout.width, layout.height, fVector);
+	if (histogram) {
+		histogram->Normalize((uint64_t)layout.width * layout.height, fVector + HistogramOffset(options));
+	}
+
+	return true;
+}
+
+static PixelView BmpView(const BmpImage &bmp) {
+	PixelView image = { bmp.pixels, bmp.width, bmp.height, bmp.widthStep, bmp.bitsPerPixel / 8, bmp.palette, bmp.paletteSize };
+	return image;
+}
+
+// Computes the feature vector of pixels held in memory: every pixel, or a sample of rows
+static void ExtractView(const ExtractionOptions &options, const PixelView &image, float *fVector, float *standardErrors) {
+
+	if (options.sampling != NULL) {
+		TraceScope trace(STAGE_EXTRACT);
+		int nbRows = EstimateFeatures(*options.classifier, image, *options.sampling, fVector, standardErrors);
+		TraceCount(COUNTER_PIXELS, (uint64_t)image.width * nbRows);
+		return;
+	}
+
+	ExtractPixels(options, image, fVector);
+}
+
+// Computes the feature vector of a BMP file without decoding it.
+// No per-image allocation: the pixels are read in place in the mapped file.
+// Returns false when the file is not a BMP this reader handles.
+static bool ExtractMappedBmp(const ExtractionOptions &options, const char *fileName, float *fVector, float *standardErrors) {
+
+	MappedFile file;
+	PooledBuffer contents;
+	const unsigned char *data;
+	size_t size;
+	BmpImage bmp;
+
+	{
+		TraceScope trace(STAGE_DECODE);
+
+		// Files that cannot be mapped (pipes, some network file systems) are read into a
+		// buffer of the pool instead
+		if (file.Open(fileName)) {
+			data = file.Data();
+			size = file.Size();
+		}
+		else if (ReadWholeFile(fileName, contents, size)) {
+			data = contents.Data();
+		}
+		else {
+			return false;
+		}
+
+		if (!ParseBmp(data, size, bmp)) {
+			return false;
+		}
+	}
+
+	// Large images are streamed instead. A sampled estimate keeps the mapping, as only
+	// the pages of its rows are read.
+	if (file.Data() != NULL && size > options.streamAbove && options.sampling == NULL) {
+		file.Close();
+		return ExtractStreamedBmp(options, fileName, fVector);
+	}
+
+	TraceCount(COUNTER_BYTES_READ, size);
+
+	ExtractView(options, BmpView(bmp), fVector, standardErrors);
+	return true;
+}
+
+bool ExtractBmpData(const ExtractionOptions &options, const unsigned char *data, size_t size, float *fVector, float *standardErrors) {
+	BmpImage bmp;
+	{
+		TraceScope trace(STAGE_DECODE);
+		if (!ParseBmp(data, size, bmp)) {
+			return false;
+		}
+	}
+
+	ExtractView(options, BmpView(bmp), fVector, standardErrors);
+	return true;
+}
+
+// Loads one image and computes its feature vector.
+// With inspect, the image and its processed copy are shown until a key is pressed.
+static bool ExtractImage(const ExtractionOptions &options, const char *fileName, float *fVector, float *standardErrors, bool inspect) {
+
+	const ColorClassifier &classifier = *options.classifier;
+
+	if (options.nativeBmp && !inspect && ExtractMappedBmp(options, fileName, fVector, standardErrors)) {
+		return true;
+	}
+
+	// Load the image from disk to the structure img.
+	// 1  - Load a 3-channel image (color)
+	// 0  - Load a 1-channel image (gray level)
+	// -1 - Load the image as it is  (depends on the file)
+	IplImage *img;
+	{
+		TraceScope trace(STAGE_DECODE);
+		img = cvLoadImage(fileName, -1);
+	}
+
+	if (img == NULL) {
+		return false;
+	}
+
+	// The copy with the pixels of interest highlighted is only needed to be shown.
+	// Its pixels live in a buffer of the pool, reused from one image to the next.
+	PooledBuffer overlay;
+	IplImage *processed = NULL;
+
+	if (inspect) {
+		TraceScope trace(STAGE_COPY);
+		overlay.Reserve(img->imageSize);
+		memcpy(overlay.Data(), img->imageData, img->imageSize);
+
+		processed = cvCreateImageHeader(cvGetSize(img), img->depth, img->nChannels);
+		cvSetData(processed, overlay.Data(), img->widthStep);
+	}
+
+	if (options.sampling != NULL) {
+		PixelView image = { (const unsigned char *)img->imageData, img->width, img->height, img->widthStep, img->nChannels, NULL, 0 };
+		{
+			TraceScope trace(STAGE_EXTRACT);
+			int nbRows = EstimateFeatures(classifier, image, *options.sampling, fVector, standardErrors);
+			TraceCount(COUNTER_PIXELS, (uint64_t)img->width * nbRows);
+		}
+
+		// The viewer still shows every highlighted pixel
+		if (processed != NULL) {
+			HighlightPixels(classifier, img, processed);
+		}
+	}
+	else if (options.components || options.histogramBins > 0) {
+		PixelView image = { (const unsigned char *)img->imageData, img->width, img->height, img->widthStep, img->nChannels, NULL, 0 };
+		ExtractPixels(options, image, fVector);
+
+		if (processed != NULL) {
+			HighlightPixels(classifier, img, processed);
+		}
+	}
+	else {
+		uint64_t counts[MAX_COLOR_RULES];
+		{
+			TraceScope trace(STAGE_EXTRACT);
+			LoopOverAllPixels(classifier, img, processed, counts);
+		}
+		TraceCount(COUNTER_PIXELS, (uint64_t)img->width * img->height);
+		{
+			TraceScope trace(STAGE_NORMALIZE);
+			NormalizeFeatures(counts, classifier.NbFeatures(), img->width, img->height, fVector);
+		}
+	}
+
+	// Finally, give a look at the original image and the image with the pixels of interest in green
+	// OpenCV create an output window
+	if (inspect) {
+		cvShowImage("Original", img);
+		cvShowImage("Processed", processed);
+		cvReleaseImageHeader(&processed);
+	}
+
+	cvReleaseImage(&img);
+
+	return true;
+}
+
+bool ExtractFile(const ExtractionOptions &options, const char *fileName, float *fVector, float *standardErrors) {
+	return ExtractImage(options, fileName, fVector, standardErrors, false);
+}
+
+// Extracts the features of one sample into the store; false if its image cannot be loaded.
+// data holds the contents of its file when they were read ahead (NULL otherwise).
+static bool ExtractSample(FeatureStore &store, size_t sample, const ExtractionOptions &options, const unsigned char *data, size_t size) {
+	TraceScope trace(STAGE_IMAGE, (int64_t)sample);
+	float fVector[MAX_IMAGE_FEATURES];
+	float standardErrors[MAX_COLOR_RULES];
+	const string &path = store.Path(sample);
+
+	if (options.archive != NULL) {
+		const PackedImage *packed = options.archive->Find(path);
+		if (packed == NULL || packed->pixels == NULL) {
+			return false;
+		}
+		PixelView image = { packed->pixels, packed->width, packed->height, packed->width * 3, 3, NULL, 0 };
+		TraceCount(COUNTER_BYTES_READ, (uint64_t)packed->width * packed->height * 3);
+		ExtractView(options, image, fVector, standardErrors);
+
+		if (options.sampling != NULL) {
+			store.SetStandardErrors(sample, standardErrors);
+		}
+		store.SetFeatures(sample, fVector);
+		return true;
+	}
+
+	// The cache holds exact features, and the viewer needs the pixels. The unchanged
+	// files were taken from it before the batch.
+	FeatureCache *cache = options.sampling == NULL && !options.inspect && options.archive == NULL ? options.cache : NULL;
+	FeatureCache::FileVersion version;
+	bool hashed = false;
+	if (cache != NULL) {
+		hashed = cache->HashFile(path, version);
+		if (hashed && cache->FindContents(path, version, fVector)) {
+			store.SetFeatures(sample, fVector);
+			return true;
+		}
+	}
+
+	bool extracted = false;
+	if (data != NULL && options.nativeBmp) {
+		TraceCount(COUNTER_BYTES_READ, size);
+		extracted = ExtractBmpData(options, data, size, fVector, standardErrors);
+	}
+	// Other formats go through OpenCV, which finds the file in the OS cache
+	if (!extracted && !ExtractImage(options, path.c_str(), fVector, standardErrors, options.inspect)) {
+		return false;
+	}
+	if (hashed) {
+		cache->Add(path, version, fVector);
+	}
+
+	if (options.sampling != NULL) {
+		store.SetStandardErrors(sample, standardErrors);
+	}
+	store.SetFeatures(sample, fVector);
+	return true;
+}
+
+// Takes the file of a position of the schedule from the read-ahead, if any, and
+// extracts its sample
+static bool ExtractScheduled(FeatureStore &store, const vector<size_t> &schedule, size_t position, const ExtractionOptions &options, ReadAhead *readAhead) {
+	PooledBuffer contents;
+	size_t size = 0;
+	bool read = readAhead != NULL && readAhead->Take(position, contents, size);
+
+	return ExtractSample(store, schedule[position], options, read ? contents.Data() : NULL, size);
+}
+
+int ProcessImageBatch(FeatureStore &store, const ExtractionOptions &options, int &nbFailed) {
+
+	size_t nbSamples = store.NbSamples();
+
+	// Before any worker writes to the store
+	if (options.sampling != NULL) {
+		store.EnableStandardErrors();
+	}
+
+	// HighGUI windows belong to the thread that created them, so the viewer stays serial
+	int nbThreads = options.inspect ? 1 : ResolveThreadCount(options.threads);
+	if ((size_t)nbThreads > nbSamples) {
+		nbThreads = (int)nbSamples;
+	}
+
+	// The images that did not change since the cache saw them are not read at all
+	FeatureCache *cache = options.sampling == NULL && !options.inspect && options.archive == NULL ? options.cache : NULL;
+	vector<size_t> schedule;
+	for (size_t i = 0; i < nbSamples; i++) {
+		float fVector[MAX_IMAGE_FEATURES];
+		if (cache != NULL && cache->FindUnchanged(store.Path(i), fVector)) {
+			store.SetFeatures(i, fVector);
+		}
+		else {
+			schedule.push_back(i);
+		}
+	}
+
+	// Largest files first, so that no big image is left for the end of the batch
+	// while the other workers wait. An archive is read in the order it was packed.
+	if (nbThreads > 1 && options.archive == NULL) {
+		stable_sort(schedule.begin(), schedule.end(), [&](size_t a, size_t b) { return store.FileSize(a) > store.FileSize(b); });
+	}
+
+	// Readers keep options.readAhead files ahead of the workers. OpenCV opens the files
+	// itself, so their bytes would be read twice.
+	unique_ptr<ReadAhead> readAhead;
+	if (options.readAhead > 0 && options.nativeBmp && !options.inspect && options.archive == NULL && !schedule.empty()) {
+		vector<string> paths;
+		for (size_t i = 0; i < schedule.size(); i++) {
+			paths.push_back(store.Path(schedule[i]));
+		}
+		int nbReaders = options.readAhead < READ_AHEAD_READERS ? options.readAhead : READ_AHEAD_READERS;
+		readAhead.reset(new ReadAhead(paths, options.readAhead, options.streamAbove, nbReaders));
+	}
+
+	if (nbThreads <= 1) {
+		for (size_t i = 0; i < schedule.size(); i++) {
+			if (ExtractScheduled(store, schedule, i, options, readAhead.get()) && options.inspect) {
+				// Wait until a key is pressed to continue...
+				cvWaitKey(0);
+			}
+		}
+	}
+	else {
+		// Workers take the next sample of the schedule and fill its features in the store
+		atomic<size_t> nextSample(0);
+
+		vector<thread> workers;
+		for (int t = 0; t < nbThreads; t++) {
+			workers.push_back(thread([&]() {
+				for (size_t i = nextSample++; i < schedule.size(); i = nextSample++) {
+					ExtractScheduled(store, schedule, i, options, readAhead.get());
+				}
+			}));
+		}
+
+		for (size_t t = 0; t < workers.size(); t++) {
+			workers[t].join();
+		}
+	}
+
+	nbFailed = 0;
+	for (size_t i = 0; i < nbSamples; i++) {
+		if (!store.Extracted(i)) {
+			fprintf(stderr, "%s: could not load image\n", store.Path(i).c_str());
+			nbFailed++;
+		}
+	}
+
+	return (int)nbSamples - nbFailed;
+}
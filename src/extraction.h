@@ -0,0 +1,101 @@
+#ifndef LABPRIMITIVE_EXTRACTION_H
+#define LABPRIMITIVE_EXTRACTION_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Working buffer of a streamed image: a few hundred rows, which stay in L2 from the
+// read to the colour kernel
+#define STRIP_BYTES (256 * 1024)
+
+// Default of ExtractionOptions::streamAbove
+#define STREAM_ABOVE_BYTES (16 * 1024 * 1024)
+
+class ColorClassifier;
+class FeatureCache;
+class FeatureStore;
+class PackedDataset;
+struct PixelView;
+struct SamplingOptions;
+
+struct ExtractionOptions {
+	// Colour rules giving the features of each image
+	const ColorClassifier *classifier;
+
+	// Show each image and its processed copy, and wait for a key (always single-threaded)
+	bool inspect;
+
+	// Number of worker threads decoding and classifying images, 0 = one per core
+	int threads;
+
+	// Classify uncompressed BMP files straight from their memory mapping instead of
+	// decoding them with OpenCV (which remains the fallback for other formats)
+	bool nativeBmp;
+
+	// BMP files larger than this are read and classified a strip of rows at a time, in a
+	// buffer of STRIP_BYTES, rather than mapped whole (native decoder, exact features)
+	size_t streamAbove;
+
+	// Estimate the features from a sample of the rows of each image, with their
+	// standard errors (NULL = classify every pixel)
+	const SamplingOptions *sampling;
+
+	// Add the blob features of each rule (see components.h) after the pixel ratios.
+	// They need every pixel, so sampling must be NULL.
+	bool components;
+
+	// Add the colour histogram of each image with this many bins per channel (see
+	// histogram.h) after the other features, 0 = none. Needs every pixel too.
+	int histogramBins;
+
+	// Features of the images already extracted with the same configuration, by the
+	// contents of their file (see feature_cache.h): ProcessImageBatch only extracts the
+	// others, and adds them. NULL = none; never used with sampling or the viewer.
+	FeatureCache *cache;
+
+	// Number of files read ahead of the workers by reader threads (see read_ahead.h),
+	// so that reading overlaps classifying; 0 = each worker reads its own files.
+	// Only used with nativeBmp: OpenCV reads the files itself.
+	int readAhead;
+
+	// Images decoded beforehand by RunPack (see packed_dataset.h): the pixels of each
+	// sample are taken from the archive, by the path of its file, which is not opened.
+	// The samples are then extracted in the order of the store, which is the order of
+	// the archive. NULL = load the image files; the cache, the read-ahead and the viewer
+	// are not used with an archive.
+	const PackedDataset *archive;
+};
+
+// Length of the feature vector of an image, and the name of each feature
+int NbImageFeatures(const ExtractionOptions &options);
+std::vector<std::string> ImageFeatureNames(const ExtractionOptions &options);
+
+// Hash of everything in options that changes the values of the features: the key of
+// their rows in a FeatureCache
+uint64_t FeatureConfigHash(const ExtractionOptions &options);
+
+// Extracts the features of every sample of store, the largest files first (without an
+// archive). Each worker writes its own samples, so the store ends up the same whatever
+// the number of threads. Returns the number of images processed; images that could
+// not be loaded are reported on stderr (in sample order) and counted in nbFailed.
+int ProcessImageBatch(FeatureStore &store, const ExtractionOptions &options, int &nbFailed);
+
+// Features of one image file, and their standard errors when options.sampling is set
+// (standardErrors may then be NULL). Never opens the viewer. Returns false if the
+// image cannot be loaded.
+bool ExtractFile(const ExtractionOptions &options, const char *fileName, float *fVector, float *standardErrors);
+
+// Features of the pixels of an image held in memory (every pixel: options.sampling is
+// ignored)
+void ExtractPixels(const ExtractionOptions &options, const PixelView &image, float *fVector);
+
+// Same for the contents of an uncompressed BMP file held in memory (the formats of
+// ParseBmp); returns false for anything else
+bool ExtractBmpData(const ExtractionOptions &options, const unsigned char *data, size_t size, float *fVector, float *standardErrors);
+
+// Number of worker threads to use for a --threads value (0 = one per core)
+int ResolveThreadCount(int threads);
+
+#endif
@@ -0,0 +1,316 @@
+#include "feature_cache.h"
+#include "bmp_reader.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using namespace std;
+
+// Start of a cache file, followed by a version number
+static const char CACHE_MAGIC[4] = { 'L', 'P', 'F', 'C' };
+#define CACHE_VERSION 1
+
+// Kinds of record
+#define RECORD_FILE 1
+#define RECORD_ROW 2
+
+static inline uint64_t RotateLeft(uint64_t x, int bits) {
+	return (x << bits) | (x >> (64 - bits));
+}
+
+// Final mix, so that every input bit affects every output bit
+static inline uint64_t Avalanche(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	const uint64_t M1 = 0x9E3779B185EBCA87ull;
+	const uint64_t M2 = 0xC2B2AE3D27D4EB4Full;
+
+	// Four independent lanes of 8 bytes, so that the multiplications overlap
+	uint64_t lanes[4] = { seed + M1 + M2, seed + M2, seed, seed - M1 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int k = 0; k < 4; k++) {
+			uint64_t word;
+			memcpy(&word, bytes + i + 8 * k, 8);
+			lanes[k] = RotateLeft(lanes[k] + word * M2, 31) * M1;
+		}
+	}
+
+	uint64_t h = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+	h += (uint64_t)size;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		h = RotateLeft(h ^ (RotateLeft(word * M2, 31) * M1), 27) * M1 + M2;
+	}
+	for (; i < size; i++) {
+		h = RotateLeft(h ^ (bytes[i] * M1), 11) * M2;
+	}
+	return Avalanche(h);
+}
+
+static void Append(vector<unsigned char> &out, const void *data, size_t size) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	out.insert(out.end(), bytes, bytes + size);
+}
+
+// Reads size bytes at offset, if the buffer has them
+static bool Take(const vector<unsigned char> &in, size_t &offset, void *data, size_t size) {
+	if (in.size() - offset < size) {
+		return false;
+	}
+	memcpy(data, &in[offset], size);
+	offset += size;
+	return true;
+}
+
+FeatureCache::FeatureCache(uint64_t configHash, int nbFeatures)
+	: configHash(configHash), nbFeatures(nbFeatures), rewrite(true), nbHits(0), nbMisses(0) {
+}
+
+bool FeatureCache::Open(const char *cacheFileName) {
+	fileName = cacheFileName;
+
+	uint32_t version = CACHE_VERSION;
+	pending.clear();
+	Append(pending, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	Append(pending, &version, sizeof(version));
+	rewrite = true;
+
+	FILE *fp = fopen(cacheFileName, "rb");
+	if (fp == NULL) {
+		if (errno == ENOENT) {
+			return true;
+		}
+		perror(cacheFileName);
+		return false;
+	}
+
+	vector<unsigned char> contents;
+	unsigned char chunk[65536];
+	size_t nbRead;
+	while ((nbRead = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+		contents.insert(contents.end(), chunk, chunk + nbRead);
+	}
+	bool readError = ferror(fp) != 0;
+	fclose(fp);
+	if (readError) {
+		perror(cacheFileName);
+		return false;
+	}
+
+	size_t offset = 0;
+	char magic[sizeof(CACHE_MAGIC)];
+	if (!Take(contents, offset, magic, sizeof(magic)) || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0
+		|| !Take(contents, offset, &version, sizeof(version)) || version != CACHE_VERSION) {
+		fprintf(stderr, "%s: not a feature cache (or from another version)\n", cacheFileName);
+		return false;
+	}
+
+	// Up to the last complete record
+	size_t validBytes = offset;
+	vector<float> row;
+	for (;;) {
+		unsigned char kind;
+		if (!Take(contents, offset, &kind, 1)) {
+			break;
+		}
+
+		if (kind == RECORD_FILE) {
+			uint32_t pathLength;
+			FileVersion fileVersion;
+			if (!Take(contents, offset, &pathLength, sizeof(pathLength)) || contents.size() - offset < pathLength) {
+				break;
+			}
+			string path((const char *)&contents[offset], pathLength);
+			offset += pathLength;
+			if (!Take(contents, offset, &fileVersion.size, sizeof(fileVersion.size))
+				|| !Take(contents, offset, &fileVersion.modified, sizeof(fileVersion.modified))
+				|| !Take(contents, offset, &fileVersion.contentHash, sizeof(fileVersion.contentHash))) {
+				break;
+			}
+			// The last record of a path is the current one
+			files[path] = fileVersion;
+		}
+		else if (kind == RECORD_ROW) {
+			uint64_t rowConfig, contentHash;
+			uint32_t rowFeatures;
+			if (!Take(contents, offset, &rowConfig, sizeof(rowConfig)) || !Take(contents, offset, &contentHash, sizeof(contentHash))
+				|| !Take(contents, offset, &rowFeatures, sizeof(rowFeatures))) {
+				break;
+			}
+			row.resize(rowFeatures);
+			if (!Take(contents, offset, row.empty() ? NULL : &row[0], rowFeatures * sizeof(float))) {
+				break;
+			}
+			// Rows of the other configurations stay in the file for the runs that use them
+			if (rowConfig == configHash && (int)rowFeatures == nbFeatures && rows.find(contentHash) == rows.end()) {
+				rows[contentHash] = values.size();
+				values.insert(values.end(), row.begin(), row.end());
+			}
+		}
+		else {
+			break;
+		}
+		validBytes = offset;
+	}
+
+	// A record cut short: the complete ones are written back without it
+	if (validBytes < contents.size()) {
+		fprintf(stderr, "%s: dropping %d bytes of an incomplete record\n", cacheFileName, (int)(contents.size() - validBytes));
+		pending.assign(contents.begin(), contents.begin() + validBytes);
+	}
+	else {
+		pending.clear();
+		rewrite = false;
+	}
+	return true;
+}
+
+bool FeatureCache::StatFile(const string &path, FileVersion &version) const {
+#ifdef _WIN32
+	// The last write time in 100 ns units: _stat64 only has whole seconds, which would
+	// miss a file rewritten with the same size within a second
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) {
+		return false;
+	}
+	version.modified = (int64_t)(((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+	version.size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+#if defined(__APPLE__)
+	version.modified = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	version.modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+	version.size = (uint64_t)info.st_size;
+#endif
+	return true;
+}
+
+bool FeatureCache::FindUnchanged(const string &path, float *fVector) {
+	FileVersion current;
+	if (!StatFile(path, current)) {
+		return false;
+	}
+
+	lock_guard<mutex> lock(cacheMutex);
+	unordered_map<string, FileVersion>::const_iterator file = files.find(path);
+	if (file == files.end() || file->second.size != current.size || file->second.modified != current.modified) {
+		return false;
+	}
+	unordered_map<uint64_t, size_t>::const_iterator row = rows.find(file->second.contentHash);
+	if (row == rows.end()) {
+		return false;
+	}
+
+	memcpy(fVector, &values[row->second], nbFeatures * sizeof(float));
+	nbHits++;
+	return true;
+}
+
+bool FeatureCache::HashFile(const string &path, FileVersion &version) const {
+	// Before reading: a change made while hashing gets hashed again by the next run
+	if (!StatFile(path, version)) {
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.Open(path.c_str())) {
+		return false;
+	}
+	version.contentHash = HashBytes(file.Data(), file.Size(), 0);
+	return true;
+}
+
+void FeatureCache::AddFileRecord(const string &path, const FileVersion &version) {
+	files[path] = version;
+
+	unsigned char kind = RECORD_FILE;
+	uint32_t pathLength = (uint32_t)path.size();
+	Append(pending, &kind, 1);
+	Append(pending, &pathLength, sizeof(pathLength));
+	Append(pending, path.data(), path.size());
+	Append(pending, &version.size, sizeof(version.size));
+	Append(pending, &version.modified, sizeof(version.modified));
+	Append(pending, &version.contentHash, sizeof(version.contentHash));
+}
+
+void FeatureCache::AddRow(uint64_t contentHash, const float *fVector) {
+	rows[contentHash] = values.size();
+	values.insert(values.end(), fVector, fVector + nbFeatures);
+
+	unsigned char kind = RECORD_ROW;
+	uint32_t rowFeatures = (uint32_t)nbFeatures;
+	Append(pending, &kind, 1);
+	Append(pending, &configHash, sizeof(configHash));
+	Append(pending, &contentHash, sizeof(contentHash));
+	Append(pending, &rowFeatures, sizeof(rowFeatures));
+	Append(pending, fVector, nbFeatures * sizeof(float));
+}
+
+bool FeatureCache::FindContents(const string &path, const FileVersion &version, float *fVector) {
+	lock_guard<mutex> lock(cacheMutex);
+	unordered_map<uint64_t, size_t>::const_iterator row = rows.find(version.contentHash);
+	if (row == rows.end()) {
+		return false;
+	}
+
+	// Same contents under a new name or a new date: only the file record changes
+	AddFileRecord(path, version);
+	memcpy(fVector, &values[row->second], nbFeatures * sizeof(float));
+	nbHits++;
+	return true;
+}
+
+void FeatureCache::Add(const string &path, const FileVersion &version, const float *fVector) {
+	lock_guard<mutex> lock(cacheMutex);
+	AddFileRecord(path, version);
+	if (rows.find(version.contentHash) == rows.end()) {
+		AddRow(version.contentHash, fVector);
+	}
+	nbMisses++;
+}
+
+bool FeatureCache::Save() {
+	lock_guard<mutex> lock(cacheMutex);
+	if (pending.empty()) {
+		return true;
+	}
+
+	FILE *fp = fopen(fileName.c_str(), rewrite ? "wb" : "ab");
+	if (fp == NULL) {
+		perror(fileName.c_str());
+		return false;
+	}
+	bool written = fwrite(&pending[0], 1, pending.size(), fp) == pending.size();
+	if (fclose(fp) != 0) {
+		written = false;
+	}
+	if (!written) {
+		perror(fileName.c_str());
+		return false;
+	}
+
+	pending.clear();
+	rewrite = false;
+	return true;
+}
@@ -0,0 +1,86 @@
+#ifndef LABPRIMITIVE_FEATURE_CACHE_H
+#define LABPRIMITIVE_FEATURE_CACHE_H
+
+#include <cstddef>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 64-bit hash of a block of bytes, chained through seed (not cryptographic)
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed);
+
+// Persistent cache of feature vectors, keyed by the hash of the contents of the image
+// file and by the hash of the feature configuration (rules and feature blocks), so
+// that a rerun only extracts the new or changed files.
+//
+// The cache is one append-only file: a header, then records of two kinds,
+//     file  path, size, modification time -> content hash
+//     row   configuration hash, content hash -> feature vector
+// A file whose size and modification time did not change since its record is not
+// read again; another one is hashed, and only extracted when no row has its hash.
+// The times are in nanoseconds (100 ns on Windows), but a file system storing coarser
+// ones (FAT: 2 s) can hide a rewrite of the same size made within that interval.
+// Records are appended by Save, and a record cut short by a crash is dropped.
+// Every method may be called from several threads.
+class FeatureCache {
+public:
+	// What identifies the contents of an image file
+	struct FileVersion {
+		uint64_t size;
+		int64_t modified;		// modification time, in the units of the file system
+		uint64_t contentHash;
+	};
+
+	// Cache of the rows of configHash, each with nbFeatures values
+	FeatureCache(uint64_t configHash, int nbFeatures);
+
+	// Loads the records of fileName; a missing file is an empty cache.
+	// Returns false (with a message on stderr) if the file is not a cache.
+	bool Open(const char *fileName);
+
+	// Features of an image whose size and modification time are those of its last
+	// record, without reading it. Returns false if it has to be hashed.
+	bool FindUnchanged(const std::string &path, float *fVector);
+
+	// Hashes the contents of an image; returns false if it cannot be read
+	bool HashFile(const std::string &path, FileVersion &version) const;
+
+	// Features of an image from the hash of its contents, recording the path under
+	// that version. Returns false if they were never extracted with this configuration.
+	bool FindContents(const std::string &path, const FileVersion &version, float *fVector);
+
+	// Records the features just extracted from an image
+	void Add(const std::string &path, const FileVersion &version, const float *fVector);
+
+	// Appends the records added since Open to the file; returns false on error
+	bool Save();
+
+	// Lookups answered without extraction, and images extracted, since Open
+	size_t NbHits() const { return nbHits; }
+	size_t NbMisses() const { return nbMisses; }
+
+private:
+	bool StatFile(const std::string &path, FileVersion &version) const;
+	void AddFileRecord(const std::string &path, const FileVersion &version);
+	void AddRow(uint64_t contentHash, const float *fVector);
+
+	uint64_t configHash;
+	int nbFeatures;
+	std::string fileName;
+	bool rewrite;		// the file is missing or ends with a cut record: write it whole
+
+	std::mutex cacheMutex;
+	std::unordered_map<std::string, FileVersion> files;
+	std::unordered_map<uint64_t, size_t> rows;		// content hash -> first value in values
+	std::vector<float> values;
+
+	// Records not saved yet, in the format of the file (the whole file when rewrite)
+	std::vector<unsigned char> pending;
+
+	size_t nbHits;
+	size_t nbMisses;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "feature_store.h"
+
+using namespace std;
+
+FeatureStore::FeatureStore(const vector<string> &featureNames) : featureNames(featureNames), columns(featureNames.size()), hasStandardErrors(false) {
+}
+
+void FeatureStore::Reserve(size_t nbSamples) {
+	for (size_t f = 0; f < columns.size(); f++) {
+		columns[f].reserve(nbSamples);
+	}
+	paths.reserve(nbSamples);
+	numbers.reserve(nbSamples);
+	fileSizes.reserve(nbSamples);
+	labelIndices.reserve(nbSamples);
+	extracted.reserve(nbSamples);
+}
+
+int FeatureStore::AddLabel(const string &label) {
+
+	// Datasets have a handful of classes: a linear search is enough
+	size_t labelIndex = 0;
+	while (labelIndex < labels.size() && labels[labelIndex] != label) {
+		labelIndex++;
+	}
+	if (labelIndex == labels.size()) {
+		labels.push_back(label);
+	}
+
+	return (int)labelIndex;
+}
+
+size_t FeatureStore::AddSample(const string &path, const string &label, int number, uint64_t fileSize) {
+	int labelIndex = AddLabel(label);
+
+	for (size_t f = 0; f < columns.size(); f++) {
+		columns[f].push_back(0.0f);
+	}
+	for (size_t f = 0; f < errorColumns.size(); f++) {
+		errorColumns[f].push_back(0.0f);
+	}
+	paths.push_back(path);
+	numbers.push_back(number);
+	fileSizes.push_back(fileSize);
+	labelIndices.push_back(labelIndex);
+	extracted.push_back(0);
+
+	return paths.size() - 1;
+}
+
+void FeatureStore::SetFeatures(size_t sample, const float *fVector) {
+	for (size_t f = 0; f < columns.size(); f++) {
+		columns[f][sample] = fVector[f];
+	}
+	extracted[sample] = 1;
+}
+
+void FeatureStore::EnableStandardErrors() {
+	if (!hasStandardErrors) {
+		errorColumns.assign(featureNames.size(), vector<float>(paths.size(), 0.0f));
+		hasStandardErrors = true;
+	}
+}
+
+void FeatureStore::SetStandardErrors(size_t sample, const float *errors) {
+	for (size_t f = 0; f < errorColumns.size(); f++) {
+		errorColumns[f][sample] = errors[f];
+	}
+}
+
+size_t FeatureStore::NbExtracted() const {
+	size_t nbExtracted = 0;
+	for (size_t i = 0; i < extracted.size(); i++) {
+		nbExtracted += extracted[i] != 0;
+	}
+	return nbExtracted;
+}
@@ -0,0 +1,78 @@
+#ifndef LABPRIMITIVE_FEATURE_STORE_H
+#define LABPRIMITIVE_FEATURE_STORE_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Features of a whole dataset, one column per feature (structure of arrays).
+// Samples are numbered 0..NbSamples()-1 in the order they were added, which is also
+// the order of the output rows; each one carries the path of its image, its class
+// label, its number in the file name and the size of its file. Columns grow with the
+// dataset, so a run holds as many samples as memory allows, and a stage working on one
+// feature (normalization, statistics, a classifier) reads it as one contiguous array.
+class FeatureStore {
+public:
+	explicit FeatureStore(const std::vector<std::string> &featureNames = std::vector<std::string>());
+
+	int NbFeatures() const { return (int)featureNames.size(); }
+	const std::string &FeatureName(int feature) const { return featureNames[feature]; }
+	size_t NbSamples() const { return paths.size(); }
+
+	// Makes room for nbSamples samples without reallocation
+	void Reserve(size_t nbSamples);
+
+	// Appends a sample with its features at zero and not yet extracted; returns its index.
+	// fileSize (0 = unknown) only orders the extraction work.
+	size_t AddSample(const std::string &path, const std::string &label, int number, uint64_t fileSize = 0);
+
+	const std::string &Path(size_t sample) const { return paths[sample]; }
+	int Number(size_t sample) const { return numbers[sample]; }
+	uint64_t FileSize(size_t sample) const { return fileSizes[sample]; }
+
+	// Labels are stored once; each sample keeps the index of its label in Labels()
+	const std::string &Label(size_t sample) const { return labels[labelIndices[sample]]; }
+	int LabelIndex(size_t sample) const { return labelIndices[sample]; }
+	const std::vector<std::string> &Labels() const { return labels; }
+
+	// Index of a label in Labels(), added at the end if it is new. Declaring the labels
+	// before the samples fixes their order.
+	int AddLabel(const std::string &label);
+
+	// Values of a feature for every sample, NbSamples() contiguous floats
+	const float *Column(int feature) const { return columns[feature].empty() ? NULL : &columns[feature][0]; }
+	float Value(size_t sample, int feature) const { return columns[feature][sample]; }
+
+	// Stores the NbFeatures() values of a sample and marks it extracted.
+	// Different samples may be set concurrently, as long as no sample is being added.
+	void SetFeatures(size_t sample, const float *fVector);
+
+	// Standard error of each feature when the features are estimated from a sample of
+	// the pixels. The columns exist once EnableStandardErrors has been called.
+	void EnableStandardErrors();
+	bool HasStandardErrors() const { return hasStandardErrors; }
+	void SetStandardErrors(size_t sample, const float *errors);
+	float StandardError(size_t sample, int feature) const { return errorColumns[feature][sample]; }
+
+	// False until SetFeatures is called for the sample (image missing or unreadable)
+	bool Extracted(size_t sample) const { return extracted[sample] != 0; }
+	size_t NbExtracted() const;
+
+private:
+	std::vector<std::string> featureNames;
+	std::vector<std::vector<float> > columns;
+	std::vector<std::vector<float> > errorColumns;
+	bool hasStandardErrors;
+
+	std::vector<std::string> paths;
+	std::vector<int> numbers;
+	std::vector<uint64_t> fileSizes;
+	std::vector<int> labelIndices;
+	std::vector<std::string> labels;
+
+	// One byte per sample (not vector<bool>) so that workers can set their own samples
+	std::vector<char> extracted;
+};
+
+#endif
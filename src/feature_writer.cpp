@@ -0,0 +1,758 @@
+#include "feature_writer.h"
+#include "bmp_reader.h"
+#include "feature_cache.h"
+#include "feature_store.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Output goes through a 1 MB buffer flushed with one fwrite
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+#define RAW_MAGIC "LPFEAT01"
+#define RAW_MAGIC_SIZE 8
+
+#define SHARD_MAGIC "LPSHARD1"
+#define SHARD_MAGIC_SIZE 8
+
+class OutputBuffer {
+public:
+	OutputBuffer(FILE *fp, const char *fileName) : fp(fp), fileName(fileName), used(0), ok(true) {
+		buffer.resize(OUTPUT_BUFFER_SIZE);
+	}
+
+	~OutputBuffer() {
+		Flush();
+	}
+
+	// Returns room for at least size bytes (size <= OUTPUT_BUFFER_SIZE), to be committed with Commit
+	char *Reserve(size_t size) {
+		if (used + size > buffer.size()) {
+			Flush();
+		}
+		return &buffer[used];
+	}
+
+	void Commit(size_t size) {
+		used += size;
+	}
+
+	void Append(const void *data, size_t size) {
+		const char *bytes = (const char *)data;
+
+		while (size > 0) {
+			size_t chunk = size < buffer.size() ? size : buffer.size();
+			memcpy(Reserve(chunk), bytes, chunk);
+			Commit(chunk);
+			bytes += chunk;
+			size -= chunk;
+		}
+	}
+
+	void Append(const string &text) {
+		Append(text.data(), text.size());
+	}
+
+	void AppendU32(uint32_t value) {
+		unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+		Append(bytes, 4);
+	}
+
+	void AppendU64(uint64_t value) {
+		AppendU32((uint32_t)value);
+		AppendU32((uint32_t)(value >> 32));
+	}
+
+	// Same text as printf("%f", value)
+	void AppendFixed(float value);
+
+	// Same text as printf("%d", value)
+	void AppendInt(int value) {
+		char *out = Reserve(16);
+		Commit(sprintf(out, "%d", value));
+	}
+
+	// Returns false if any write failed, after reporting it once
+	bool Flush() {
+		if (used > 0 && ok && fwrite(&buffer[0], 1, used, fp) != used) {
+			perror(fileName);
+			ok = false;
+		}
+		used = 0;
+		return ok;
+	}
+
+private:
+	FILE *fp;
+	const char *fileName;
+	vector<char> buffer;
+	size_t used;
+	bool ok;
+};
+
+void OutputBuffer::AppendFixed(float value) {
+	char *out = Reserve(64);
+
+	// A float has 24 significant bits and 10^6 needs 14, so value * 10^6 is exact in a
+	// double: rounding it to the nearest integer (ties to even, like printf) gives
+	// the six decimals without going through the C library formatter.
+	double scaled = fabs((double)value) * 1e6;
+
+	if (!(scaled < 9e15)) {
+		// Infinite, NaN or too large for the fast path
+		Commit(sprintf(out, "%f", value));
+		return;
+	}
+
+	uint64_t fixed = (uint64_t)nearbyint(scaled);
+	uint64_t integerPart = fixed / 1000000;
+	uint32_t fraction = (uint32_t)(fixed % 1000000);
+
+	char digits[24];
+	int nbDigits = 0;
+	do {
+		digits[nbDigits++] = (char)('0' + integerPart % 10);
+		integerPart /= 10;
+	} while (integerPart != 0);
+
+	char *p = out;
+	if (signbit(value)) {
+		*p++ = '-';
+	}
+	while (nbDigits > 0) {
+		*p++ = digits[--nbDigits];
+	}
+	*p++ = '.';
+	for (int i = 5; i >= 0; i--) {
+		p[i] = (char)('0' + fraction % 10);
+		fraction /= 10;
+	}
+	p += 6;
+
+	Commit(p - out);
+}
+
+static bool LittleEndianHost() {
+	const uint16_t one = 1;
+	return *(const unsigned char *)&one == 1;
+}
+
+// Appends the values of a column as little-endian float32: for every sample, or only
+// for the extracted ones
+static void AppendColumn(OutputBuffer &output, const FeatureStore &store, int feature, bool everySample) {
+	const float *column = store.Column(feature);
+	size_t nbSamples = store.NbSamples();
+
+	if (everySample && LittleEndianHost()) {
+		// The column is already the file content
+		output.Append(column, nbSamples * sizeof(float));
+		return;
+	}
+
+	for (size_t i = 0; i < nbSamples; i++) {
+		if (everySample || store.Extracted(i)) {
+			uint32_t bits;
+			memcpy(&bits, &column[i], sizeof(bits));
+			output.AppendU32(bits);
+		}
+	}
+}
+
+bool WriteArffFeatures(const FeatureStore &store, FILE *fp, const char *fileName) {
+	OutputBuffer output(fp, fileName);
+
+	// Setup .arff header
+	output.Append(string("@relation Homer-Bart\n"));
+	output.Append(string("\n"));
+	for (int f = 0; f < store.NbFeatures(); f++) {
+		output.Append("@attribute " + store.FeatureName(f) + " real\n");
+	}
+	output.Append(string("\n"));
+
+	string classes;
+	for (size_t i = 0; i < store.Labels().size(); i++) {
+		classes += (i > 0 ? ", " : "") + store.Labels()[i];
+	}
+	output.Append("@attribute classe {" + classes + "}\n");
+	output.Append(string("@data\n"));
+
+	for (size_t i = 0; i < store.NbSamples(); i++) {
+		if (!store.Extracted(i)) {
+			continue;
+		}
+
+		for (int f = 0; f < store.NbFeatures(); f++) {
+			output.AppendFixed(store.Value(i, f));
+			output.Append(",", 1);
+		}
+
+		// IMPORTANT
+		// Do not forget the label....
+		output.Append(store.Label(i));
+		output.Append("\n", 1);
+	}
+
+	return output.Flush();
+}
+
+bool WriteNpyFeatures(const FeatureStore &store, FILE *fp, const char *fileName) {
+	size_t nbRows = store.NbExtracted();
+	bool allExtracted = nbRows == store.NbSamples();
+
+	// Version 1.0 header: magic, header length, then a Python dict padded with spaces
+	// so that the data starts on a 64-byte boundary. The matrix is stored in Fortran
+	// (column) order, which is exactly the layout of the store.
+	char dict[256];
+	int dictSize = sprintf(dict, "{'descr': '<f4', 'fortran_order': True, 'shape': (%llu, %d), }",
+		(unsigned long long)nbRows, store.NbFeatures());
+
+	string header(dict, dictSize);
+	while ((10 + header.size() + 1) % 64 != 0) {
+		header += ' ';
+	}
+	header += '\n';
+
+	{
+		OutputBuffer output(fp, fileName);
+		unsigned char preamble[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, (unsigned char)header.size(), (unsigned char)(header.size() >> 8) };
+		output.Append(preamble, sizeof(preamble));
+		output.Append(header);
+
+		for (int f = 0; f < store.NbFeatures(); f++) {
+			AppendColumn(output, store, f, allExtracted);
+		}
+
+		if (!output.Flush()) {
+			return false;
+		}
+	}
+
+	// Class of each row, for numpy.loadtxt(..., dtype=str)
+	string labelsFileName = string(fileName) + ".labels.txt";
+	FILE *labelsFile = fopen(labelsFileName.c_str(), "wb");
+
+	if (labelsFile == NULL) {
+		perror(labelsFileName.c_str());
+		return false;
+	}
+
+	bool ok;
+	{
+		OutputBuffer labels(labelsFile, labelsFileName.c_str());
+		for (size_t i = 0; i < store.NbSamples(); i++) {
+			if (store.Extracted(i)) {
+				labels.Append(store.Label(i));
+				labels.Append("\n", 1);
+			}
+		}
+		ok = labels.Flush();
+	}
+
+	if (fclose(labelsFile) != 0 && ok) {
+		perror(labelsFileName.c_str());
+		ok = false;
+	}
+
+	return ok;
+}
+
+bool WriteRawFeatures(const FeatureStore &store, FILE *fp, const char *fileName) {
+	OutputBuffer output(fp, fileName);
+	size_t nbRows = store.NbExtracted();
+	bool allExtracted = nbRows == store.NbSamples();
+
+	output.Append(RAW_MAGIC, RAW_MAGIC_SIZE);
+	output.AppendU32((uint32_t)store.NbFeatures());
+	output.AppendU32((uint32_t)store.Labels().size());
+	output.AppendU64(nbRows);
+
+	for (int f = 0; f < store.NbFeatures(); f++) {
+		output.AppendU32((uint32_t)store.FeatureName(f).size());
+		output.Append(store.FeatureName(f));
+	}
+	for (size_t i = 0; i < store.Labels().size(); i++) {
+		output.AppendU32((uint32_t)store.Labels()[i].size());
+		output.Append(store.Labels()[i]);
+	}
+
+	for (size_t i = 0; i < store.NbSamples(); i++) {
+		if (store.Extracted(i)) {
+			output.AppendU32((uint32_t)store.LabelIndex(i));
+		}
+	}
+
+	for (int f = 0; f < store.NbFeatures(); f++) {
+		AppendColumn(output, store, f, allExtracted);
+	}
+
+	return output.Flush();
+}
+
+// Sequential reader over the bytes of a raw feature file
+class InputCursor {
+public:
+	InputCursor(const unsigned char *data, size_t size) : data(data), size(size), offset(0) {
+	}
+
+	bool Has(uint64_t nbBytes) const {
+		return nbBytes <= size - offset;
+	}
+
+	const unsigned char *Take(size_t nbBytes) {
+		const unsigned char *p = data + offset;
+		offset += nbBytes;
+		return p;
+	}
+
+	bool ReadU32(uint32_t &value) {
+		if (!Has(4)) {
+			return false;
+		}
+		const unsigned char *p = Take(4);
+		value = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		return true;
+	}
+
+	bool ReadU64(uint64_t &value) {
+		uint32_t low, high;
+		if (!ReadU32(low) || !ReadU32(high)) {
+			return false;
+		}
+		value = ((uint64_t)high << 32) | low;
+		return true;
+	}
+
+	bool ReadString(string &text) {
+		uint32_t length;
+		if (!ReadU32(length) || !Has(length)) {
+			return false;
+		}
+		text.assign((const char *)Take(length), length);
+		return true;
+	}
+
+private:
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+};
+
+bool ReadRawFeatures(const char *fileName, FeatureStore &store) {
+	MappedFile file;
+
+	if (!file.Open(fileName)) {
+		perror(fileName);
+		return false;
+	}
+
+	InputCursor input(file.Data(), file.Size());
+	uint32_t nbFeatures, nbLabels;
+	uint64_t nbSamples;
+
+	if (!input.Has(RAW_MAGIC_SIZE) || memcmp(input.Take(RAW_MAGIC_SIZE), RAW_MAGIC, RAW_MAGIC_SIZE) != 0
+		|| !input.ReadU32(nbFeatures) || !input.ReadU32(nbLabels) || !input.ReadU64(nbSamples)) {
+		fprintf(stderr, "%s: not a raw feature file\n", fileName);
+		return false;
+	}
+
+	vector<string> featureNames(nbFeatures);
+	vector<string> labels(nbLabels);
+	bool ok = true;
+
+	for (uint32_t f = 0; ok && f < nbFeatures; f++) {
+		ok = input.ReadString(featureNames[f]);
+	}
+	for (uint32_t l = 0; ok && l < nbLabels; l++) {
+		ok = input.ReadString(labels[l]);
+	}
+
+	// Label indices, then one float per sample and feature
+	if (!ok || !input.Has(nbSamples * (4 + 4 * (uint64_t)nbFeatures))) {
+		fprintf(stderr, "%s: truncated raw feature file\n", fileName);
+		return false;
+	}
+
+	store = FeatureStore(featureNames);
+	store.Reserve((size_t)nbSamples);
+	for (uint32_t l = 0; l < nbLabels; l++) {
+		store.AddLabel(labels[l]);
+	}
+
+	for (uint64_t i = 0; i < nbSamples; i++) {
+		uint32_t labelIndex = 0;
+		input.ReadU32(labelIndex);
+		if (labelIndex >= nbLabels) {
+			fprintf(stderr, "%s: sample %llu has no valid label\n", fileName, (unsigned long long)i);
+			return false;
+		}
+		store.AddSample("", labels[labelIndex], (int)(i + 1));
+	}
+
+	vector<const unsigned char *> columns(nbFeatures);
+	for (uint32_t f = 0; f < nbFeatures; f++) {
+		columns[f] = input.Take((size_t)nbSamples * 4);
+	}
+
+	vector<float> fVector(nbFeatures);
+	for (uint64_t i = 0; i < nbSamples; i++) {
+		for (uint32_t f = 0; f < nbFeatures; f++) {
+			const unsigned char *p = columns[f] + 4 * i;
+			uint32_t bits = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+			memcpy(&fVector[f], &bits, sizeof(bits));
+		}
+		store.SetFeatures((size_t)i, nbFeatures > 0 ? &fVector[0] : NULL);
+	}
+
+	return true;
+}
+
+void SelectShard(const FeatureStore &all, bool training, ShardInfo &shard, FeatureStore &store, vector<uint64_t> &positions) {
+	string list;
+	for (size_t i = 0; i < all.NbSamples(); i++) {
+		list += all.Path(i) + '\n' + all.Label(i) + '\n';
+	}
+	shard.nbSamples = all.NbSamples();
+	shard.listHash = HashBytes(list.data(), list.size(), 0);
+	shard.training = training;
+
+	vector<string> featureNames;
+	for (int f = 0; f < all.NbFeatures(); f++) {
+		featureNames.push_back(all.FeatureName(f));
+	}
+	store = FeatureStore(featureNames);
+	for (size_t l = 0; l < all.Labels().size(); l++) {
+		store.AddLabel(all.Labels()[l]);
+	}
+	positions.clear();
+	for (size_t i = shard.index; i < all.NbSamples(); i += shard.count) {
+		store.AddSample(all.Path(i), all.Label(i), all.Number(i), all.FileSize(i));
+		positions.push_back(i);
+	}
+}
+
+bool WriteShardFeatures(const FeatureStore &store, const ShardInfo &shard, const vector<uint64_t> &positions, FILE *fp, const char *fileName) {
+	OutputBuffer output(fp, fileName);
+	size_t nbSamples = store.NbSamples();
+
+	output.Append(SHARD_MAGIC, SHARD_MAGIC_SIZE);
+	output.AppendU32(shard.index);
+	output.AppendU32(shard.count);
+	output.AppendU64(shard.nbSamples);
+	output.AppendU64(shard.listHash);
+	output.AppendU32(shard.training ? 1 : 0);
+	output.AppendU32((uint32_t)store.NbFeatures());
+	output.AppendU32((uint32_t)store.Labels().size());
+	output.AppendU64(nbSamples);
+
+	for (int f = 0; f < store.NbFeatures(); f++) {
+		output.AppendU32((uint32_t)store.FeatureName(f).size());
+		output.Append(store.FeatureName(f));
+	}
+	for (size_t i = 0; i < store.Labels().size(); i++) {
+		output.AppendU32((uint32_t)store.Labels()[i].size());
+		output.Append(store.Labels()[i]);
+	}
+
+	for (size_t i = 0; i < nbSamples; i++) {
+		output.AppendU64(positions[i]);
+		output.AppendU32((uint32_t)store.LabelIndex(i));
+		output.AppendU32((uint32_t)store.Number(i));
+		output.AppendU32(store.Extracted(i) ? 1 : 0);
+		output.AppendU32((uint32_t)store.Path(i).size());
+		output.Append(store.Path(i));
+	}
+
+	// Every sample has its values, so the merge finds each one at its place
+	for (int f = 0; f < store.NbFeatures(); f++) {
+		AppendColumn(output, store, f, true);
+	}
+
+	return output.Flush();
+}
+
+bool ReadShardFeatures(const char *fileName, ShardInfo &shard, vector<uint64_t> &positions, FeatureStore &store) {
+	MappedFile file;
+
+	if (!file.Open(fileName)) {
+		perror(fileName);
+		return false;
+	}
+
+	InputCursor input(file.Data(), file.Size());
+	uint32_t training, nbFeatures, nbLabels;
+	uint64_t nbSamples;
+
+	if (!input.Has(SHARD_MAGIC_SIZE) || memcmp(input.Take(SHARD_MAGIC_SIZE), SHARD_MAGIC, SHARD_MAGIC_SIZE) != 0
+		|| !input.ReadU32(shard.index) || !input.ReadU32(shard.count) || !input.ReadU64(shard.nbSamples)
+		|| !input.ReadU64(shard.listHash) || !input.ReadU32(training) || !input.ReadU32(nbFeatures)
+		|| !input.ReadU32(nbLabels) || !input.ReadU64(nbSamples)) {
+		fprintf(stderr, "%s: not a shard file\n", fileName);
+		return false;
+	}
+	shard.training = training != 0;
+
+	vector<string> featureNames(nbFeatures);
+	vector<string> labels(nbLabels);
+	bool ok = true;
+
+	for (uint32_t f = 0; ok && f < nbFeatures; f++) {
+		ok = input.ReadString(featureNames[f]);
+	}
+	for (uint32_t l = 0; ok && l < nbLabels; l++) {
+		ok = input.ReadString(labels[l]);
+	}
+
+	store = FeatureStore(featureNames);
+	store.Reserve((size_t)nbSamples);
+	for (uint32_t l = 0; l < nbLabels; l++) {
+		store.AddLabel(labels[l]);
+	}
+
+	positions.clear();
+	vector<char> extracted;
+	for (uint64_t i = 0; ok && i < nbSamples; i++) {
+		uint64_t position;
+		uint32_t labelIndex, number, wasExtracted;
+		string path;
+		ok = input.ReadU64(position) && input.ReadU32(labelIndex) && input.ReadU32(number) && input.ReadU32(wasExtracted)
+			&& input.ReadString(path);
+		if (ok && labelIndex >= nbLabels) {
+			fprintf(stderr, "%s: sample %llu has no valid label\n", fileName, (unsigned long long)i);
+			return false;
+		}
+		if (ok) {
+			store.AddSample(path, labels[labelIndex], (int)number);
+			positions.push_back(position);
+			extracted.push_back(wasExtracted != 0 ? 1 : 0);
+		}
+	}
+
+	// A shard still being written, or killed, is cut short
+	if (!ok || !input.Has(nbSamples * 4 * (uint64_t)nbFeatures)) {
+		fprintf(stderr, "%s: truncated shard file\n", fileName);
+		return false;
+	}
+
+	vector<const unsigned char *> columns(nbFeatures);
+	for (uint32_t f = 0; f < nbFeatures; f++) {
+		columns[f] = input.Take((size_t)nbSamples * 4);
+	}
+
+	vector<float> fVector(nbFeatures);
+	for (uint64_t i = 0; i < nbSamples; i++) {
+		if (!extracted[i]) {
+			continue;
+		}
+		for (uint32_t f = 0; f < nbFeatures; f++) {
+			const unsigned char *p = columns[f] + 4 * i;
+			uint32_t bits = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+			memcpy(&fVector[f], &bits, sizeof(bits));
+		}
+		store.SetFeatures((size_t)i, nbFeatures > 0 ? &fVector[0] : NULL);
+	}
+
+	return true;
+}
+
+// Splits an .arff line at the commas, trimming the spaces around each field
+static vector<string> SplitFields(const string &line) {
+	vector<string> fields;
+	size_t start = 0;
+
+	while (start <= line.size()) {
+		size_t end = line.find(',', start);
+		if (end == string::npos) {
+			end = line.size();
+		}
+
+		size_t first = line.find_first_not_of(" \t", start);
+		size_t last = line.find_last_not_of(" \t", end - 1);
+		fields.push_back(first < end && last != string::npos && last >= first ? line.substr(first, last - first + 1) : string());
+
+		start = end + 1;
+	}
+
+	return fields;
+}
+
+static bool SameKeyword(const char *text, const char *keyword) {
+	for (; *keyword != '\0'; text++, keyword++) {
+		if (tolower((unsigned char)*text) != *keyword) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Reads the next line of fp, of any length, without its end of line; returns false
+// at the end of the file
+static bool ReadLine(FILE *fp, string &line) {
+	char buffer[4096];
+
+	line.clear();
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		line += buffer;
+		if (line[line.size() - 1] == '\n') {
+			break;
+		}
+	}
+	if (line.empty()) {
+		return false;
+	}
+
+	while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r')) {
+		line.erase(line.size() - 1);
+	}
+	return true;
+}
+
+bool ReadArffFeatures(const char *fileName, FeatureStore &store) {
+	FILE *fp = fopen(fileName, "r");
+
+	if (fp == NULL) {
+		perror(fileName);
+		return false;
+	}
+
+	vector<string> featureNames;
+	vector<string> classes;
+	bool classFound = false;
+	bool inData = false;
+	bool ok = true;
+	int lineNb = 0;
+	int sampleNb = 0;
+	string line;
+	vector<float> fVector;
+
+	while (ok && ReadLine(fp, line)) {
+		lineNb++;
+
+		size_t start = line.find_first_not_of(" \t");
+		if (start == string::npos || line[start] == '%') {
+			continue;	// blank line or comment
+		}
+
+		const char *text = line.c_str() + start;
+
+		if (!inData) {
+			char name[256], type[256];
+
+			if (SameKeyword(text, "@data")) {
+				inData = true;
+				if (!classFound) {
+					fprintf(stderr, "%s:%d: no nominal class attribute\n", fileName, lineNb);
+					ok = false;
+				}
+				store = FeatureStore(featureNames);
+				for (size_t c = 0; c < classes.size(); c++) {
+					store.AddLabel(classes[c]);
+				}
+				fVector.resize(featureNames.size());
+			}
+			else if (SameKeyword(text, "@attribute")) {
+				if (classFound) {
+					fprintf(stderr, "%s:%d: the class must be the last attribute\n", fileName, lineNb);
+					ok = false;
+				}
+				else if (strchr(text, '{') != NULL) {
+					// Declared classes, in order: {homer, bart, lisa}
+					string values = strchr(text, '{') + 1;
+					values = values.substr(0, values.find('}'));
+					classes = SplitFields(values);
+					classFound = true;
+				}
+				else if (sscanf(text + 10, "%255s %255s", name, type) == 2 && (SameKeyword(type, "real") || SameKeyword(type, "numeric"))) {
+					featureNames.push_back(name);
+				}
+				else {
+					fprintf(stderr, "%s:%d: only numeric attributes and a nominal class are supported\n", fileName, lineNb);
+					ok = false;
+				}
+			}
+			continue;
+		}
+
+		vector<string> fields = SplitFields(text);
+		if (fields.size() != featureNames.size() + 1 || fields.back().empty()) {
+			fprintf(stderr, "%s:%d: expected %d features and a class\n", fileName, lineNb, (int)featureNames.size());
+			ok = false;
+			break;
+		}
+
+		for (size_t f = 0; f < featureNames.size(); f++) {
+			char *end;
+			fVector[f] = strtof(fields[f].c_str(), &end);
+			if (end == fields[f].c_str() || *end != '\0') {
+				fprintf(stderr, "%s:%d: \"%s\" is not a number\n", fileName, lineNb, fields[f].c_str());
+				ok = false;
+			}
+		}
+
+		size_t sample = store.AddSample("", fields.back(), ++sampleNb);
+		store.SetFeatures(sample, fVector.empty() ? NULL : &fVector[0]);
+	}
+
+	fclose(fp);
+
+	if (ok && !inData) {
+		fprintf(stderr, "%s: no @data section\n", fileName);
+		ok = false;
+	}
+
+	return ok;
+}
+
+bool LoadFeatures(const char *fileName, FeatureStore &store) {
+	char magic[RAW_MAGIC_SIZE];
+	FILE *fp = fopen(fileName, "rb");
+
+	if (fp == NULL) {
+		perror(fileName);
+		return false;
+	}
+
+	bool raw = fread(magic, 1, RAW_MAGIC_SIZE, fp) == RAW_MAGIC_SIZE && memcmp(magic, RAW_MAGIC, RAW_MAGIC_SIZE) == 0;
+	fclose(fp);
+
+	return raw ? ReadRawFeatures(fileName, store) : ReadArffFeatures(fileName, store);
+}
+
+void PrintFeatureRows(const FeatureStore &store, FILE *out) {
+	OutputBuffer output(out, "stdout");
+
+	for (size_t i = 0; i < store.NbSamples(); i++) {
+		if (!store.Extracted(i)) {
+			continue;
+		}
+
+		output.Append(store.Path(i));
+		output.AppendInt(store.Number(i));
+		for (int f = 0; f < store.NbFeatures(); f++) {
+			output.Append(" ", 1);
+			output.AppendFixed(store.Value(i, f));
+		}
+		output.Append("\n", 1);
+	}
+}
+
+static const FeatureFormat FEATURE_FORMATS[] = {
+	{ "arff", ".arff", WriteArffFeatures },
+	{ "npy", ".npy", WriteNpyFeatures },
+	{ "raw", ".lpf", WriteRawFeatures }
+};
+
+const FeatureFormat *FindFeatureFormat(const char *name) {
+	for (size_t i = 0; i < sizeof(FEATURE_FORMATS) / sizeof(FEATURE_FORMATS[0]); i++) {
+		if (strcmp(FEATURE_FORMATS[i].name, name) == 0) {
+			return &FEATURE_FORMATS[i];
+		}
+	}
+	return NULL;
+}
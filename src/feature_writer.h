@@ -0,0 +1,92 @@
+#ifndef LABPRIMITIVE_FEATURE_WRITER_H
+#define LABPRIMITIVE_FEATURE_WRITER_H
+
+#include <cstdio>
+#include <stdint.h>
+#include <vector>
+
+class FeatureStore;
+
+// Writes the extracted samples of store to fp, already opened in binary mode on
+// fileName (formats with a sidecar file derive its name from fileName).
+// Returns false, with the error reported on stderr, if a write fails.
+typedef bool (*WriteFeaturesFn)(const FeatureStore &store, FILE *fp, const char *fileName);
+
+// An output format of the feature vectors
+struct FeatureFormat {
+	const char *name;
+	const char *extension;	// default file extension, with the dot
+	WriteFeaturesFn write;
+};
+
+// Formats known to FindFeatureFormat:
+//   arff  Weka text file, one row per sample (features, then the class)
+//   npy   NumPy float32 matrix of shape (samples, features) in column order, plus
+//         <file>.labels.txt with the class of each row, one per line
+//   raw   columnar binary file (see WriteRawFeatures)
+// Returns NULL for an unknown name.
+const FeatureFormat *FindFeatureFormat(const char *name);
+
+bool WriteArffFeatures(const FeatureStore &store, FILE *fp, const char *fileName);
+bool WriteNpyFeatures(const FeatureStore &store, FILE *fp, const char *fileName);
+
+// Raw columnar file, little-endian:
+//     char[8]   magic "LPFEAT01"
+//     uint32    number of features F
+//     uint32    number of labels L
+//     uint64    number of samples N
+//     F names, then L labels, each a uint32 length followed by its bytes
+//     int32[N]  index of the label of each sample
+//     F columns of float32[N], in feature order
+bool WriteRawFeatures(const FeatureStore &store, FILE *fp, const char *fileName);
+
+// Loads a raw columnar file into store (replacing its content); every sample is
+// marked extracted. Returns false, with the error reported on stderr, if the file
+// cannot be read or is not a raw feature file.
+bool ReadRawFeatures(const char *fileName, FeatureStore &store);
+
+// Loads the data of an .arff file: its numeric attributes become the features, and
+// its last attribute, which must be nominal, the label of each row. Returns false,
+// with the error and its line reported on stderr, on anything else.
+bool ReadArffFeatures(const char *fileName, FeatureStore &store);
+
+// Loads a raw feature file (recognized by its magic) or else an .arff file
+bool LoadFeatures(const char *fileName, FeatureStore &store);
+
+// Part of a run split across processes with --shard: shard index (from 0) of count.
+// The samples of the full list go to the shards in turn, and each shard keeps the
+// position of its samples in that list, so that merge puts them back in order.
+struct ShardInfo {
+	uint32_t index;
+	uint32_t count;
+	uint64_t nbSamples;		// of the full list
+	uint64_t listHash;		// of the paths and labels of the full list: shards of other runs do not merge
+	bool training;
+};
+
+// Keeps in store the samples of one shard of all, the full list of a run: every
+// shard.count-th sample from shard.index, not extracted yet, with their position in
+// all. Fills in the rest of shard from the list (shard.index and count are read).
+void SelectShard(const FeatureStore &all, bool training, ShardInfo &shard, FeatureStore &store, std::vector<uint64_t> &positions);
+
+// Shard file, little-endian:
+//     char[8]   magic "LPSHARD1"
+//     uint32    shard index, uint32 shard count, uint64 samples of the full list,
+//     uint64    list hash, uint32 training (1) or validation (0)
+//     uint32    number of features F, uint32 number of labels L, uint64 samples N
+//     F names, then L labels, each a uint32 length followed by its bytes
+//     N samples: uint64 position in the full list, uint32 label index, int32 number,
+//               uint32 extracted (1) or not loaded (0), path (uint32 length, bytes)
+//     F columns of float32[N], in feature order (0 for the samples not loaded)
+// positions holds the position of each sample of store, not-loaded samples included.
+bool WriteShardFeatures(const FeatureStore &store, const ShardInfo &shard, const std::vector<uint64_t> &positions, FILE *fp, const char *fileName);
+
+// Loads a shard file into store (replacing its content) and positions; only the
+// samples extracted by the shard are marked extracted. Returns false, with the error
+// reported on stderr, if the file cannot be read, is truncated or is not a shard file.
+bool ReadShardFeatures(const char *fileName, ShardInfo &shard, std::vector<uint64_t> &positions, FeatureStore &store);
+
+// Echoes each extracted sample on out: its path and number, then its features
+void PrintFeatureRows(const FeatureStore &store, FILE *out);
+
+#endif
@@ -0,0 +1,168 @@
+#include "histogram.h"
+#include "color_classifier.h"
+#include "sampling.h"
+
+#include <cstddef>
+#include <cstdio>
+
+using namespace std;
+
+// Rows counted and added to the histogram together: about as many bytes as the L1 cache
+#define HISTOGRAM_BLOCK_BYTES (32 * 1024)
+
+bool ValidHistogramBins(int bins) {
+	return bins >= MIN_HISTOGRAM_BINS && bins <= MAX_HISTOGRAM_BINS && (bins & (bins - 1)) == 0;
+}
+
+ColorHistogram::ColorHistogram(int binsPerChannel) : bits(0), pendingPixels(0) {
+	while ((1 << bits) < binsPerChannel) {
+		bits++;
+	}
+	shift = 8 - bits;
+
+	size_t nbBins = (size_t)1 << (3 * bits);
+	lanes.assign(HISTOGRAM_LANES * nbBins, 0);
+	totals.assign(nbBins, 0);
+}
+
+// Bin of a pixel: its three channels, quantized, side by side
+static inline uint32_t Bin(const unsigned char *pixel, int greenOffset, int redOffset, int shift, int bits) {
+	return ((uint32_t)(pixel[0] >> shift) << (2 * bits)) | ((uint32_t)(pixel[greenOffset] >> shift) << bits) | (uint32_t)(pixel[redOffset] >> shift);
+}
+
+// One row, with the pixel i going to the sub-histogram i % HISTOGRAM_LANES
+template <int N>
+static void AddRow(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins) {
+	// A gray level image has the same value in the three channels
+	const int greenOffset = N >= 3 ? 1 : 0;
+	const int redOffset = N >= 3 ? 2 : 0;
+
+	uint32_t *h0 = lanes;
+	uint32_t *h1 = lanes + nbBins;
+	uint32_t *h2 = lanes + 2 * nbBins;
+	uint32_t *h3 = lanes + 3 * nbBins;
+
+	int w = 0;
+	for (; w + 4 <= width; w += 4, row += 4 * N) {
+		h0[Bin(row, greenOffset, redOffset, shift, bits)]++;
+		h1[Bin(row + N, greenOffset, redOffset, shift, bits)]++;
+		h2[Bin(row + 2 * N, greenOffset, redOffset, shift, bits)]++;
+		h3[Bin(row + 3 * N, greenOffset, redOffset, shift, bits)]++;
+	}
+	for (; w < width; w++, row += N) {
+		h0[Bin(row, greenOffset, redOffset, shift, bits)]++;
+	}
+}
+
+void AddHistogramRowScalar(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins) {
+	AddRow<3>(row, width, shift, bits, lanes, nbBins);
+}
+
+void ColorHistogram::Add(const unsigned char *data, int width, int height, int widthStep, int nChannels) {
+	size_t nbBins = totals.size();
+	HistogramRowFn addBgrRow = SelectedHistogramKernel();
+
+	for (int h = 0; h < height; h++) {
+		// A lane counter holds at most the pixels added since the last flush
+		if (pendingPixels + (uint64_t)width > 0xFFFFFFFFull) {
+			Flush();
+		}
+		pendingPixels += (uint64_t)width;
+
+		const unsigned char *row = data + (ptrdiff_t)h * widthStep;
+		switch (nChannels) {
+		case 1:
+			AddRow<1>(row, width, shift, bits, &lanes[0], nbBins);
+			break;
+		case 3:
+			addBgrRow(row, width, shift, bits, &lanes[0], nbBins);
+			break;
+		default:
+			AddRow<4>(row, width, shift, bits, &lanes[0], nbBins);
+			break;
+		}
+	}
+}
+
+void ColorHistogram::AddPalette(const uint64_t indexHistogram[256], const unsigned char *palette, int paletteSize) {
+	static const unsigned char BLACK[4] = { 0, 0, 0, 0 };
+
+	for (int index = 0; index < 256; index++) {
+		const unsigned char *color = index < paletteSize ? palette + 4 * index : BLACK;
+		totals[Bin(color, 1, 2, shift, bits)] += indexHistogram[index];
+	}
+}
+
+void ColorHistogram::Flush() {
+	size_t nbBins = totals.size();
+
+	for (int lane = 0; lane < HISTOGRAM_LANES; lane++) {
+		uint32_t *counts = &lanes[lane * nbBins];
+		for (size_t i = 0; i < nbBins; i++) {
+			totals[i] += counts[i];
+			counts[i] = 0;
+		}
+	}
+	pendingPixels = 0;
+}
+
+void ColorHistogram::Normalize(uint64_t nbPixels, float *features) {
+	Flush();
+
+	// Same normalization as the colour features
+	float scale = (float)nbPixels;
+	for (size_t i = 0; i < totals.size(); i++) {
+		features[i] = (float)totals[i] / scale;
+	}
+}
+
+void AddHistogramFeatureNames(int binsPerChannel, vector<string> &names) {
+	for (int b = 0; b < binsPerChannel; b++) {
+		for (int g = 0; g < binsPerChannel; g++) {
+			for (int r = 0; r < binsPerChannel; r++) {
+				char name[48];
+				sprintf(name, "Hist_%d_%d_%d", b, g, r);
+				names.push_back(name);
+			}
+		}
+	}
+}
+
+void CountColorsAndHistogram(const ColorClassifier &classifier, const PixelView &image, ColorHistogram &histogram, uint64_t *counts) {
+	int nbFeatures = classifier.NbFeatures();
+
+	// Palette images: both come from the histogram of the indices
+	if (image.palette != NULL) {
+		uint64_t indexHistogram[256] = { 0 };
+		for (int h = 0; h < image.height; h++) {
+			const unsigned char *row = image.pixels + (ptrdiff_t)h * image.widthStep;
+			for (int w = 0; w < image.width; w++) {
+				indexHistogram[row[w]]++;
+			}
+		}
+
+		classifier.CountPalette(indexHistogram, image.palette, image.paletteSize, counts);
+		histogram.AddPalette(indexHistogram, image.palette, image.paletteSize);
+		return;
+	}
+
+	for (int i = 0; i < nbFeatures; i++) {
+		counts[i] = 0;
+	}
+
+	int rowBytes = image.width * image.nChannels;
+	int rowsPerBlock = rowBytes < HISTOGRAM_BLOCK_BYTES ? HISTOGRAM_BLOCK_BYTES / rowBytes : 1;
+
+	for (int first = 0; first < image.height; first += rowsPerBlock) {
+		int nbRows = image.height - first < rowsPerBlock ? image.height - first : rowsPerBlock;
+		const unsigned char *block = image.pixels + (ptrdiff_t)first * image.widthStep;
+
+		uint64_t blockCounts[MAX_COLOR_RULES];
+		classifier.Count(block, image.width, nbRows, image.widthStep, image.nChannels, blockCounts);
+		for (int i = 0; i < nbFeatures; i++) {
+			counts[i] += blockCounts[i];
+		}
+
+		histogram.Add(block, image.width, nbRows, image.widthStep, image.nChannels);
+	}
+}
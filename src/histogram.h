@@ -0,0 +1,76 @@
+#ifndef LABPRIMITIVE_HISTOGRAM_H
+#define LABPRIMITIVE_HISTOGRAM_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ColorClassifier;
+struct PixelView;
+
+// Bins per channel of the colour histogram: a power of two from 2 to 16
+#define MIN_HISTOGRAM_BINS 2
+#define MAX_HISTOGRAM_BINS 16
+
+// Bins of the largest histogram (16 x 16 x 16)
+#define MAX_HISTOGRAM_FEATURES (MAX_HISTOGRAM_BINS * MAX_HISTOGRAM_BINS * MAX_HISTOGRAM_BINS)
+
+// Number of sub-histograms filled in turn: consecutive pixels of the same colour then
+// increment different counters, instead of each waiting for the store of the one before
+#define HISTOGRAM_LANES 4
+
+// Adds the bins of one row of width BGR pixels to the HISTOGRAM_LANES sub-histograms of
+// nbBins counters at lanes, with channels quantized by value >> shift into bits bits.
+// The SIMD kernels gather the channels with the shuffles of the colour kernels and
+// compute 16 or 32 bin indices at once; a run of 16 pixels in the same bin, common in
+// flat regions, is then a single addition.
+typedef void (*HistogramRowFn)(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins);
+
+void AddHistogramRowScalar(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins);
+void AddHistogramRowSse42(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins);
+void AddHistogramRowAvx2(const unsigned char *row, int width, int shift, int bits, uint32_t *lanes, size_t nbBins);
+
+// Kernel of the instruction set selected for the colour kernels, resolved with them by
+// SetColorKernel (see color_features.h)
+HistogramRowFn SelectedHistogramKernel();
+
+// Quantized BGR histogram of an image: each channel is cut into binsPerChannel ranges of
+// the same width, and bin (b, g, r) is at index (b * bins + g) * bins + r.
+class ColorHistogram {
+public:
+	explicit ColorHistogram(int binsPerChannel);
+
+	int NbBins() const { return (int)totals.size(); }
+
+	// Adds height rows of width pixels of nChannels bytes (BGR(X), or gray levels)
+	void Add(const unsigned char *data, int width, int height, int widthStep, int nChannels);
+
+	// Adds the pixels of a palette image from the histogram of its palette indices.
+	// Indices past paletteSize are black.
+	void AddPalette(const uint64_t indexHistogram[256], const unsigned char *palette, int paletteSize);
+
+	// Stores the fraction of the nbPixels pixels in each bin
+	void Normalize(uint64_t nbPixels, float *features);
+
+private:
+	void Flush();
+
+	int bits;			// log2 of the bins per channel
+	int shift;			// 8 - bits
+	std::vector<uint32_t> lanes;		// HISTOGRAM_LANES sub-histograms, one after the other
+	uint64_t pendingPixels;				// added to lanes since the last Flush
+	std::vector<uint64_t> totals;
+};
+
+// Whether bins is a valid number of bins per channel
+bool ValidHistogramBins(int bins);
+
+// Attribute names of the bins, "Hist_b_g_r"
+void AddHistogramFeatureNames(int binsPerChannel, std::vector<std::string> &names);
+
+// Counts the colour pixels of each rule and fills histogram in the same pass over image:
+// both walk each block of rows while it is in the cache
+void CountColorsAndHistogram(const ColorClassifier &classifier, const PixelView &image, ColorHistogram &histogram, uint64_t *counts);
+
+#endif
@@ -0,0 +1,26 @@
+#include "image_features.h"
+
+void LoopOverAllPixels(const ColorClassifier &classifier, const IplImage *img, const IplImage *processed, uint64_t *counts) {
+
+	classifier.Count((const unsigned char *)img->imageData, img->width, img->height, img->widthStep, img->nChannels, counts);
+
+	// Just to be sure we are doing the right thing, the pixels of the highlighted
+	// colours are painted in a cloned image (processed)
+	if (processed != NULL) {
+		HighlightPixels(classifier, img, processed);
+	}
+}
+
+void HighlightPixels(const ColorClassifier &classifier, const IplImage *img, const IplImage *processed) {
+	classifier.Highlight((const unsigned char *)img->imageData, img->width, img->height, img->widthStep, img->nChannels,
+		(unsigned char *)processed->imageData, processed->widthStep, processed->nChannels);
+}
+
+void ExtractFeatures(const ColorClassifier &classifier, const IplImage *img, const IplImage *processed, float *fVector) {
+
+	uint64_t counts[MAX_COLOR_RULES];
+
+	LoopOverAllPixels(classifier, img, processed, counts);
+
+	NormalizeFeatures(counts, classifier.NbFeatures(), img->width, img->height, fVector);
+}
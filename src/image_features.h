@@ -0,0 +1,22 @@
+#ifndef LABPRIMITIVE_IMAGE_FEATURES_H
+#define LABPRIMITIVE_IMAGE_FEATURES_H
+
+#include "color_classifier.h"
+
+#include <cv.h> 			//OpenCV lib
+
+// The colour classifier on OpenCV images, for the command line program and its viewer.
+// The classifier itself works on raw pixel buffers and does not depend on OpenCV.
+
+// Counts the colour pixels of img. When processed is not NULL, the pixels of the
+// highlighted rules are painted in it so they can be inspected.
+void LoopOverAllPixels(const ColorClassifier &classifier, const IplImage *img, const IplImage *processed, uint64_t *counts);
+
+// Paints the pixels of the highlighted rules of img in processed
+void HighlightPixels(const ColorClassifier &classifier, const IplImage *img, const IplImage *processed);
+
+// Runs LoopOverAllPixels over img and stores one feature per rule, normalized by the
+// image size, in fVector.
+void ExtractFeatures(const ColorClassifier &classifier, const IplImage *img, const IplImage *processed, float *fVector);
+
+#endif
@@ -0,0 +1,116 @@
+#include "labprimitive.h"
+#include "color_classifier.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Checks that image describes pixels the colour kernels can read
+static bool ValidImage(const ImageBuffer &image) {
+	if (image.pixels == NULL || image.width <= 0 || image.height <= 0) {
+		return false;
+	}
+	if (image.channels != 1 && image.channels != 3 && image.channels != 4) {
+		return false;
+	}
+	return (int64_t)abs(image.stride) >= (int64_t)image.width * image.channels;
+}
+
+FeatureExtractor::FeatureExtractor() : classifier(NULL) {
+	// Resolve the kernel now rather than on the first call of a worker thread
+	ColorKernelName();
+	classifier = new ColorClassifier(BuiltinColorRules());
+}
+
+FeatureExtractor::FeatureExtractor(const char *rulesFileName, const char *featureList) : classifier(NULL) {
+	vector<ColorRule> rules = BuiltinColorRules();
+
+	if (rulesFileName != NULL && !LoadColorRules(rulesFileName, rules)) {
+		return;
+	}
+	if (featureList != NULL && !SelectColorRules(featureList, rules)) {
+		return;
+	}
+
+	ColorKernelName();
+	classifier = new ColorClassifier(rules);
+}
+
+FeatureExtractor::~FeatureExtractor() {
+	delete classifier;
+}
+
+int FeatureExtractor::NbFeatures() const {
+	return classifier != NULL ? classifier->NbFeatures() : 0;
+}
+
+const char *FeatureExtractor::FeatureName(int feature) const {
+	if (feature < 0 || feature >= NbFeatures()) {
+		return NULL;
+	}
+	return classifier->Rules()[feature].name.c_str();
+}
+
+bool FeatureExtractor::Extract(const ImageBuffer &image, float *features, size_t capacity) const {
+	if (classifier == NULL || capacity < (size_t)classifier->NbFeatures() || !ValidImage(image)) {
+		return false;
+	}
+
+	uint64_t counts[MAX_COLOR_RULES];
+	classifier->Count(image.pixels, image.width, image.height, image.stride, image.channels, counts);
+	NormalizeFeatures(counts, classifier->NbFeatures(), image.width, image.height, features);
+
+	return true;
+}
+
+size_t FeatureExtractor::ExtractBatch(const ImageBuffer *images, size_t nbImages, float *features, size_t capacity, int threads) const {
+	size_t nbFeatures = (size_t)NbFeatures();
+
+	if (classifier == NULL || capacity / (nbFeatures > 0 ? nbFeatures : 1) < nbImages) {
+		return 0;
+	}
+
+	atomic<size_t> nextImage(0);
+	atomic<size_t> nbExtracted(0);
+
+	// Each image writes its own row, so the result does not depend on the threads
+	auto work = [&]() {
+		size_t extracted = 0;
+		for (size_t i = nextImage++; i < nbImages; i = nextImage++) {
+			float *row = features + i * nbFeatures;
+			if (Extract(images[i], row, nbFeatures)) {
+				extracted++;
+			}
+			else {
+				for (size_t f = 0; f < nbFeatures; f++) {
+					row[f] = NAN;
+				}
+			}
+		}
+		nbExtracted += extracted;
+	};
+
+	int nbThreads = threads > 0 ? threads : (int)thread::hardware_concurrency();
+	if ((size_t)nbThreads > nbImages) {
+		nbThreads = (int)nbImages;
+	}
+
+	if (nbThreads <= 1) {
+		work();
+	}
+	else {
+		vector<thread> workers;
+		for (int t = 0; t < nbThreads; t++) {
+			workers.push_back(thread(work));
+		}
+		for (size_t t = 0; t < workers.size(); t++) {
+			workers[t].join();
+		}
+	}
+
+	return nbExtracted;
+}
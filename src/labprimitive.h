@@ -0,0 +1,61 @@
+#ifndef LABPRIMITIVE_LABPRIMITIVE_H
+#define LABPRIMITIVE_LABPRIMITIVE_H
+
+// Colour features of images held in memory, for programs embedding the extractor.
+// This header and the labprimitive library do not use OpenCV: images are raw pixel
+// buffers, and features are written into arrays of the caller. Once a FeatureExtractor
+// is built, Extract allocates nothing, and one extractor can be shared by any number
+// of threads.
+
+#include <cstddef>
+
+class ColorClassifier;
+
+// Pixels of an image: BGR (channels 3), BGRX (4) or gray levels (1), rows stride bytes
+// apart. A negative stride reads bottom-up images with pixels pointing to the top row.
+struct ImageBuffer {
+	const unsigned char *pixels;
+	int width;
+	int height;
+	int stride;
+	int channels;
+};
+
+class FeatureExtractor {
+public:
+	// The six built-in colours: Orange, White, Brown, Blue, Green and Red
+	FeatureExtractor();
+
+	// Colour rules read from rulesFileName (see color-rules.txt), or the built-in ones
+	// when it is NULL, keeping only those of the comma-separated featureList when it
+	// is not NULL. Errors go to stderr and leave the extractor not Valid().
+	FeatureExtractor(const char *rulesFileName, const char *featureList);
+
+	~FeatureExtractor();
+
+	bool Valid() const { return classifier != NULL; }
+
+	// Length of a feature vector, and the name of each of its features
+	int NbFeatures() const;
+	const char *FeatureName(int feature) const;
+
+	// Stores in features the fraction of the pixels of image that have each colour.
+	// Returns false, without writing, if the image is malformed or features holds less
+	// than NbFeatures() values.
+	bool Extract(const ImageBuffer &image, float *features, size_t capacity) const;
+
+	// Extracts nbImages images into features, one row of NbFeatures() values per image.
+	// The rows of malformed images are set to NaN. Up to threads worker threads share
+	// the images (0 = one per core, 1 = the calling thread, without allocation).
+	// Returns the number of images extracted, or 0 if features holds less than
+	// nbImages rows.
+	size_t ExtractBatch(const ImageBuffer *images, size_t nbImages, float *features, size_t capacity, int threads = 1) const;
+
+private:
+	FeatureExtractor(const FeatureExtractor &);
+	FeatureExtractor &operator=(const FeatureExtractor &);
+
+	ColorClassifier *classifier;
+};
+
+#endif
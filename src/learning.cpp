@@ -0,0 +1,283 @@
+#include "learning.h"
+#include "distance_kernels.h"
+#include "feature_store.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void RankNeighbours(const float *distances, size_t nbSamples, size_t nbNeighbours, vector<size_t> &order) {
+	for (size_t i = 0; i < nbSamples; i++) {
+		order[i] = i;
+	}
+
+	struct Closer {
+		const float *d;
+		bool operator()(size_t a, size_t b) const { return d[a] < d[b] || (d[a] == d[b] && a < b); }
+	} closer = { distances };
+
+	nth_element(order.begin(), order.begin() + (nbNeighbours - 1), order.begin() + nbSamples, closer);
+	sort(order.begin(), order.begin() + nbNeighbours, closer);
+}
+
+int VoteNeighbours(const size_t *nearest, size_t nbNeighbours, const int *classes, vector<int> &votes) {
+	fill(votes.begin(), votes.end(), 0);
+	int bestVotes = 0;
+	for (size_t n = 0; n < nbNeighbours; n++) {
+		int votesForClass = ++votes[classes[nearest[n]]];
+		bestVotes = max(bestVotes, votesForClass);
+	}
+
+	// Among the classes with the most votes, the one of the nearest neighbour
+	for (size_t n = 0; n < nbNeighbours; n++) {
+		if (votes[classes[nearest[n]]] == bestVotes) {
+			return classes[nearest[n]];
+		}
+	}
+	return classes[nearest[0]];
+}
+
+double NaiveBayesSmoothing(double largestVariance) {
+	double smoothing = 1e-9 * largestVariance;
+	return smoothing > 0.0 ? smoothing : 1e-9;
+}
+
+double GaussianLogNormalizer(double variance) {
+	const double PI = 3.14159265358979323846;
+	return -0.5 * log(2.0 * PI * variance);
+}
+
+int MostLikelyClass(const vector<double> &logPriors, const double *means, const double *variances, const double *logNormalizers,
+	int nbFeatures, const float *values) {
+
+	int best = -1;
+	double bestLogLikelihood = -HUGE_VAL;
+
+	for (int c = 0; c < (int)logPriors.size(); c++) {
+		if (logPriors[c] == -HUGE_VAL) {
+			continue;
+		}
+
+		double logLikelihood = logPriors[c];
+		for (int f = 0; f < nbFeatures; f++) {
+			size_t index = (size_t)c * nbFeatures + f;
+			double difference = values[f] - means[index];
+			logLikelihood += logNormalizers[index] - difference * difference / (2.0 * variances[index]);
+		}
+
+		if (best < 0 || logLikelihood > bestLogLikelihood) {
+			best = c;
+			bestLogLikelihood = logLikelihood;
+		}
+	}
+
+	return best;
+}
+
+KnnClassifier::KnnClassifier(int k) : k(k > 0 ? k : 1), nbClasses(0), nbSamples(0) {
+}
+
+void KnnClassifier::Train(const FeatureStore &training) {
+	int nbFeatures = training.NbFeatures();
+
+	nbClasses = (int)training.Labels().size();
+	nbSamples = training.NbExtracted();
+	offsets.assign(nbFeatures, 0.0f);
+	scales.assign(nbFeatures, 0.0f);
+	columns.assign(nbFeatures, vector<float>());
+	columnPointers.assign(nbFeatures, (const float *)NULL);
+	classes.clear();
+
+	for (size_t i = 0; i < training.NbSamples(); i++) {
+		if (training.Extracted(i)) {
+			classes.push_back(training.LabelIndex(i));
+		}
+	}
+
+	for (int f = 0; f < nbFeatures; f++) {
+		float low = 0.0f, high = 0.0f;
+		bool first = true;
+
+		for (size_t i = 0; i < training.NbSamples(); i++) {
+			if (training.Extracted(i)) {
+				float value = training.Value(i, f);
+				low = first || value < low ? value : low;
+				high = first || value > high ? value : high;
+				first = false;
+			}
+		}
+
+		// A constant feature does not separate anything: it is scaled to 0
+		offsets[f] = low;
+		scales[f] = high > low ? 1.0f / (high - low) : 0.0f;
+
+		columns[f].reserve(nbSamples);
+		for (size_t i = 0; i < training.NbSamples(); i++) {
+			if (training.Extracted(i)) {
+				columns[f].push_back((training.Value(i, f) - offsets[f]) * scales[f]);
+			}
+		}
+		columnPointers[f] = columns[f].empty() ? NULL : &columns[f][0];
+	}
+
+	distances.resize(nbSamples);
+	order.resize(nbSamples);
+	votes.resize(nbClasses);
+}
+
+int KnnClassifier::Predict(const float *fVector) const {
+	int nbFeatures = (int)columns.size();
+
+	if (nbSamples == 0) {
+		return -1;
+	}
+
+	vector<float> query(nbFeatures);
+	for (int f = 0; f < nbFeatures; f++) {
+		query[f] = (fVector[f] - offsets[f]) * scales[f];
+	}
+
+	SelectedDistanceKernel()(nbFeatures > 0 ? &columnPointers[0] : NULL, nbFeatures, nbSamples, nbFeatures > 0 ? &query[0] : NULL, &distances[0]);
+
+	// The k nearest samples, closest first
+	size_t nbNeighbours = (size_t)k < nbSamples ? (size_t)k : nbSamples;
+	RankNeighbours(&distances[0], nbSamples, nbNeighbours, order);
+	return VoteNeighbours(&order[0], nbNeighbours, &classes[0], votes);
+}
+
+void GaussianNaiveBayes::Train(const FeatureStore &training) {
+	nbClasses = (int)training.Labels().size();
+	nbFeatures = training.NbFeatures();
+
+	vector<size_t> classSizes(nbClasses, 0);
+	means.assign((size_t)nbClasses * nbFeatures, 0.0);
+	variances.assign((size_t)nbClasses * nbFeatures, 0.0);
+	logNormalizers.assign((size_t)nbClasses * nbFeatures, 0.0);
+	logPriors.assign(nbClasses, 0.0);
+
+	size_t nbSamples = 0;
+	for (size_t i = 0; i < training.NbSamples(); i++) {
+		if (training.Extracted(i)) {
+			classSizes[training.LabelIndex(i)]++;
+			nbSamples++;
+		}
+	}
+
+	// Mean then variance of each feature, one column at a time
+	double largestVariance = 0.0;
+	for (int f = 0; f < nbFeatures; f++) {
+		const float *column = training.Column(f);
+		double sum = 0.0, sumSquares = 0.0;
+
+		for (size_t i = 0; i < training.NbSamples(); i++) {
+			if (training.Extracted(i)) {
+				means[(size_t)training.LabelIndex(i) * nbFeatures + f] += column[i];
+				sum += column[i];
+				sumSquares += (double)column[i] * column[i];
+			}
+		}
+		for (int c = 0; c < nbClasses; c++) {
+			if (classSizes[c] > 0) {
+				means[(size_t)c * nbFeatures + f] /= (double)classSizes[c];
+			}
+		}
+		for (size_t i = 0; i < training.NbSamples(); i++) {
+			if (training.Extracted(i)) {
+				size_t index = (size_t)training.LabelIndex(i) * nbFeatures + f;
+				double difference = column[i] - means[index];
+				variances[index] += difference * difference;
+			}
+		}
+
+		if (nbSamples > 0) {
+			double mean = sum / (double)nbSamples;
+			largestVariance = max(largestVariance, sumSquares / (double)nbSamples - mean * mean);
+		}
+	}
+
+	double smoothing = NaiveBayesSmoothing(largestVariance);
+
+	for (int c = 0; c < nbClasses; c++) {
+		logPriors[c] = classSizes[c] > 0 ? log((double)classSizes[c] / (double)nbSamples) : -HUGE_VAL;
+
+		for (int f = 0; f < nbFeatures; f++) {
+			size_t index = (size_t)c * nbFeatures + f;
+			variances[index] = (classSizes[c] > 0 ? variances[index] / (double)classSizes[c] : 0.0) + smoothing;
+			logNormalizers[index] = GaussianLogNormalizer(variances[index]);
+		}
+	}
+}
+
+int GaussianNaiveBayes::Predict(const float *fVector) const {
+	if (nbFeatures == 0) {
+		return MostLikelyClass(logPriors, NULL, NULL, NULL, 0, fVector);
+	}
+	return MostLikelyClass(logPriors, &means[0], &variances[0], &logNormalizers[0], nbFeatures, fVector);
+}
+
+ConfusionMatrix::ConfusionMatrix(const vector<string> &labels) : labels(labels), counts(labels.size(), vector<int>(labels.size(), 0)) {
+}
+
+int ConfusionMatrix::LabelIndex(const string &label) {
+	for (size_t i = 0; i < labels.size(); i++) {
+		if (labels[i] == label) {
+			return (int)i;
+		}
+	}
+
+	labels.push_back(label);
+	for (size_t i = 0; i < counts.size(); i++) {
+		counts[i].push_back(0);
+	}
+	counts.push_back(vector<int>(labels.size(), 0));
+	return (int)labels.size() - 1;
+}
+
+void ConfusionMatrix::Add(int actual, int predicted) {
+	if (predicted >= 0) {
+		counts[actual][predicted]++;
+	}
+	else {
+		// No prediction (empty training set): counted as an error of the first other class
+		counts[actual][actual == 0 && labels.size() > 1 ? 1 : 0]++;
+	}
+}
+
+int ConfusionMatrix::NbCorrect() const {
+	int nbCorrect = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		nbCorrect += counts[i][i];
+	}
+	return nbCorrect;
+}
+
+int ConfusionMatrix::NbTotal() const {
+	int nbTotal = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		for (size_t j = 0; j < counts[i].size(); j++) {
+			nbTotal += counts[i][j];
+		}
+	}
+	return nbTotal;
+}
+
+void ConfusionMatrix::Print(FILE *out, const char *title) const {
+	int nbCorrect = NbCorrect();
+	int nbTotal = NbTotal();
+
+	fprintf(out, "%s: %d / %d correct (%.2f %%)\n", title, nbCorrect, nbTotal, nbTotal > 0 ? 100.0 * nbCorrect / nbTotal : 0.0);
+
+	// Same layout as Weka's "=== Confusion Matrix ===": the classes are named a, b, c...
+	for (size_t j = 0; j < labels.size(); j++) {
+		fprintf(out, " %4c", (char)('a' + j % 26));
+	}
+	fprintf(out, "   <-- classified as\n");
+
+	for (size_t i = 0; i < labels.size(); i++) {
+		for (size_t j = 0; j < labels.size(); j++) {
+			fprintf(out, " %4d", counts[i][j]);
+		}
+		fprintf(out, " |  %c = %s\n", (char)('a' + i % 26), labels[i].c_str());
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef LABPRIMITIVE_LEARNING_H
+#define LABPRIMITIVE_LEARNING_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class FeatureStore;
+
+// Classifiers trained on the extracted samples of a FeatureStore. Predictions are
+// indices in the labels of the training store.
+
+// k nearest neighbours in Euclidean distance. As in Weka's IBk, each feature is first
+// scaled to [0, 1] with the minimum and maximum of the training set. The neighbours
+// vote; a tie goes to the tied class of the nearest neighbour, and equal distances
+// are broken by sample order, so the result does not depend on the kernel.
+class KnnClassifier {
+public:
+	explicit KnnClassifier(int k = 3);
+
+	void Train(const FeatureStore &training);
+	int Predict(const float *fVector) const;
+
+	int K() const { return k; }
+
+private:
+	int k;
+	int nbClasses;
+	size_t nbSamples;
+	std::vector<float> offsets;
+	std::vector<float> scales;
+	std::vector<std::vector<float> > columns;	// scaled training features
+	std::vector<const float *> columnPointers;
+	std::vector<int> classes;
+
+	// Scratch space of Predict
+	mutable std::vector<float> distances;
+	mutable std::vector<size_t> order;
+	mutable std::vector<int> votes;
+};
+
+// Gaussian naive Bayes: each feature follows a normal law per class. Like
+// scikit-learn, 1e-9 times the largest feature variance is added to every variance
+// so that a constant feature does not give an infinite likelihood.
+class GaussianNaiveBayes {
+public:
+	void Train(const FeatureStore &training);
+	int Predict(const float *fVector) const;
+
+private:
+	int nbClasses;
+	int nbFeatures;
+	std::vector<double> logPriors;
+	std::vector<double> means;			// [class * nbFeatures + feature]
+	std::vector<double> variances;
+	std::vector<double> logNormalizers;	// -log(sqrt(2 pi variance))
+};
+
+// Steps of the two classifiers, shared with CrossValidate (see cross_validation.h) so
+// that the leaderboard of evaluate scores exactly what classify predicts.
+
+// Puts the nbNeighbours samples nearest to a query at the start of order, closest first,
+// from the distances of nbSamples samples (order holds nbSamples indices). Equal
+// distances are broken by sample order.
+void RankNeighbours(const float *distances, size_t nbSamples, size_t nbNeighbours, std::vector<size_t> &order);
+
+// Class voted by the nbNeighbours samples of nearest, closest first, the class of
+// sample i being classes[i]: a tie goes to the tied class of the nearest neighbour.
+// votes is scratch space, holding one counter per class.
+int VoteNeighbours(const size_t *nearest, size_t nbNeighbours, const int *classes, std::vector<int> &votes);
+
+// Added to every per-class variance of a naive Bayes model whose largest feature
+// variance over the training set is largestVariance
+double NaiveBayesSmoothing(double largestVariance);
+
+// -log(sqrt(2 pi variance)), the constant part of a normal log-density
+double GaussianLogNormalizer(double variance);
+
+// Most likely class of the nbFeatures values of a sample, each feature following a
+// normal law per class: means, variances and logNormalizers are [class * nbFeatures +
+// feature]. Classes without training sample (log prior -HUGE_VAL) are skipped; returns
+// -1 when none is left.
+int MostLikelyClass(const std::vector<double> &logPriors, const double *means, const double *variances, const double *logNormalizers,
+	int nbFeatures, const float *values);
+
+// Counts of (actual, predicted) class pairs over a test set
+class ConfusionMatrix {
+public:
+	explicit ConfusionMatrix(const std::vector<std::string> &labels);
+
+	// Index of a label, added to the matrix if it is not known yet
+	int LabelIndex(const std::string &label);
+
+	void Add(int actual, int predicted);
+
+	int NbCorrect() const;
+	int NbTotal() const;
+
+	// Accuracy line, then the matrix in Weka's layout (rows: actual class)
+	void Print(FILE *out, const char *title) const;
+
+private:
+	std::vector<std::string> labels;
+	std::vector<std::vector<int> > counts;
+};
+
+#endif
@@ -1,401 +1,584 @@
 #include <cv.h> 			//OpenCV lib
 #include <highgui.h>		//OpenCV lib
 #include <string>
-
-#define NUM_SAMPLES 1000
-#define NUM_FEATURES 6
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "color_classifier.h"
+#include "color_features.h"
+#include "commands.h"
+#include "cross_validation.h"
+#include "dataset.h"
+#include "extraction.h"
+#include "feature_cache.h"
+#include "feature_store.h"
+#include "feature_writer.h"
+#include "histogram.h"
+#include "packed_dataset.h"
+#include "sampling.h"
+#include "trace.h"
 
 using namespace std;
 
-// Bart Train: 80 items: bart1.bmp - bart80.bmp
-// Homer Train 62 items: homer1.bmp - homer62.bmp
-// Bart Valid: 54 items: bart116.bmp - bart169.bmp
-// Homer Valid: 37 items: homer88.bmp - homer124.bmp
-
-void BuildFileName(int iNum, char *character, char *cFileName, bool training);
-
-float OrangeFeatureExtraction(int h, int w, unsigned char red, unsigned char blue, unsigned char green, float fOrange, const IplImage *processed);
-
-float WhiteFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fWhite);
-
-float BrownFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fBrown);
-
-float BlueFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fBlue);
-
-float GreenFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fGreen);
-
-float RedFeatureExtraction(int h, int w, unsigned char red, unsigned char blue, unsigned char green, float fRed, const IplImage *processed);
-
-void LoopOverAllPixels(const IplImage *img, const IplImage *processed, float &fOrange, float &fWhite, float &fBrown, float &fBlue, float &fGreen, float &fRed);
+void PrintUsage(const char *program);
 
-void
-ProcessImageBatch(int firstItemNb, int lastItemNb, char *character, FILE *fp, IplImage *&img, IplImage *&processed,
-	bool training);
-
-void InitCharArray(char *cFileName);
+// Appends the rows extracted by this run to the cache file, and says how much it saved
+static bool SaveCache(FeatureCache &cache) {
+	printf("feature cache: %d images reused, %d extracted\n", (int)cache.NbHits(), (int)cache.NbMisses());
+	return cache.Save();
+}
 
 int main(int argc, char** argv)
 {
 	bool training = false;
-	char *resultFileName;
+	// Headless by default: no window is opened and nothing waits on a key press.
+	// --inspect brings back the interactive viewer, one image at a time.
+	bool inspect = false;
+	int threads = 1;
+	bool forceLookup = false;
+	bool nativeBmp = true;
+	size_t streamAbove = STREAM_ABOVE_BYTES;
+	int readAhead = 0;
+	const char *rulesFileName = NULL;
+	const char *featureList = NULL;
+	// Approximate extraction: 0 = every pixel
+	int rowStep = 0;
+	double tolerance = 0.0;
+	bool components = false;
+	int histogramBins = 0;
+	const FeatureFormat *format = FindFeatureFormat("arff");
+	string resultFileName;
 	FILE *fp;
 
+	if (argc < 2) {
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
 	string arg = argv[1];
+	bool classify = arg == "classify";
+	bool serve = arg == "serve";
+	bool tune = arg == "tune";
+	bool pack = arg == "pack";
+	bool merge = arg == "merge";
+	bool evaluate = arg == "evaluate";
+	bool extract = !classify && !serve && !tune && !pack && !merge && !evaluate;
+	vector<string> shardFileNames;
+	ShardInfo shard = { 0, 0, 0, 0, false };
+	bool formatGiven = false;
+	const char *socketPath = NULL;
+	const char *trainFileName = NULL;
+	const char *validFileName = NULL;
+	int k = 3;
+
+	// evaluate: every k-NN of the list and naive Bayes, on 10 folds; the first 20 are printed
+	EvaluationGrid grid;
+	grid.nbFolds = DEFAULT_FOLDS;
+	grid.seed = 1;
+	grid.naiveBayes = true;
+	const int DEFAULT_NEIGHBOURS[] = { 1, 3, 5, 7, 9, 11, 15, 21 };
+	grid.neighbourCounts.assign(DEFAULT_NEIGHBOURS, DEFAULT_NEIGHBOURS + sizeof(DEFAULT_NEIGHBOURS) / sizeof(DEFAULT_NEIGHBOURS[0]));
+	int nbLeaderboardRows = 20;
+
 	if (arg == "train") {
 		training = true;
-		resultFileName = "apprentissage-homer-bart-lisa.arff";
+		resultFileName = "apprentissage-homer-bart-lisa";
 	}
 	else {
 		training = false;
-		resultFileName = "validation-homer-bart-lisa.arff";
+		resultFileName = "validation-homer-bart-lisa";
 	}
 
-	// Open a text file to store the feature vectors
-	fp = fopen(resultFileName, "w");
+	const char *outputFileName = NULL;
+	const char *traceFileName = NULL;
+	const char *cacheFileName = NULL;
+	const char *archiveFileName = NULL;
+	DatasetOptions dataset = DefaultDatasetOptions();
 
-	if (fp == NULL) {
-		perror(resultFileName);
-		return EXIT_FAILURE;
+	for (int i = 2; i < argc; i++) {
+		string option = argv[i];
+		if (option == "--headless") {
+			inspect = false;
+		}
+		else if (option == "--inspect") {
+			inspect = true;
+		}
+		else if (option == "--decoder" && i + 1 < argc) {
+			string decoder = argv[++i];
+			if (decoder != "native" && decoder != "opencv") {
+				fprintf(stderr, "Unknown decoder: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			nativeBmp = decoder == "native";
+		}
+		else if (option == "--stream-above" && i + 1 < argc) {
+			double megabytes = atof(argv[++i]);
+			if (megabytes < 0.0) {
+				fprintf(stderr, "Invalid size: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			streamAbove = (size_t)(megabytes * 1048576.0);
+		}
+		else if (option == "--read-ahead" && i + 1 < argc) {
+			readAhead = atoi(argv[++i]);
+			if (readAhead < 0) {
+				fprintf(stderr, "Invalid read-ahead depth: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (option == "--format" && i + 1 < argc) {
+			format = FindFeatureFormat(argv[++i]);
+			if (format == NULL) {
+				fprintf(stderr, "Unknown output format: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			formatGiven = true;
+		}
+		else if (option == "-o" && i + 1 < argc) {
+			outputFileName = argv[++i];
+		}
+		else if ((classify || evaluate) && option == "--train" && i + 1 < argc) {
+			trainFileName = argv[++i];
+		}
+		else if ((classify || evaluate) && option == "--valid" && i + 1 < argc) {
+			validFileName = argv[++i];
+		}
+		else if (evaluate && option == "--k" && i + 1 < argc) {
+			// Comma-separated list: 1,3,5
+			string list = argv[++i];
+			grid.neighbourCounts.clear();
+			for (size_t start = 0; start <= list.size(); ) {
+				size_t comma = list.find(',', start);
+				if (comma == string::npos) {
+					comma = list.size();
+				}
+				int neighbours = atoi(list.substr(start, comma - start).c_str());
+				if (neighbours <= 0) {
+					fprintf(stderr, "Invalid number of neighbours: %s\n", argv[i]);
+					return EXIT_FAILURE;
+				}
+				grid.neighbourCounts.push_back(neighbours);
+				start = comma + 1;
+			}
+		}
+		else if (evaluate && option == "--folds" && i + 1 < argc) {
+			grid.nbFolds = atoi(argv[++i]);
+			if (grid.nbFolds < 2) {
+				fprintf(stderr, "Invalid number of folds: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (evaluate && option == "--seed" && i + 1 < argc) {
+			grid.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		}
+		else if (evaluate && option == "--top" && i + 1 < argc) {
+			nbLeaderboardRows = atoi(argv[++i]);
+			if (nbLeaderboardRows <= 0) {
+				fprintf(stderr, "Invalid number of leaderboard rows: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (classify && option == "--k" && i + 1 < argc) {
+			k = atoi(argv[++i]);
+			if (k <= 0) {
+				fprintf(stderr, "Invalid number of neighbours: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (serve && option == "--socket" && i + 1 < argc) {
+			socketPath = argv[++i];
+		}
+		else if (extract && option == "--shard" && i + 1 < argc) {
+			// i/N, i from 0 to N - 1
+			char extra;
+			if (sscanf(argv[++i], "%u/%u%c", &shard.index, &shard.count, &extra) != 2 || shard.count == 0 || shard.index >= shard.count) {
+				fprintf(stderr, "Invalid shard (i/N, from 0/N to N-1/N): %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (merge && option[0] != '-') {
+			shardFileNames.push_back(option);
+		}
+		else if (option == "--components") {
+			components = true;
+		}
+		else if (option == "--histogram" && i + 1 < argc) {
+			histogramBins = atoi(argv[++i]);
+			if (!ValidHistogramBins(histogramBins)) {
+				fprintf(stderr, "Invalid number of histogram bins (2, 4, 8 or 16): %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (option == "--dataset" && i + 1 < argc) {
+			string directory = argv[++i];
+			dataset.trainDirectory = directory + "/Train";
+			dataset.validDirectory = directory + "/Valid";
+		}
+		else if (option == "--classes" && i + 1 < argc) {
+			// "all": every label found in the directory
+			string list = argv[++i];
+			dataset.classes.clear();
+			for (size_t start = 0; list != "all" && start <= list.size(); ) {
+				size_t comma = list.find(',', start);
+				if (comma == string::npos) {
+					comma = list.size();
+				}
+				if (comma > start) {
+					dataset.classes.push_back(list.substr(start, comma - start));
+				}
+				start = comma + 1;
+			}
+			if (list != "all" && dataset.classes.empty()) {
+				fprintf(stderr, "Invalid class list: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!pack && option == "--archive" && i + 1 < argc) {
+			archiveFileName = argv[++i];
+		}
+		else if (option == "--cache" && i + 1 < argc) {
+			cacheFileName = argv[++i];
+		}
+		else if (option == "--trace" && i + 1 < argc) {
+			traceFileName = argv[++i];
+		}
+		else if (option == "--rules" && i + 1 < argc) {
+			rulesFileName = argv[++i];
+		}
+		else if (option == "--features" && i + 1 < argc) {
+			featureList = argv[++i];
+		}
+		else if (option == "--kernel" && i + 1 < argc) {
+			// "lut" keeps the lookup tables even for the built-in colours
+			forceLookup = string(argv[++i]) == "lut";
+			if (!forceLookup && !SetColorKernel(argv[i])) {
+				fprintf(stderr, "Colour kernel not available on this CPU: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (option == "--threads" && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+			if (threads < 0) {
+				fprintf(stderr, "Invalid thread count: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (option == "--sample" && i + 1 < argc) {
+			rowStep = atoi(argv[++i]);
+			if (rowStep < 1) {
+				fprintf(stderr, "Invalid row step: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (option == "--tolerance" && i + 1 < argc) {
+			tolerance = atof(argv[++i]);
+			if (tolerance <= 0.0) {
+				fprintf(stderr, "Invalid tolerance: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else {
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
 	}
 
-	// Setup .arff header
-	fprintf(fp, "@relation Homer-Bart\n");
-	fprintf(fp, "\n");
-	fprintf(fp, "@attribute Orange real\n");
-	fprintf(fp, "@attribute White real\n");
-	fprintf(fp, "@attribute Brown real\n");
-	fprintf(fp, "@attribute Blue real\n");
-	fprintf(fp, "@attribute Green real\n");
-	fprintf(fp, "@attribute Red real\n");
-	fprintf(fp, "\n");
-	fprintf(fp, "@attribute classe {homer, bart, lisa}\n");
-	fprintf(fp, "@data");
-	fprintf(fp, "\n");
-
-	// OpenCV variables related to the image structure.
-	// IplImage structure contains several information of the image (See OpenCV manual).
-	IplImage *img = NULL;
-	IplImage *processed = NULL;
-	IplImage *threshold = NULL;
-
-	// OpenCV variable that stores the image width and height
-	CvSize tam;
-
-	// OpenCV variable that stores a pixel value
-	CvScalar element;
-
-	// *****************************************************************************************************************************************
-	// TRAINING SAMPLES 
-	// HOMER
-	// Homer Train 62 items: homer1.bmp - homer62.bmp
-	// Homer Valid 37 items: homer88.bmp - homer124.bmp
-	// *****************************************************************************************************************************************
-
-	if (training) {
-		ProcessImageBatch(1, 62, "homer", fp, img, processed, true);
+	if (components && (rowStep > 0 || tolerance > 0.0)) {
+		fprintf(stderr, "--components needs every pixel: it cannot be combined with --sample or --tolerance\n");
+		return EXIT_FAILURE;
 	}
-	else {
-		ProcessImageBatch(88, 124, "homer", fp, img, processed, false);
+	if ((histogramBins > 0 || tune) && (rowStep > 0 || tolerance > 0.0)) {
+		fprintf(stderr, "%s needs every pixel: it cannot be combined with --sample or --tolerance\n", tune ? "tune" : "--histogram");
+		return EXIT_FAILURE;
+	}
+	if (archiveFileName != NULL && (inspect || cacheFileName != NULL)) {
+		fprintf(stderr, "--archive holds decoded pixels only: it cannot be combined with --inspect or --cache\n");
+		return EXIT_FAILURE;
 	}
 
-	// *****************************************************************************************************************************************
-	// TRAINING SAMPLES
-	// BART
-	// Bart Train: 80 items: bart1.bmp - bart80.bmp
-	// Bart Valid: 80 items: bart116.bmp - bart169.bmp
-	// *****************************************************************************************************************************************
-
-	if (training) {
-		ProcessImageBatch(1, 80, "bart", fp, img, processed, true);
+	if (shard.count > 0 && formatGiven) {
+		fprintf(stderr, "--shard writes a shard file: the output format is chosen by merge\n");
+		return EXIT_FAILURE;
 	}
-	else {
-		ProcessImageBatch(116, 169, "bart", fp, img, processed, false);
+
+	if (merge) {
+		if (outputFileName == NULL) {
+			fprintf(stderr, "merge needs -o FILE\n");
+			return EXIT_FAILURE;
+		}
+		return RunMerge(outputFileName, *format, shardFileNames);
 	}
 
-	// *****************************************************************************************************************************************
-	// TRAINING SAMPLES
-	// LISA
-	// Lisa Train: 33 items: lisa1.bmp - lisa33.bmp
-	// Lisa Valid: 33 items: lisa34.bmp - lisa46.bmp
-	// *****************************************************************************************************************************************
+	// Pick the fastest kernel now, before any worker thread starts counting pixels
+	ColorKernelName();
 
-	if (training) {
-		ProcessImageBatch(1, 33, "lisa", fp, img, processed, true);
+	// The colour rules give both the pixel classification and the .arff attributes
+	vector<ColorRule> rules = BuiltinColorRules();
+	if (rulesFileName != NULL && !LoadColorRules(rulesFileName, rules)) {
+		return EXIT_FAILURE;
 	}
-	else {
-		ProcessImageBatch(34, 46, "lisa", fp, img, processed, false);
+	if (featureList != NULL && !SelectColorRules(featureList, rules)) {
+		return EXIT_FAILURE;
 	}
-
-	// *****************************************************************************************************************************************
-	// TRAINING SAMPLES
-	// OTHER
-	// Other Train: 121 items: other1.bmp - other121.bmp
-	// Other Valid: 121 items: other122.bmp - other170.bmp
-	// *****************************************************************************************************************************************
-
-	if (training) {
-		//ProcessImageBatch(1, 80, "other", fp, img, processed, true);
+	ColorClassifier classifier(rules, forceLookup);
+
+	ExtractionOptions options;
+	options.classifier = &classifier;
+	options.inspect = inspect;
+	options.threads = threads;
+	options.nativeBmp = nativeBmp;
+	options.streamAbove = streamAbove;
+	options.sampling = NULL;
+
+	// An adaptive estimate without a row step starts from one row in 64
+	SamplingOptions sampling;
+	sampling.rowStep = rowStep > 0 ? rowStep : 64;
+	sampling.tolerance = tolerance;
+	if (rowStep > 0 || tolerance > 0.0) {
+		options.sampling = &sampling;
 	}
-	else {
-		//ProcessImageBatch(122, 170, "other", fp, img, processed, false);
+	options.components = components;
+	options.histogramBins = histogramBins;
+	options.cache = NULL;
+	options.readAhead = readAhead;
+	options.archive = NULL;
+
+	// Serve reads the images of its requests: the archive is for the dataset
+	PackedDataset archive;
+	if (archiveFileName != NULL && !serve) {
+		if (!archive.Open(archiveFileName)) {
+			return EXIT_FAILURE;
+		}
+		options.archive = &archive;
+		dataset.archive = &archive;
 	}
 
-	cvReleaseImage(&img);
-	cvDestroyWindow("Original");
-
-	cvReleaseImage(&processed);
-	cvDestroyWindow("Processed");
-
-	fclose(fp);
+	vector<string> featureNames = ImageFeatureNames(options);
 
-	return 0;
-}
-
-void InitCharArray(char *cFileName) {
-	// Fill cFileName with zeros
-	for (int i = 0; i < 50; i++)
-	{
-		cFileName[i] = '\0';
+	// Serve answers requests, not the dataset, tune extracts histograms of its own and
+	// pack extracts nothing: they do not use the cache
+	FeatureCache cache(FeatureConfigHash(options), (int)featureNames.size());
+	if (cacheFileName != NULL && !serve && !tune && !pack) {
+		if (!cache.Open(cacheFileName)) {
+			return EXIT_FAILURE;
+		}
+		options.cache = &cache;
 	}
-}
-
-void
-ProcessImageBatch(int firstItemNb, int lastItemNb, char *character, FILE *fp, IplImage *&img, IplImage *&processed, bool training) {
-
-	CvSize tam;
-	IplImage *threshold;
-
-	// Feature variables
-	float fOrange;
-	float fWhite;
-	float fBrown;
-	float fBlue;
-	float fGreen;
-	float fRed;
 
-	// In fact it is a "matrix of features"
-	float fVector[NUM_SAMPLES][NUM_FEATURES];
+	EnableTracing(traceFileName != NULL);
 
-	// Fill fVector with zeros
-	for (int ii = 0; ii < NUM_SAMPLES; ii++)
-	{
-		for (int jj = 0; jj < NUM_FEATURES; jj++)
-		{
-			fVector[ii][jj] = 0.0;
+	if (classify) {
+		int status = RunClassify(trainFileName, validFileName, k, featureNames, dataset, options);
+		if (options.cache != NULL && !SaveCache(cache)) {
+			return EXIT_FAILURE;
 		}
+		return status;
 	}
 
-	// Variable filename
-	static char cFileName[50] = { '\0' };
-	InitCharArray(cFileName);
-
-	// Take all the image files at the range
-	for (int iNum = firstItemNb; iNum <= lastItemNb; iNum++) {
-		BuildFileName(iNum, character, cFileName, training);
-
-		// Load the image from disk to the structure img.
-		// 1  - Load a 3-channel image (color)
-		// 0  - Load a 1-channel image (gray level)
-		// -1 - Load the image as it is  (depends on the file)
-		img = cvLoadImage(cFileName, -1);
-
-		// Gets the image size (width, height) 'img'
-		tam = cvGetSize(img);
-
-		// Creates a header and allocates memory (tam) to store a copy of the original image.
-		// 1 - gray level image
-		// 3 - color image
-		// processed = cvCreateImage( tam, IPL_DEPTH_8U, 3);
-
-
-		// Make a image clone and store it at processed and threshold
-		processed = cvCloneImage(img);
-		threshold = cvCloneImage(img);
-
-		// Initialize variables with zero
-		fOrange = 0.0;
-		fWhite = 0.0;
-		fBrown = 0.0;
-		fBlue = 0.0;
-		fGreen = 0.0;
-		fRed = 0.0;
-
-		LoopOverAllPixels(img, processed, fOrange, fWhite, fBrown, fBlue, fGreen, fRed);
-
-		// Lets make our counting somewhat independent on the image size...
-		// Compute the percentage of pixels of a given colour.
-		// Normalize the feature by the image size
-		fOrange = fOrange / ((int)img->height * (int)img->width);
-		fWhite = fWhite / ((int)img->height * (int)img->width);
-		fBrown = fBrown / ((int)img->height * (int)img->width);
-		fBlue = fBlue / ((int)img->height * (int)img->width);
-		fGreen = fGreen / ((int)img->height * (int)img->width);
-		fRed = fRed / ((int)img->height * (int)img->width);
-
-
-		// Store the feature value in the columns of the feature (matrix) vector
-		fVector[iNum][0] = fOrange;
-		fVector[iNum][1] = fWhite;
-		fVector[iNum][2] = fBrown;
-		fVector[iNum][3] = fBlue;
-		fVector[iNum][4] = fGreen;
-		fVector[iNum][5] = fRed;
-
-
-		// Here you can add more features to your feature vector by filling the other columns: fVector[iNum][3] = ???; fVector[iNum][4] = ???;
-
-		// Shows the feature vector at the screen
-		//printf(" : #%d %f %f\n\n", iNum, fVector[iNum][1], fVector[iNum][2]);
-		printf("%d %f %f %f %f %f\n", iNum, fVector[iNum][0], fVector[iNum][1], fVector[iNum][2], fVector[iNum][3], fVector[iNum][4], fVector[iNum][5]);
-
-		// And finally, store your features in a file
-		fprintf(fp, "%f,", fVector[iNum][0]);
-		fprintf(fp, "%f,", fVector[iNum][1]);
-		fprintf(fp, "%f,", fVector[iNum][2]);
-		fprintf(fp, "%f,", fVector[iNum][3]);
-		fprintf(fp, "%f,", fVector[iNum][4]);
-		fprintf(fp, "%f,", fVector[iNum][5]);
-
-		// IMPORTANT
-		// Do not forget the label....
-		fprintf(fp, "%s\n", character);
-
-
-		// Finally, give a look at the original image and the image with the pixels of interest in green
-		// OpenCV create an output window
-		cvShowImage("Original", img);
-		cvShowImage("Processed", processed);
-
-		// Wait until a key is pressed to continue...
-		cvWaitKey(0);
+	if (evaluate) {
+		grid.threads = threads;
+		int status = RunEvaluate(trainFileName, validFileName, featureNames, dataset, options, grid, nbLeaderboardRows, outputFileName);
+		if (options.cache != NULL && !SaveCache(cache)) {
+			return EXIT_FAILURE;
+		}
+		return status;
 	}
-}
 
-void LoopOverAllPixels(const IplImage *img, const IplImage *processed, float &fOrange, float &fWhite, float &fBrown, float &fBlue, float &fGreen, float &fRed) {
-
-	int h;
-	int w;
-
-	// Variables to store the RGB values of a pixel
-	unsigned char red;
-	unsigned char blue;
-	unsigned char green;
-
-	// Loop that reads each image pixel
-	for (h = 0; h < img->height; h++) // rows
-	{
-		for (w = 0; w < img->width; w++) // columns
-		{
-			// Read each channel and writes it into the blue, green and red variables. Notice that OpenCV considers BGR
-			blue = ((uchar *)(img->imageData + h * img->widthStep))[w * img->nChannels + 0];
-			green = ((uchar *)(img->imageData + h * img->widthStep))[w * img->nChannels + 1];
-			red = ((uchar *)(img->imageData + h * img->widthStep))[w * img->nChannels + 2];
+	if (tune) {
+		options.inspect = false;
+		return RunTune(outputFileName != NULL ? outputFileName : "tuned-rules.txt", dataset, options);
+	}
 
-			// Shows the pixel value at the screenl
-			//printf( "pixel[%d][%d]= %d %d %d \n", h, w, (int)blue, (int)green, (int)red );
+	if (pack) {
+		return RunPack(outputFileName != NULL ? outputFileName : "homer-bart-lisa.lpk", dataset, options);
+	}
 
-			// Here starts the feature extraction....
-			fOrange = OrangeFeatureExtraction(h, w, red, blue, green, fOrange, processed);
-			fWhite = WhiteFeatureExtraction(red, blue, green, fWhite);
-			fBrown = BrownFeatureExtraction(red, blue, green, fBrown);
-			fBlue = BlueFeatureExtraction(red, blue, green, fBlue);
-			fGreen = GreenFeatureExtraction(red, blue, green, fGreen);
-			fRed = RedFeatureExtraction(h, w, red, blue, green, fRed, processed);
+	if (serve) {
+		if (socketPath == NULL) {
+			fprintf(stderr, "serve needs --socket PATH\n");
+			return EXIT_FAILURE;
+		}
 
-			// Here you can add your own features....... Good luck
+		// The viewer needs a key press per image: never in the daemon
+		options.inspect = false;
+		int status = RunServe(socketPath, options);
 
+		if (traceFileName != NULL) {
+			PrintTraceSummary(stdout);
+			if (!WriteChromeTrace(traceFileName)) {
+				return EXIT_FAILURE;
+			}
 		}
+		return status;
 	}
-}
 
-float WhiteFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fWhite) {
-
-	// Detect and count the number of white pixels (just a dummy feature...)
-	// Verify if the pixels have a given value ( White, defined as R[253-255], G[253-255], B[253-255] ). If so, count it...
-	if (blue >= 253 && green >= 253 && red >= 253)
-	{
-		fWhite++;
+	// Open the file to store the feature vectors now, so that a bad path fails before
+	// the extraction rather than after it
+	if (outputFileName != NULL) {
+		resultFileName = outputFileName;
 	}
+	else if (shard.count > 0) {
+		char suffix[48];
+		sprintf(suffix, ".%u-of-%u.shard", shard.index, shard.count);
+		resultFileName += suffix;
+	}
+	else {
+		resultFileName += format->extension;
+	}
+	fp = fopen(resultFileName.c_str(), "wb");
 
-	return fWhite;
-}
-
-float BrownFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fBrown) {
-
-	if (blue >= 102 && blue <= 112 && green >= 168 && green <= 178 && red >= 180 && red <= 210)
-	{
-		fBrown++;
+	if (fp == NULL) {
+		perror(resultFileName.c_str());
+		return EXIT_FAILURE;
 	}
 
-	return fBrown;
-}
+	// Every image of the run, in the order its row goes into the .arff file
+	FeatureStore store(featureNames);
 
-float BlueFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fBlue) {
+	if (!AddDatasetImages(store, training, dataset)) {
+		fclose(fp);
+		return EXIT_FAILURE;
+	}
 
-	if (blue >= 100 && green <= 130 && red <= 25)
-	{
-		fBlue++;
+	// A shard extracts its part of the list, and keeps where each sample goes in it
+	vector<uint64_t> shardPositions;
+	if (shard.count > 0) {
+		FeatureStore all = store;
+		SelectShard(all, training, shard, store, shardPositions);
 	}
 
-	return fBlue;
-}
+	// Throughput report: number of images processed and total wall time
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
 
-float GreenFeatureExtraction(unsigned char red, unsigned char blue, unsigned char green, float fGreen) {
+	int nbFailed = 0;
+	int nbImages = ProcessImageBatch(store, options, nbFailed);
 
-	if (blue >= 14 && blue <= 34 && green >= 130 && green <= 150 && red <= 90 && red >= 70)
+	// Shows the feature vectors at the screen
 	{
-		fGreen++;
+		TraceScope trace(STAGE_WRITE);
+		PrintFeatureRows(store, stdout);
 	}
 
-	return fGreen;
-}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	printf("%d images in %.3f s (%.1f images/s)\n", nbImages, elapsed, elapsed > 0.0 ? nbImages / elapsed : 0.0);
+	printf("peak resident memory %.1f MB, image buffers %.1f MB in %d buffers\n", PeakResidentBytes() / 1048576.0,
+		BufferPool::Shared().PeakBytesAllocated() / 1048576.0, (int)BufferPool::Shared().NbBuffers());
+	bool cacheSaved = options.cache == NULL || SaveCache(cache);
+
+	// How far the estimated features may be from the exact ones
+	if (store.HasStandardErrors()) {
+		printf("standard error     mean        max\n");
+		for (int f = 0; f < store.NbFeatures(); f++) {
+			double sum = 0.0;
+			double largest = 0.0;
+			for (size_t i = 0; i < store.NbSamples(); i++) {
+				if (store.Extracted(i)) {
+					double error = store.StandardError(i, f);
+					sum += error;
+					largest = error > largest ? error : largest;
+				}
+			}
+			printf("%-12s %10.6f %10.6f\n", store.FeatureName(f).c_str(), store.NbExtracted() > 0 ? sum / store.NbExtracted() : 0.0, largest);
+		}
+	}
 
-float RedFeatureExtraction(int h, int w, unsigned char red, unsigned char blue, unsigned char green, float fRed, const IplImage *processed) {
+	if (inspect) {
+		cvDestroyWindow("Original");
+		cvDestroyWindow("Processed");
+	}
 
-	if (blue <= 50 && green <= 50 && red >= 190)
+	bool written;
 	{
-		fRed++;
-		((uchar *)(processed->imageData + h*processed->widthStep))[w*processed->nChannels + 0] = 0;
-		((uchar *)(processed->imageData + h*processed->widthStep))[w*processed->nChannels + 1] = 255;
-		((uchar *)(processed->imageData + h*processed->widthStep))[w*processed->nChannels + 2] = 0;
+		TraceScope trace(STAGE_WRITE);
+		written = shard.count > 0 ? WriteShardFeatures(store, shard, shardPositions, fp, resultFileName.c_str())
+			: format->write(store, fp, resultFileName.c_str());
+		if (fclose(fp) != 0 && written) {
+			perror(resultFileName.c_str());
+			written = false;
+		}
 	}
+	TraceCount(COUNTER_ROWS_WRITTEN, store.NbExtracted());
 
-	return fRed;
-}
-
-float OrangeFeatureExtraction(int h, int w, unsigned char red, unsigned char blue, unsigned char green, float fOrange, const IplImage *processed) {
-
-	// Detect and count the number of orange pixels
-	// Verify if the pixels have a given value ( Orange, defined as R[240-255], G[85-105], B[11-22] ). If so, count it...
-	if (blue >= 11 && blue <= 22 && green >= 85 && green <= 105 && red >= 240 && red <= 255)
-	{
-		fOrange++;
+	// Where the time went, image by image
+	if (traceFileName != NULL) {
+		PrintTraceSummary(stdout);
+		if (!WriteChromeTrace(traceFileName)) {
+			return EXIT_FAILURE;
+		}
+	}
 
-		// Just to be sure we are doing the right thing, we change the color of the orange pixels to green [R=0, G=255, B=0] and show them into a cloned image (processed)
+	if (!written || !cacheSaved) {
+		return EXIT_FAILURE;
+	}
 
+	if (nbFailed > 0) {
+		fprintf(stderr, "%d images could not be loaded\n", nbFailed);
+		return EXIT_FAILURE;
 	}
 
-	return fOrange;
+	return 0;
 }
 
-void BuildFileName(int iNum, char *character, char *cFileName, bool training = true) {
-#ifdef __linux__ 
-	char* trainPathPattern = "../Train/%s%d.bmp";
-	char* validPathPattern = "../Valid/%s%d.bmp";
-#elif _WIN32
-	char* trainPathPattern = "Train/%s%d.bmp";
-	char* validPathPattern = "Valid/%s%d.bmp";
-#else
-	char* trainPathPattern = "Train/%s%d.bmp";
-	char* validPathPattern = "Valid/%s%d.bmp";
-#endif
-	// Build the image filename and path to read from disk
-	if (training) {
-		sprintf(cFileName, trainPathPattern, character, iNum);
-	}
-	else {
-		sprintf(cFileName, validPathPattern, character, iNum);
-	}
-
-	printf("%s", cFileName);
+void PrintUsage(const char *program) {
+	fprintf(stderr, "Usage: %s <train|valid|classify|evaluate|serve|tune|pack|merge> [--headless | --inspect] [--threads N] [--kernel NAME] [--rules FILE] [--features LIST]\n", program);
+	fprintf(stderr, "       [--decoder native|opencv] [--stream-above MB] [--read-ahead N] [--format arff|npy|raw] [-o FILE] [--trace FILE]\n");
+	fprintf(stderr, "       [--sample N] [--tolerance E] [--components] [--histogram N] [--cache FILE]\n");
+	fprintf(stderr, "       [--dataset DIR] [--classes LIST] [--archive FILE] [--shard I/N]\n");
+	fprintf(stderr, "  --headless   never open a window (default)\n");
+	fprintf(stderr, "  --inspect    show each image and its processed copy, wait for a key\n");
+	fprintf(stderr, "  --threads N  extract with N worker threads, 0 = one per core (default 1)\n");
+	fprintf(stderr, "  --kernel K   colour kernel: auto, scalar, sse42, avx2 or lut (default auto)\n");
+	fprintf(stderr, "  --rules FILE read the colour features from FILE instead of the built-in six\n");
+	fprintf(stderr, "  --features L only extract the comma-separated features of L, e.g. orange,red\n");
+	fprintf(stderr, "  --decoder D  native: read uncompressed .bmp in place, OpenCV for the rest (default)\n");
+	fprintf(stderr, "               opencv: decode every image with cvLoadImage\n");
+	fprintf(stderr, "  --stream-above MB  read the .bmp files over MB megabytes a strip of rows at a time\n");
+	fprintf(stderr, "               with a fixed buffer (default 16, 0 = every file)\n");
+	fprintf(stderr, "  --read-ahead N  read up to N files ahead of the workers on reader threads, so that\n");
+	fprintf(stderr, "               the reads overlap the classification (default 0: no read-ahead; native\n");
+	fprintf(stderr, "               decoder only)\n");
+	fprintf(stderr, "  --format F   arff (default), npy (float32 matrix + FILE.labels.txt) or raw (columnar)\n");
+	fprintf(stderr, "  --sample N   estimate the features from one row in N, with their standard errors\n");
+	fprintf(stderr, "  --tolerance E  add rows until the standard error of every feature is at most E\n");
+	fprintf(stderr, "               (starting from --sample, or one row in 64)\n");
+	fprintf(stderr, "  --components add the blob count, and the area, centroid and bounding box of the\n");
+	fprintf(stderr, "               largest blob of each colour after the pixel ratios\n");
+	fprintf(stderr, "  --histogram N  add the BGR histogram of each image, N = 2, 4, 8 or 16 bins per\n");
+	fprintf(stderr, "               channel (N^3 features), after the other features\n");
+	fprintf(stderr, "  --dataset DIR  read the images of DIR/Train and DIR/Valid (default Train and Valid\n");
+	fprintf(stderr, "               next to the program; see dataset.h for the manifest.txt they may have)\n");
+	fprintf(stderr, "  --classes L  comma-separated classes to keep, in .arff order (default homer,bart,lisa),\n");
+	fprintf(stderr, "               or all: every label found, e.g. other and school\n");
+	fprintf(stderr, "  --archive FILE  take the images and their decoded pixels from FILE, written by pack,\n");
+	fprintf(stderr, "               instead of opening the image files\n");
+	fprintf(stderr, "  --cache FILE reuse the features of the images extracted by earlier runs with the same\n");
+	fprintf(stderr, "               rules, found by the contents of their file; add the new ones to FILE\n");
+	fprintf(stderr, "  --trace FILE time each stage of each image, write a Chrome trace (chrome://tracing)\n");
+	fprintf(stderr, "               to FILE and print a latency summary\n");
+	fprintf(stderr, "  --shard I/N  train and valid: extract every Nth image of the list from image I (0 to N-1)\n");
+	fprintf(stderr, "               into a shard file (default <output>.I-of-N.shard), for merge\n");
+	fprintf(stderr, "  -o FILE      output file (default apprentissage- or validation-homer-bart-lisa.<format>)\n");
+	fprintf(stderr, "classify: score a k-NN and a naive Bayes classifier on the validation set\n");
+	fprintf(stderr, "  --train FILE training features (.arff or raw) instead of extracting the training images\n");
+	fprintf(stderr, "  --valid FILE validation features instead of extracting the validation images\n");
+	fprintf(stderr, "  --k N        number of neighbours of the k-NN (default 3)\n");
+	fprintf(stderr, "evaluate: rank classifiers and feature subsets by stratified cross-validation on the\n");
+	fprintf(stderr, "      training and validation sets together (--train and --valid as for classify)\n");
+	fprintf(stderr, "  --k LIST     neighbours of the k-NN candidates (default 1,3,5,7,9,11,15,21)\n");
+	fprintf(stderr, "  --folds N    number of folds (default 10)\n");
+	fprintf(stderr, "  --seed N     seed of the shuffle before the folds are dealt (default 1)\n");
+	fprintf(stderr, "  --top N      rows of the leaderboard to print (default 20; -o keeps them all)\n");
+	fprintf(stderr, "  -o FILE      also write the whole leaderboard to FILE as CSV\n");
+	fprintf(stderr, "serve: extract the images of the requests sent to a Unix socket (see serve_protocol.h)\n");
+	fprintf(stderr, "  --socket PATH  socket to listen on; --threads sets the number of extraction workers\n");
+	fprintf(stderr, "tune: search the BGR box that best separates each class of the training set from the\n");
+	fprintf(stderr, "      others, and write them as colour rules to -o FILE (default tuned-rules.txt)\n");
+	fprintf(stderr, "  --histogram N  box granularity: N bins per channel (default 16)\n");
+	fprintf(stderr, "pack: decode the training and validation images of --dataset and --classes into one\n");
+	fprintf(stderr, "      archive, -o FILE (default homer-bart-lisa.lpk), for --archive\n");
+	fprintf(stderr, "merge -o FILE [--format F] SHARD...: put the shard files of a run back together, in the\n");
+	fprintf(stderr, "      order of the unsharded run, checking that no image is missing or there twice\n");
 }
@@ -0,0 +1,158 @@
+#include "commands.h"
+#include "feature_store.h"
+#include "feature_writer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// Whether two shards come from the same run: same list of images, same split, same
+// features and classes
+static bool SameRun(const ShardInfo &a, const FeatureStore &storeA, const ShardInfo &b, const FeatureStore &storeB) {
+	if (a.count != b.count || a.nbSamples != b.nbSamples || a.listHash != b.listHash || a.training != b.training) {
+		return false;
+	}
+	if (storeA.NbFeatures() != storeB.NbFeatures() || storeA.Labels() != storeB.Labels()) {
+		return false;
+	}
+	for (int f = 0; f < storeA.NbFeatures(); f++) {
+		if (storeA.FeatureName(f) != storeB.FeatureName(f)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int RunMerge(const char *outputFileName, const FeatureFormat &format, const vector<string> &shardFileNames) {
+	if (shardFileNames.empty()) {
+		fprintf(stderr, "merge needs the shard files to merge\n");
+		return EXIT_FAILURE;
+	}
+
+	vector<ShardInfo> shards(shardFileNames.size());
+	vector<FeatureStore> stores(shardFileNames.size());
+	vector<vector<uint64_t> > positions(shardFileNames.size());
+	for (size_t s = 0; s < shardFileNames.size(); s++) {
+		if (!ReadShardFeatures(shardFileNames[s].c_str(), shards[s], positions[s], stores[s])) {
+			return EXIT_FAILURE;
+		}
+		if (!SameRun(shards[0], stores[0], shards[s], stores[s])) {
+			fprintf(stderr, "%s: not a shard of the same run as %s\n", shardFileNames[s].c_str(), shardFileNames[0].c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Every shard of the split, once
+	const ShardInfo &run = shards[0];
+	vector<int> shardFiles(run.count, -1);
+	bool ok = true;
+	for (size_t s = 0; s < shards.size(); s++) {
+		if (shards[s].index >= run.count) {
+			fprintf(stderr, "%s: shard %u of %u\n", shardFileNames[s].c_str(), shards[s].index, run.count);
+			ok = false;
+		}
+		else if (shardFiles[shards[s].index] >= 0) {
+			fprintf(stderr, "%s: shard %u/%u is also %s\n", shardFileNames[s].c_str(), shards[s].index, run.count,
+				shardFileNames[shardFiles[shards[s].index]].c_str());
+			ok = false;
+		}
+		else {
+			shardFiles[shards[s].index] = (int)s;
+		}
+	}
+	for (uint32_t i = 0; i < run.count; i++) {
+		if (shardFiles[i] < 0) {
+			fprintf(stderr, "shard %u/%u is missing\n", i, run.count);
+			ok = false;
+		}
+	}
+	if (!ok) {
+		return EXIT_FAILURE;
+	}
+
+	// Every sample of the full list, once: owners[p] is the shard file and the sample
+	// of position p
+	vector<pair<int, size_t> > owners((size_t)run.nbSamples, make_pair(-1, (size_t)0));
+	for (size_t s = 0; s < shards.size(); s++) {
+		for (size_t i = 0; i < positions[s].size(); i++) {
+			uint64_t position = positions[s][i];
+			if (position >= run.nbSamples) {
+				fprintf(stderr, "%s: sample %s at position %llu of %llu\n", shardFileNames[s].c_str(), stores[s].Path(i).c_str(),
+					(unsigned long long)position, (unsigned long long)run.nbSamples);
+				ok = false;
+			}
+			else if (owners[position].first >= 0) {
+				fprintf(stderr, "%s: sample %s is also in %s\n", shardFileNames[s].c_str(), stores[s].Path(i).c_str(),
+					shardFileNames[owners[position].first].c_str());
+				ok = false;
+			}
+			else {
+				owners[position] = make_pair((int)s, i);
+			}
+		}
+	}
+	int nbMissing = 0;
+	for (size_t p = 0; p < owners.size(); p++) {
+		if (owners[p].first < 0) {
+			nbMissing++;
+		}
+	}
+	if (nbMissing > 0) {
+		fprintf(stderr, "%d samples of the %llu of the run are in no shard\n", nbMissing, (unsigned long long)run.nbSamples);
+		ok = false;
+	}
+	if (!ok) {
+		return EXIT_FAILURE;
+	}
+
+	// The samples in the order of the full list: the rows of an unsharded run
+	vector<string> featureNames;
+	for (int f = 0; f < stores[0].NbFeatures(); f++) {
+		featureNames.push_back(stores[0].FeatureName(f));
+	}
+	FeatureStore merged(featureNames);
+	for (size_t l = 0; l < stores[0].Labels().size(); l++) {
+		merged.AddLabel(stores[0].Labels()[l]);
+	}
+	merged.Reserve(owners.size());
+
+	vector<float> fVector(featureNames.size());
+	int nbFailed = 0;
+	for (size_t p = 0; p < owners.size(); p++) {
+		const FeatureStore &store = stores[owners[p].first];
+		size_t i = owners[p].second;
+		size_t sample = merged.AddSample(store.Path(i), store.Label(i), store.Number(i));
+		if (!store.Extracted(i)) {
+			nbFailed++;
+			continue;
+		}
+		for (int f = 0; f < merged.NbFeatures(); f++) {
+			fVector[f] = store.Value(i, f);
+		}
+		merged.SetFeatures(sample, fVector.empty() ? NULL : &fVector[0]);
+	}
+
+	FILE *fp = fopen(outputFileName, "wb");
+	if (fp == NULL) {
+		perror(outputFileName);
+		return EXIT_FAILURE;
+	}
+	bool written = format.write(merged, fp, outputFileName);
+	if (fclose(fp) != 0 && written) {
+		perror(outputFileName);
+		written = false;
+	}
+	if (!written) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%u shards merged into %s: %d samples\n", run.count, outputFileName, (int)merged.NbExtracted());
+
+	// As the unsharded run would
+	if (nbFailed > 0) {
+		fprintf(stderr, "%d images could not be loaded\n", nbFailed);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#include "bmp_reader.h"
+#include "commands.h"
+#include "dataset.h"
+#include "extraction.h"
+#include "feature_store.h"
+#include "packed_dataset.h"
+#include "sampling.h"
+
+#include <highgui.h>		//OpenCV lib
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// Decodes an image file as the extraction would (uncompressed BMP in place, or
+// OpenCV) and appends its pixels as image i of the archive. loaded is false when the
+// file cannot be decoded; returns false on a write error.
+static bool PackImageFile(PackWriter &writer, size_t i, const char *fileName, bool nativeBmp, bool &loaded) {
+	loaded = true;
+
+	if (nativeBmp) {
+		MappedFile file;
+		BmpImage bmp;
+		if (file.Open(fileName) && ParseBmp(file.Data(), file.Size(), bmp)) {
+			PixelView image = { bmp.pixels, bmp.width, bmp.height, bmp.widthStep, bmp.bitsPerPixel / 8, bmp.palette, bmp.paletteSize };
+			return writer.Add(i, image);
+		}
+	}
+
+	IplImage *img = cvLoadImage(fileName, -1);
+	if (img == NULL) {
+		loaded = false;
+		return true;
+	}
+
+	PixelView image = { (const unsigned char *)img->imageData, img->width, img->height, img->widthStep, img->nChannels, NULL, 0 };
+	bool written = writer.Add(i, image);
+	cvReleaseImage(&img);
+	return written;
+}
+
+int RunPack(const char *outputFileName, const DatasetOptions &dataset, const ExtractionOptions &options) {
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	// The training images, then the validation images: the order of their runs
+	FeatureStore training, validation;
+	if (!AddDatasetImages(training, true, dataset) || !AddDatasetImages(validation, false, dataset)) {
+		return EXIT_FAILURE;
+	}
+
+	vector<PackedImage> images;
+	const FeatureStore *stores[2] = { &training, &validation };
+	for (int s = 0; s < 2; s++) {
+		for (size_t i = 0; i < stores[s]->NbSamples(); i++) {
+			PackedImage image;
+			image.path = stores[s]->Path(i);
+			image.label = stores[s]->Label(i);
+			image.number = stores[s]->Number(i);
+			image.training = s == 0;
+			image.width = 0;
+			image.height = 0;
+			image.pixels = NULL;
+			images.push_back(image);
+		}
+	}
+
+	PackWriter writer;
+	if (!writer.Open(outputFileName, images)) {
+		return EXIT_FAILURE;
+	}
+
+	// Images that cannot be loaded stay in the index, so that the runs on the archive
+	// report them as the runs on the files would
+	int nbFailed = 0;
+	for (size_t i = 0; i < images.size(); i++) {
+		bool loaded;
+		if (!PackImageFile(writer, i, images[i].path.c_str(), options.nativeBmp, loaded)) {
+			return EXIT_FAILURE;
+		}
+		if (!loaded) {
+			fprintf(stderr, "%s: could not load image\n", images[i].path.c_str());
+			nbFailed++;
+		}
+	}
+	if (!writer.Finish()) {
+		return EXIT_FAILURE;
+	}
+
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	printf("%d training and %d validation images packed into %s (%.1f MB) in %.3f s\n", (int)training.NbSamples(),
+		(int)validation.NbSamples(), outputFileName, writer.Size() / 1048576.0, elapsed);
+
+	if (nbFailed > 0) {
+		fprintf(stderr, "%d images could not be loaded\n", nbFailed);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
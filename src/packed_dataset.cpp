@@ -0,0 +1,230 @@
+#include "packed_dataset.h"
+#include "sampling.h"
+
+#include <cstring>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+// Start of an archive, followed by a version number
+static const char PACK_MAGIC[4] = { 'L', 'P', 'A', 'K' };
+#define PACK_VERSION 1
+
+struct PackHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t nbImages;
+	uint32_t stringBytes;	// after the entries
+	uint64_t dataOffset;	// first pixel of the first image, from the start of the file
+	uint64_t fileSize;		// of the whole archive, to detect a truncated copy
+};
+
+struct PackEntry {
+	uint64_t offset;		// of the pixels from the start of the file, 0 if not loaded
+	uint32_t width;
+	uint32_t height;
+	uint32_t pathOffset;	// in the strings, NUL-terminated
+	uint32_t labelOffset;
+	int32_t number;
+	uint8_t training;
+	uint8_t padding[3];
+};
+
+static_assert(sizeof(PackHeader) == 32, "PackHeader is written as is");
+static_assert(sizeof(PackEntry) == 32, "PackEntry is written as is");
+
+static uint64_t AlignOffset(uint64_t offset) {
+	return (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+
+bool PackedDataset::Open(const char *fileName) {
+	images.clear();
+	imagesByPath.clear();
+
+	if (!file.Open(fileName)) {
+		perror(fileName);
+		return false;
+	}
+
+	PackHeader header;
+	if (file.Size() < sizeof(header)) {
+		fprintf(stderr, "%s: not a dataset archive\n", fileName);
+		return false;
+	}
+	memcpy(&header, file.Data(), sizeof(header));
+	if (memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 || header.version != PACK_VERSION) {
+		fprintf(stderr, "%s: not a dataset archive (or from another version)\n", fileName);
+		return false;
+	}
+
+	uint64_t indexBytes = sizeof(header) + (uint64_t)header.nbImages * sizeof(PackEntry) + header.stringBytes;
+	if (header.fileSize != file.Size() || indexBytes > header.dataOffset || header.dataOffset > file.Size()
+		|| (header.stringBytes > 0 && file.Data()[indexBytes - 1] != '\0')) {
+		fprintf(stderr, "%s: truncated or damaged dataset archive\n", fileName);
+		return false;
+	}
+
+	const unsigned char *entries = file.Data() + sizeof(header);
+	const char *strings = (const char *)(entries + (size_t)header.nbImages * sizeof(PackEntry));
+	images.resize(header.nbImages);
+	for (size_t i = 0; i < images.size(); i++) {
+		PackEntry entry;
+		memcpy(&entry, entries + i * sizeof(PackEntry), sizeof(entry));
+
+		uint64_t pixelBytes = (uint64_t)entry.width * entry.height * 3;
+		if (entry.pathOffset >= header.stringBytes || entry.labelOffset >= header.stringBytes
+			|| (entry.offset != 0 && (entry.offset < header.dataOffset || entry.offset > file.Size() || file.Size() - entry.offset < pixelBytes))) {
+			fprintf(stderr, "%s: damaged entry %d\n", fileName, (int)i);
+			images.clear();
+			return false;
+		}
+
+		PackedImage &image = images[i];
+		image.path = strings + entry.pathOffset;
+		image.label = strings + entry.labelOffset;
+		image.number = entry.number;
+		image.training = entry.training != 0;
+		image.width = (int)entry.width;
+		image.height = (int)entry.height;
+		image.pixels = entry.offset != 0 ? file.Data() + entry.offset : NULL;
+		imagesByPath[image.path] = i;
+	}
+
+#if defined(__linux__) || defined(__APPLE__)
+	// The images are extracted in the order they were packed
+	if (file.Size() > header.dataOffset) {
+		madvise((void *)file.Data(), file.Size(), MADV_SEQUENTIAL);
+	}
+#endif
+	return true;
+}
+
+const PackedImage *PackedDataset::Find(const string &path) const {
+	unordered_map<string, size_t>::const_iterator image = imagesByPath.find(path);
+	return image != imagesByPath.end() ? &images[image->second] : NULL;
+}
+
+PackWriter::PackWriter() : fp(NULL), size(0) {
+}
+
+PackWriter::~PackWriter() {
+	if (fp != NULL) {
+		fclose(fp);
+	}
+}
+
+bool PackWriter::Open(const char *outputFileName, const vector<PackedImage> &images) {
+	fileName = outputFileName;
+
+	// Strings first: their size gives the offset of the pixels
+	vector<PackEntry> entries(images.size());
+	string strings;
+	for (size_t i = 0; i < images.size(); i++) {
+		PackEntry &entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+		entry.pathOffset = (uint32_t)strings.size();
+		strings.append(images[i].path.c_str(), images[i].path.size() + 1);
+		entry.labelOffset = (uint32_t)strings.size();
+		strings.append(images[i].label.c_str(), images[i].label.size() + 1);
+		entry.number = images[i].number;
+		entry.training = images[i].training ? 1 : 0;
+	}
+
+	PackHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+	header.version = PACK_VERSION;
+	header.nbImages = (uint32_t)images.size();
+	header.stringBytes = (uint32_t)strings.size();
+	header.dataOffset = AlignOffset(sizeof(header) + entries.size() * sizeof(PackEntry) + strings.size());
+
+	index.assign(header.dataOffset, 0);
+	memcpy(&index[0], &header, sizeof(header));
+	if (!entries.empty()) {
+		memcpy(&index[sizeof(header)], &entries[0], entries.size() * sizeof(PackEntry));
+	}
+	memcpy(&index[sizeof(header) + entries.size() * sizeof(PackEntry)], strings.data(), strings.size());
+
+	// The index is written again by Finish, with the offsets of the pixels
+	fp = fopen(outputFileName, "wb");
+	if (fp == NULL || fwrite(&index[0], 1, index.size(), fp) != index.size()) {
+		perror(outputFileName);
+		return false;
+	}
+	size = index.size();
+	return true;
+}
+
+bool PackWriter::Add(size_t i, const PixelView &image) {
+	// Padding up to the alignment of the pixels
+	static const unsigned char ZEROS[PACK_ALIGNMENT] = { 0 };
+	size_t padding = (size_t)(AlignOffset(size) - size);
+	if (padding > 0 && fwrite(ZEROS, 1, padding, fp) != padding) {
+		perror(fileName.c_str());
+		return false;
+	}
+	size += padding;
+
+	PackEntry entry;
+	unsigned char *indexEntry = &index[sizeof(PackHeader) + i * sizeof(PackEntry)];
+	memcpy(&entry, indexEntry, sizeof(entry));
+	entry.offset = size;
+	entry.width = (uint32_t)image.width;
+	entry.height = (uint32_t)image.height;
+	memcpy(indexEntry, &entry, sizeof(entry));
+
+	// Palette, grey and 4-channel images become BGR rows, which have the same features
+	static const unsigned char BLACK[4] = { 0, 0, 0, 0 };
+	row.resize((size_t)image.width * 3);
+	for (int h = 0; h < image.height; h++) {
+		const unsigned char *pixels = image.pixels + (ptrdiff_t)h * image.widthStep;
+		unsigned char *out = &row[0];
+		if (image.nChannels == 3) {
+			memcpy(out, pixels, row.size());
+		}
+		else if (image.palette != NULL) {
+			for (int w = 0; w < image.width; w++) {
+				const unsigned char *color = pixels[w] < image.paletteSize ? image.palette + 4 * pixels[w] : BLACK;
+				out[3 * w] = color[0];
+				out[3 * w + 1] = color[1];
+				out[3 * w + 2] = color[2];
+			}
+		}
+		else {
+			for (int w = 0; w < image.width; w++) {
+				const unsigned char *pixel = pixels + w * image.nChannels;
+				out[3 * w] = pixel[0];
+				out[3 * w + 1] = pixel[image.nChannels >= 3 ? 1 : 0];
+				out[3 * w + 2] = pixel[image.nChannels >= 3 ? 2 : 0];
+			}
+		}
+		if (fwrite(out, 1, row.size(), fp) != row.size()) {
+			perror(fileName.c_str());
+			return false;
+		}
+	}
+	size += (uint64_t)row.size() * image.height;
+	return true;
+}
+
+bool PackWriter::Finish() {
+	PackHeader header;
+	memcpy(&header, &index[0], sizeof(header));
+	header.fileSize = size;
+	memcpy(&index[0], &header, sizeof(header));
+
+	// The index is at the start: no 64-bit seek is needed for large archives
+	bool written = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&index[0], 1, index.size(), fp) == index.size();
+	if (fclose(fp) != 0) {
+		written = false;
+	}
+	fp = NULL;
+	if (!written) {
+		perror(fileName.c_str());
+		return false;
+	}
+	return true;
+}
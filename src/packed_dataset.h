@@ -0,0 +1,81 @@
+#ifndef LABPRIMITIVE_PACKED_DATASET_H
+#define LABPRIMITIVE_PACKED_DATASET_H
+
+#include "bmp_reader.h"
+
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct PixelView;
+
+// Pixels of each image start on a multiple of this offset in the archive
+#define PACK_ALIGNMENT 64
+
+// One image of a dataset archive
+struct PackedImage {
+	std::string path;		// of the image file it was packed from
+	std::string label;
+	int number;
+	bool training;			// training set, or validation set
+	int width;
+	int height;
+	const unsigned char *pixels;	// width * 3 bytes per row (B, G, R), top row first; NULL if it could not be loaded
+};
+
+// Archive of the images of a dataset, decoded once (see RunPack): a header, an index
+// of every image (label, dimensions, offset of its pixels), the strings of the index,
+// then the pixels of each image, aligned and tightly packed. The archive is mapped
+// whole: extracting an image opens no file and parses nothing, and the images of a
+// run are read in the order they are stored. The fields are in the byte order of the
+// machine that wrote the archive.
+class PackedDataset {
+public:
+	// Maps an archive; returns false (with a message on stderr) if it cannot be read
+	bool Open(const char *fileName);
+
+	size_t NbImages() const { return images.size(); }
+	const PackedImage &Image(size_t i) const { return images[i]; }
+
+	// Image packed from the file path, NULL if there is none
+	const PackedImage *Find(const std::string &path) const;
+
+private:
+	MappedFile file;
+	std::vector<PackedImage> images;
+	std::unordered_map<std::string, size_t> imagesByPath;
+};
+
+// Writes an archive, one image after the other
+class PackWriter {
+public:
+	PackWriter();
+	~PackWriter();
+
+	// Creates fileName for these images (their pixels are ignored); returns false on error
+	bool Open(const char *fileName, const std::vector<PackedImage> &images);
+
+	// Appends the pixels of image i of the list, in list order; images not added are
+	// stored as not loaded. Returns false on error.
+	bool Add(size_t i, const PixelView &image);
+
+	// Writes the index; returns false on error
+	bool Finish();
+
+	// Bytes written so far
+	uint64_t Size() const { return size; }
+
+private:
+	PackWriter(const PackWriter &);
+	PackWriter &operator=(const PackWriter &);
+
+	FILE *fp;
+	std::string fileName;
+	std::vector<unsigned char> index;		// header, entries and strings
+	uint64_t size;
+	std::vector<unsigned char> row;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "read_ahead.h"
+#include "bmp_reader.h"
+#include "trace.h"
+
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Asks the OS to start reading a whole file into its cache
+static void AdviseWillNeed(const string &path) {
+#if defined(__linux__)
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+#else
+	(void)path;
+#endif
+}
+
+ReadAhead::ReadAhead(const vector<string> &paths, int depth, size_t maxBytes, int nbReaders)
+	: paths(paths), depth((size_t)depth), maxBytes(maxBytes), nextRead(0), window(0), stopping(false),
+	states(paths.size(), SLOT_PENDING), buffers(paths.size()), sizes(paths.size(), 0) {
+
+	for (int t = 0; t < nbReaders; t++) {
+		readers.push_back(thread(&ReadAhead::Reader, this));
+	}
+}
+
+ReadAhead::~ReadAhead() {
+	{
+		lock_guard<mutex> lock(readMutex);
+		stopping = true;
+	}
+	readCondition.notify_all();
+
+	for (size_t t = 0; t < readers.size(); t++) {
+		readers[t].join();
+	}
+}
+
+void ReadAhead::Reader() {
+	for (;;) {
+		size_t position;
+		{
+			unique_lock<mutex> lock(readMutex);
+			while (!stopping && nextRead < paths.size() && nextRead >= window + depth) {
+				readCondition.wait(lock);
+			}
+			if (stopping || nextRead >= paths.size()) {
+				return;
+			}
+			position = nextRead++;
+		}
+
+		const string &path = paths[position];
+		unique_ptr<PooledBuffer> buffer;
+		size_t size = 0;
+		bool read = false;
+		{
+			TraceScope trace(STAGE_READ, (int64_t)position);
+
+			struct stat info;
+			bool known = stat(path.c_str(), &info) == 0;
+			if (known && (uint64_t)info.st_size > maxBytes) {
+				AdviseWillNeed(path);
+			}
+			else if (known) {
+				// One byte more than the file: ReadWholeFile then sees the end at once
+				buffer.reset(new PooledBuffer());
+				buffer->Reserve((size_t)info.st_size + 1);
+				read = ReadWholeFile(path.c_str(), *buffer, size);
+			}
+		}
+
+		{
+			lock_guard<mutex> lock(readMutex);
+			if (read) {
+				buffers[position] = move(buffer);
+				sizes[position] = size;
+			}
+			states[position] = read ? SLOT_READ : SLOT_SKIPPED;
+		}
+		takeCondition.notify_all();
+	}
+}
+
+bool ReadAhead::Take(size_t position, PooledBuffer &buffer, size_t &size) {
+	TraceScope trace(STAGE_WAIT, (int64_t)position);
+	unique_lock<mutex> lock(readMutex);
+
+	// Readers may now go depth files past this one
+	if (position + 1 > window) {
+		window = position + 1;
+		readCondition.notify_all();
+	}
+
+	while (states[position] == SLOT_PENDING) {
+		takeCondition.wait(lock);
+	}
+
+	bool read = states[position] == SLOT_READ;
+	if (read) {
+		buffer.Swap(*buffers[position]);
+		size = sizes[position];
+		buffers[position].reset();
+	}
+	states[position] = SLOT_TAKEN;
+	return read;
+}
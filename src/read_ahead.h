@@ -0,0 +1,59 @@
+#ifndef LABPRIMITIVE_READ_AHEAD_H
+#define LABPRIMITIVE_READ_AHEAD_H
+
+#include "buffer_pool.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Most reader threads of a ReadAhead
+#define READ_AHEAD_READERS 4
+
+// Reads a list of files ahead of the workers that process them, so that the disk (or
+// the network) is busy while the pixels of the files already read are classified.
+// Reader threads read the files in list order into buffers of the pool, never more
+// than depth files past the last one taken: a slow consumer holds depth buffers at
+// most. Files over maxBytes are not read but announced to the OS (posix_fadvise), as
+// they are streamed by the workers anyway.
+class ReadAhead {
+public:
+	ReadAhead(const std::vector<std::string> &paths, int depth, size_t maxBytes, int nbReaders);
+	~ReadAhead();
+
+	// Waits for the file at position in the list, and moves its contents to buffer.
+	// Returns false if it was not read (too large, or an error): the worker then opens
+	// it itself. Each position is taken once.
+	bool Take(size_t position, PooledBuffer &buffer, size_t &size);
+
+private:
+	ReadAhead(const ReadAhead &);
+	ReadAhead &operator=(const ReadAhead &);
+
+	enum SlotState { SLOT_PENDING, SLOT_READ, SLOT_SKIPPED, SLOT_TAKEN };
+
+	void Reader();
+
+	std::vector<std::string> paths;
+	size_t depth;
+	size_t maxBytes;
+
+	std::mutex readMutex;
+	std::condition_variable readCondition;		// a reader may go on
+	std::condition_variable takeCondition;		// a file was read
+	size_t nextRead;
+	size_t window;		// past the last position taken
+	bool stopping;
+
+	std::vector<char> states;
+	std::vector<std::unique_ptr<PooledBuffer> > buffers;
+	std::vector<size_t> sizes;
+
+	std::vector<std::thread> readers;
+};
+
+#endif
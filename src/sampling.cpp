@@ -0,0 +1,115 @@
+#include "sampling.h"
+#include "color_classifier.h"
+
+#include <cmath>
+#include <cstddef>
+
+using namespace std;
+
+// An adaptive estimate never stops on fewer rows: the variance of the row counts
+// needs a few of them to mean anything
+#define MIN_SAMPLED_ROWS 8
+
+// Counts the pixels of each rule in one row
+static void CountRow(const ColorClassifier &classifier, const PixelView &image, const uint64_t *paletteMasks, int row, uint64_t *counts) {
+	const unsigned char *pixels = image.pixels + (ptrdiff_t)row * image.widthStep;
+
+	if (paletteMasks == NULL) {
+		classifier.Count(pixels, image.width, 1, image.widthStep, image.nChannels, counts);
+		return;
+	}
+
+	for (int i = 0; i < classifier.NbFeatures(); i++) {
+		counts[i] = 0;
+	}
+	for (int w = 0; w < image.width; w++) {
+		for (uint64_t mask = paletteMasks[pixels[w]]; mask != 0; mask &= mask - 1) {
+			counts[LowestBit(mask)]++;
+		}
+	}
+}
+
+int EstimateFeatures(const ColorClassifier &classifier, const PixelView &image, const SamplingOptions &options, float *fVector, float *standardErrors) {
+
+	int nbFeatures = classifier.NbFeatures();
+	bool adaptive = options.tolerance > 0.0;
+
+	// Adaptive sampling halves the step level by level, so it starts at a power of two
+	int step = options.rowStep > 1 ? options.rowStep : 1;
+	if (adaptive) {
+		int power = 1;
+		while (power < step) {
+			power *= 2;
+		}
+		step = power;
+	}
+
+	// Each palette colour is classified once
+	uint64_t paletteMasks[256];
+	if (image.palette != NULL) {
+		for (int index = 0; index < 256; index++) {
+			const unsigned char *color = index < image.paletteSize ? image.palette + 4 * index : NULL;
+			paletteMasks[index] = color != NULL ? classifier.Classify(color[0], color[1], color[2]) : classifier.Classify(0, 0, 0);
+		}
+	}
+
+	uint64_t sums[MAX_COLOR_RULES] = { 0 };
+	double sumSquares[MAX_COLOR_RULES] = { 0 };
+	double errors[MAX_COLOR_RULES];
+	int nbRows = 0;
+
+	// Level 0 takes the rows 0, step, 2 step...; level l adds the rows halfway between
+	// those of the levels before, so after it the sample holds every (step >> l)th row.
+	int first = 0;
+	int stride = step;
+
+	for (;;) {
+		for (int row = first; row < image.height; row += stride) {
+			uint64_t counts[MAX_COLOR_RULES];
+			CountRow(classifier, image, image.palette != NULL ? paletteMasks : NULL, row, counts);
+
+			for (int i = 0; i < nbFeatures; i++) {
+				sums[i] += counts[i];
+				sumSquares[i] += (double)counts[i] * counts[i];
+			}
+			nbRows++;
+		}
+
+		// Standard error of a ratio estimated from n rows of width pixels, out of height rows
+		double largestError = 0.0;
+		for (int i = 0; i < nbFeatures; i++) {
+			if (nbRows >= image.height) {
+				errors[i] = 0.0;
+			}
+			else if (nbRows < 2) {
+				errors[i] = HUGE_VAL;
+			}
+			else {
+				double mean = (double)sums[i] / nbRows;
+				double variance = (sumSquares[i] - nbRows * mean * mean) / (nbRows - 1);
+				double correction = 1.0 - (double)nbRows / image.height;
+				errors[i] = sqrt(variance > 0.0 ? correction * variance / nbRows : 0.0) / image.width;
+			}
+			largestError = errors[i] > largestError ? errors[i] : largestError;
+		}
+
+		int spacing = first == 0 ? stride : first;
+		if (!adaptive || spacing <= 1 || nbRows >= image.height || (nbRows >= MIN_SAMPLED_ROWS && largestError <= options.tolerance)) {
+			break;
+		}
+
+		// Next level: the rows halfway between the sampled ones
+		stride = spacing;
+		first = spacing / 2;
+	}
+
+	NormalizeFeatures(sums, nbFeatures, image.width, nbRows, fVector);
+
+	if (standardErrors != NULL) {
+		for (int i = 0; i < nbFeatures; i++) {
+			standardErrors[i] = (float)errors[i];
+		}
+	}
+
+	return nbRows;
+}
@@ -0,0 +1,36 @@
+#ifndef LABPRIMITIVE_SAMPLING_H
+#define LABPRIMITIVE_SAMPLING_H
+
+class ColorClassifier;
+
+// Pixels of an image in memory: BGR(X) when palette is NULL (nChannels 3 or 4, or 1 for
+// gray levels), palette indices otherwise (paletteSize entries of B, G, R, reserved)
+struct PixelView {
+	const unsigned char *pixels;	// first row
+	int width;
+	int height;
+	int widthStep;
+	int nChannels;
+	const unsigned char *palette;
+	int paletteSize;
+};
+
+// Estimation of the features from a subset of the rows. A row is a cluster of pixels:
+// the rows are counted whole with the colour kernels, and the spread of the per-row
+// counts gives the standard error of each ratio (cluster sampling with the finite
+// population correction).
+struct SamplingOptions {
+	// One row in rowStep is classified, at rows 0, rowStep, 2 rowStep... (1 = every pixel)
+	int rowStep;
+
+	// When above 0, the sample starts at rowStep and the rows in between are added level
+	// by level, doubling the sample each time, until the standard error of every feature
+	// is at most tolerance (or every row is counted)
+	double tolerance;
+};
+
+// Estimates the features of an image, and their standard errors when standardErrors
+// is not NULL. Returns the number of rows classified.
+int EstimateFeatures(const ColorClassifier &classifier, const PixelView &image, const SamplingOptions &options, float *fVector, float *standardErrors);
+
+#endif
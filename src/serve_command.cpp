@@ -0,0 +1,578 @@
+#include "commands.h"
+#include "color_classifier.h"
+#include "components.h"
+#include "extraction.h"
+#include "sampling.h"
+#include "serve_protocol.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+int RunServe(const char *socketPath, const ExtractionOptions &options) {
+	fprintf(stderr, "serve: Unix domain sockets are not available on this platform\n");
+	return EXIT_FAILURE;
+}
+
+#else
+
+// Request latency buckets: bucket i holds the latencies in [2^(i-1), 2^i) microseconds
+#define SERVE_LATENCY_BUCKETS 32
+
+// One image of a request; its bytes are in the body of the request
+struct ServeItem {
+	size_t offset;
+	size_t size;
+	int width;		// SERVE_PIXELS only
+	int height;
+	int channels;
+};
+
+// A request handed to the workers, who take its items one at a time
+struct ServeJob {
+	int type;
+	const unsigned char *body;
+	const ServeItem *items;
+	size_t nbItems;
+	int nbFeatures;
+	unsigned char *loaded;
+	float *features;
+
+	size_t nextItem;		// under the queue mutex of the pool
+	size_t nbDone;			// under doneMutex
+	mutex doneMutex;
+	condition_variable doneCondition;
+};
+
+// Worker threads kept from one request to the next. Requests of all the connections
+// share them, in arrival order.
+class ExtractionPool {
+public:
+	ExtractionPool(const ExtractionOptions &options, int nbThreads);
+	~ExtractionPool();
+
+	// Extracts every item of job, then returns
+	void Run(ServeJob &job);
+
+	// Items waiting for a worker
+	size_t QueueDepth();
+	int NbThreads() const { return (int)workers.size(); }
+
+private:
+	ExtractionPool(const ExtractionPool &);
+	ExtractionPool &operator=(const ExtractionPool &);
+
+	void Work();
+	bool ExtractItem(const ServeJob &job, size_t i);
+
+	const ExtractionOptions &options;
+	mutex queueMutex;
+	condition_variable queueCondition;
+	deque<ServeJob *> jobs;
+	size_t queuedItems;
+	bool stopping;
+	vector<thread> workers;
+};
+
+ExtractionPool::ExtractionPool(const ExtractionOptions &options, int nbThreads) : options(options), queuedItems(0), stopping(false) {
+	for (int t = 0; t < nbThreads; t++) {
+		workers.push_back(thread(&ExtractionPool::Work, this));
+	}
+}
+
+ExtractionPool::~ExtractionPool() {
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+}
+
+void ExtractionPool::Run(ServeJob &job) {
+	if (job.nbItems == 0) {
+		return;
+	}
+
+	job.nextItem = 0;
+	job.nbDone = 0;
+	{
+		lock_guard<mutex> lock(queueMutex);
+		jobs.push_back(&job);
+		queuedItems += job.nbItems;
+	}
+	queueCondition.notify_all();
+
+	unique_lock<mutex> lock(job.doneMutex);
+	while (job.nbDone < job.nbItems) {
+		job.doneCondition.wait(lock);
+	}
+}
+
+size_t ExtractionPool::QueueDepth() {
+	lock_guard<mutex> lock(queueMutex);
+	return queuedItems;
+}
+
+void ExtractionPool::Work() {
+	for (;;) {
+		ServeJob *job;
+		size_t i;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			while (!stopping && jobs.empty()) {
+				queueCondition.wait(lock);
+			}
+			if (stopping) {
+				return;
+			}
+
+			job = jobs.front();
+			i = job->nextItem++;
+			if (job->nextItem == job->nbItems) {
+				jobs.pop_front();
+			}
+			queuedItems--;
+		}
+
+		job->loaded[i] = ExtractItem(*job, i) ? 1 : 0;
+
+		lock_guard<mutex> lock(job->doneMutex);
+		if (++job->nbDone == job->nbItems) {
+			job->doneCondition.notify_all();
+		}
+	}
+}
+
+bool ExtractionPool::ExtractItem(const ServeJob &job, size_t i) {
+	TraceScope trace(STAGE_IMAGE, (int64_t)i);
+	const ServeItem &item = job.items[i];
+	const unsigned char *data = job.body + item.offset;
+	float *fVector = job.features + i * job.nbFeatures;
+
+	switch (job.type) {
+	case SERVE_PATHS:
+		// The body keeps a zero after each item
+		return ExtractFile(options, (const char *)data, fVector, NULL);
+
+	case SERVE_BMP:
+		return ExtractBmpData(options, data, item.size, fVector, NULL);
+
+	default: {
+		PixelView image = { data, item.width, item.height, item.width * item.channels, item.channels, NULL, 0 };
+		TraceCount(COUNTER_BYTES_READ, item.size);
+
+		if (options.sampling != NULL) {
+			TraceScope extract(STAGE_EXTRACT);
+			int nbRows = EstimateFeatures(*options.classifier, image, *options.sampling, fVector, NULL);
+			TraceCount(COUNTER_PIXELS, (uint64_t)item.width * nbRows);
+			return true;
+		}
+
+		ExtractPixels(options, image, fVector);
+		return true;
+	}
+	}
+}
+
+// Totals over every connection
+struct ServeStats {
+	mutex statsMutex;
+	uint64_t nbRequests;
+	uint64_t nbImages;
+	uint64_t nbFailed;
+	uint64_t totalLatency;		// nanoseconds
+	uint64_t maxLatency;
+	uint64_t latencies[SERVE_LATENCY_BUCKETS];
+	size_t maxQueueDepth;
+};
+
+static bool ReadFully(int fd, void *buffer, size_t size) {
+	unsigned char *bytes = (unsigned char *)buffer;
+
+	while (size > 0) {
+		ssize_t nbRead = read(fd, bytes, size);
+		if (nbRead < 0 && errno == EINTR) {
+			continue;
+		}
+		if (nbRead <= 0) {
+			return false;
+		}
+		bytes += nbRead;
+		size -= (size_t)nbRead;
+	}
+	return true;
+}
+
+static bool WriteFully(int fd, const void *buffer, size_t size) {
+	const unsigned char *bytes = (const unsigned char *)buffer;
+
+	while (size > 0) {
+		ssize_t nbWritten = write(fd, bytes, size);
+		if (nbWritten < 0 && errno == EINTR) {
+			continue;
+		}
+		if (nbWritten <= 0) {
+			return false;
+		}
+		bytes += nbWritten;
+		size -= (size_t)nbWritten;
+	}
+	return true;
+}
+
+static uint32_t LoadU32(const unsigned char *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void StoreU32(unsigned char *p, uint32_t value) {
+	p[0] = (unsigned char)value;
+	p[1] = (unsigned char)(value >> 8);
+	p[2] = (unsigned char)(value >> 16);
+	p[3] = (unsigned char)(value >> 24);
+}
+
+static bool WriteResponseHeader(int fd, uint32_t status, uint32_t count, uint32_t nbFeatures) {
+	unsigned char header[16];
+	StoreU32(header, SERVE_RESPONSE_MAGIC);
+	StoreU32(header + 4, status);
+	StoreU32(header + 8, count);
+	StoreU32(header + 12, nbFeatures);
+	return WriteFully(fd, header, sizeof(header));
+}
+
+// Reads the count items of a request into body (each followed by a zero) and items.
+// Returns false if the connection fails or the request breaks the limits.
+static bool ReadItems(int fd, int type, uint32_t count, vector<unsigned char> &body, vector<ServeItem> &items) {
+	body.clear();
+	items.clear();
+
+	for (uint32_t c = 0; c < count; c++) {
+		ServeItem item;
+		uint64_t size;
+		unsigned char fields[12];
+
+		item.width = item.height = item.channels = 0;
+
+		if (type == SERVE_PIXELS) {
+			if (!ReadFully(fd, fields, 12)) {
+				return false;
+			}
+			item.width = (int)LoadU32(fields);
+			item.height = (int)LoadU32(fields + 4);
+			item.channels = (int)LoadU32(fields + 8);
+			if (item.width <= 0 || item.height <= 0 || (item.channels != 1 && item.channels != 3 && item.channels != 4)) {
+				return false;
+			}
+			size = (uint64_t)item.width * item.height * item.channels;
+		}
+		else {
+			if (!ReadFully(fd, fields, 4)) {
+				return false;
+			}
+			size = LoadU32(fields);
+			if (type == SERVE_PATHS && (size == 0 || size > SERVE_MAX_PATH)) {
+				return false;
+			}
+		}
+
+		if (size > SERVE_MAX_REQUEST_BYTES - body.size()) {
+			return false;
+		}
+
+		item.offset = body.size();
+		item.size = (size_t)size;
+		body.resize(body.size() + item.size + 1);
+		if (!ReadFully(fd, &body[item.offset], item.size)) {
+			return false;
+		}
+		body[item.offset + item.size] = 0;
+
+		items.push_back(item);
+	}
+
+	return true;
+}
+
+// Upper bound, in microseconds, of the bucket holding the quantile q of the latencies
+static uint64_t LatencyQuantile(const uint64_t *latencies, uint64_t nbRequests, double q) {
+	uint64_t seen = 0;
+	for (int b = 0; b < SERVE_LATENCY_BUCKETS; b++) {
+		seen += latencies[b];
+		if (seen > 0 && seen >= (uint64_t)(q * nbRequests + 0.5)) {
+			return 1ull << b;
+		}
+	}
+	return 0;
+}
+
+static string StatsJson(ServeStats &stats, ExtractionPool &pool) {
+	size_t queueDepth = pool.QueueDepth();
+	lock_guard<mutex> lock(stats.statsMutex);
+
+	char text[1024];
+	snprintf(text, sizeof(text),
+		"{\"requests\": %llu, \"images\": %llu, \"failed\": %llu, \"workers\": %d, \"queue_depth\": %llu, \"max_queue_depth\": %llu, "
+		"\"latency_us\": {\"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %.1f}}",
+		(unsigned long long)stats.nbRequests, (unsigned long long)stats.nbImages, (unsigned long long)stats.nbFailed,
+		pool.NbThreads(), (unsigned long long)queueDepth, (unsigned long long)stats.maxQueueDepth,
+		stats.nbRequests > 0 ? stats.totalLatency / 1e3 / stats.nbRequests : 0.0,
+		(unsigned long long)LatencyQuantile(stats.latencies, stats.nbRequests, 0.5),
+		(unsigned long long)LatencyQuantile(stats.latencies, stats.nbRequests, 0.9),
+		(unsigned long long)LatencyQuantile(stats.latencies, stats.nbRequests, 0.99),
+		stats.maxLatency / 1e3);
+	return text;
+}
+
+// Answers the requests of one client until it disconnects. The buffers of a request
+// are kept for the next one.
+static void ServeConnection(int fd, ExtractionPool &pool, int nbFeatures, ServeStats &stats) {
+	vector<unsigned char> body;
+	vector<ServeItem> items;
+	vector<unsigned char> loaded;
+	vector<float> features;
+
+	for (;;) {
+		unsigned char header[12];
+		if (!ReadFully(fd, header, sizeof(header))) {
+			return;
+		}
+		chrono::steady_clock::time_point arrival = chrono::steady_clock::now();
+
+		uint32_t magic = LoadU32(header);
+		int type = (int)LoadU32(header + 4);
+		uint32_t count = LoadU32(header + 8);
+
+		if (magic != SERVE_REQUEST_MAGIC || type < SERVE_PATHS || type > SERVE_STATS || count > SERVE_MAX_ITEMS
+			|| (type == SERVE_STATS && count != 0)) {
+			WriteResponseHeader(fd, SERVE_BAD_REQUEST, 0, 0);
+			return;
+		}
+
+		if (type == SERVE_STATS) {
+			string json = StatsJson(stats, pool);
+			if (!WriteResponseHeader(fd, SERVE_OK, (uint32_t)json.size(), 0) || !WriteFully(fd, json.data(), json.size())) {
+				return;
+			}
+			continue;
+		}
+
+		if (!ReadItems(fd, type, count, body, items)) {
+			WriteResponseHeader(fd, SERVE_BAD_REQUEST, 0, 0);
+			return;
+		}
+
+		loaded.assign(count, 0);
+		features.assign((size_t)count * nbFeatures, NAN);
+
+		ServeJob job;
+		job.type = type;
+		job.body = body.data();
+		job.items = items.data();
+		job.nbItems = count;
+		job.nbFeatures = nbFeatures;
+		job.loaded = loaded.data();
+		job.features = features.data();
+
+		{
+			lock_guard<mutex> lock(stats.statsMutex);
+			size_t queueDepth = pool.QueueDepth() + count;
+			stats.maxQueueDepth = queueDepth > stats.maxQueueDepth ? queueDepth : stats.maxQueueDepth;
+		}
+
+		pool.Run(job);
+
+		// The features are sent as they are in memory: the daemon runs on little-endian CPUs
+		if (!WriteResponseHeader(fd, SERVE_OK, count, (uint32_t)nbFeatures) || !WriteFully(fd, loaded.data(), loaded.size())
+			|| !WriteFully(fd, features.data(), features.size() * sizeof(float))) {
+			return;
+		}
+
+		uint64_t latency = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - arrival).count();
+		uint64_t nbFailed = 0;
+		for (size_t i = 0; i < loaded.size(); i++) {
+			nbFailed += loaded[i] == 0 ? 1 : 0;
+		}
+
+		int bucket = 0;
+		for (uint64_t micros = latency / 1000; micros != 0 && bucket < SERVE_LATENCY_BUCKETS - 1; micros >>= 1) {
+			bucket++;
+		}
+
+		lock_guard<mutex> lock(stats.statsMutex);
+		stats.nbRequests++;
+		stats.nbImages += count;
+		stats.nbFailed += nbFailed;
+		stats.totalLatency += latency;
+		stats.maxLatency = latency > stats.maxLatency ? latency : stats.maxLatency;
+		stats.latencies[bucket]++;
+	}
+}
+
+// SIGINT and SIGTERM wake up the accept loop through this pipe
+static int stopPipe[2] = { -1, -1 };
+
+static void RequestStop(int) {
+	char byte = 0;
+	ssize_t nbWritten = write(stopPipe[1], &byte, 1);
+	(void)nbWritten;
+}
+
+int RunServe(const char *socketPath, const ExtractionOptions &options) {
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", socketPath);
+		return EXIT_FAILURE;
+	}
+	strcpy(address.sun_path, socketPath);
+
+	// A socket left by a daemon that did not stop cleanly is replaced; any other file is not
+	struct stat info;
+	if (lstat(socketPath, &info) == 0 && S_ISSOCK(info.st_mode)) {
+		unlink(socketPath);
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+		perror(socketPath);
+		if (listener >= 0) {
+			close(listener);
+		}
+		return EXIT_FAILURE;
+	}
+
+	if (pipe(stopPipe) != 0) {
+		perror("pipe");
+		close(listener);
+		unlink(socketPath);
+		return EXIT_FAILURE;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = RequestStop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	// A client leaving before its response must not kill the daemon
+	signal(SIGPIPE, SIG_IGN);
+
+	ServeStats stats;
+	stats.nbRequests = stats.nbImages = stats.nbFailed = 0;
+	stats.totalLatency = stats.maxLatency = 0;
+	stats.maxQueueDepth = 0;
+	for (int b = 0; b < SERVE_LATENCY_BUCKETS; b++) {
+		stats.latencies[b] = 0;
+	}
+
+	int nbFeatures = NbImageFeatures(options);
+	int exitCode = 0;
+
+	// Connections run on threads of their own, tracked so that a stop can wake them up
+	mutex connectionsMutex;
+	condition_variable connectionsCondition;
+	set<int> connections;
+
+	{
+		ExtractionPool pool(options, ResolveThreadCount(options.threads));
+
+		printf("serving %d features on %s with %d workers\n", nbFeatures, socketPath, pool.NbThreads());
+		fflush(stdout);
+
+		for (;;) {
+			struct pollfd fds[2];
+			fds[0].fd = listener;
+			fds[0].events = POLLIN;
+			fds[1].fd = stopPipe[0];
+			fds[1].events = POLLIN;
+
+			if (poll(fds, 2, -1) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				perror("poll");
+				exitCode = EXIT_FAILURE;
+				break;
+			}
+			if (fds[1].revents != 0) {
+				break;
+			}
+			if ((fds[0].revents & POLLIN) == 0) {
+				continue;
+			}
+
+			int fd = accept(listener, NULL, NULL);
+			if (fd < 0) {
+				if (errno != EINTR && errno != ECONNABORTED) {
+					perror("accept");
+				}
+				continue;
+			}
+
+			lock_guard<mutex> lock(connectionsMutex);
+			connections.insert(fd);
+			thread([fd, &pool, nbFeatures, &stats, &connectionsMutex, &connectionsCondition, &connections]() {
+				ServeConnection(fd, pool, nbFeatures, stats);
+
+				lock_guard<mutex> lock(connectionsMutex);
+				close(fd);
+				connections.erase(fd);
+				connectionsCondition.notify_all();
+			}).detach();
+		}
+
+		// Wake up the connections waiting for a request, and let those in a request finish
+		unique_lock<mutex> lock(connectionsMutex);
+		for (set<int>::iterator fd = connections.begin(); fd != connections.end(); ++fd) {
+			shutdown(*fd, SHUT_RD);
+		}
+		while (!connections.empty()) {
+			connectionsCondition.wait(lock);
+		}
+
+		printf("%s\n", StatsJson(stats, pool).c_str());
+	}
+
+	close(listener);
+	unlink(socketPath);
+	close(stopPipe[0]);
+	close(stopPipe[1]);
+
+	return exitCode;
+}
+
+#endif
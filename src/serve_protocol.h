@@ -0,0 +1,46 @@
+#ifndef LABPRIMITIVE_SERVE_PROTOCOL_H
+#define LABPRIMITIVE_SERVE_PROTOCOL_H
+
+// Framing of the requests and responses of the serve daemon, on a Unix stream socket.
+// A connection carries any number of requests, each answered in order. Every integer
+// is a little-endian uint32, features are little-endian float32.
+//
+// Request:
+//     magic SERVE_REQUEST_MAGIC, type, count, then count items of the type:
+//     SERVE_PATHS  length, then the bytes of a file name (relative to the daemon's
+//                  working directory), without terminating zero
+//     SERVE_BMP    length, then the bytes of an uncompressed .bmp file
+//     SERVE_PIXELS width, height, channels (1, 3 or 4), then width * height * channels
+//                  bytes of BGR(X) or gray pixels, top row first, rows without padding
+//     SERVE_STATS  no item (count is 0)
+//
+// Response:
+//     magic SERVE_RESPONSE_MAGIC, status, count, nbFeatures, then
+//     - for images: count bytes, 1 if the image was extracted and 0 if it could not
+//       be loaded, followed by count rows of nbFeatures features (NaN when not loaded)
+//     - for SERVE_STATS: count is the length of a JSON object that follows, with the
+//       request and image totals, the queue depth and the request latencies
+// A request that breaks the framing or the limits gets a single response with status
+// SERVE_BAD_REQUEST and count 0, and the connection is closed.
+
+#define SERVE_REQUEST_MAGIC 0x3151504Cu		// "LPQ1"
+#define SERVE_RESPONSE_MAGIC 0x3152504Cu	// "LPR1"
+
+enum ServeRequestType {
+	SERVE_PATHS = 1,
+	SERVE_BMP = 2,
+	SERVE_PIXELS = 3,
+	SERVE_STATS = 4
+};
+
+enum ServeStatus {
+	SERVE_OK = 0,
+	SERVE_BAD_REQUEST = 1
+};
+
+// Limits of one request
+#define SERVE_MAX_ITEMS (1 << 20)
+#define SERVE_MAX_PATH 4096
+#define SERVE_MAX_REQUEST_BYTES ((size_t)1 << 30)
+
+#endif
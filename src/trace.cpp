@@ -0,0 +1,250 @@
+#include "trace.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> tracingEnabled(false);
+
+static const char *STAGE_NAMES[NUM_TRACE_STAGES] = { "decode", "copy", "extract", "normalize", "write", "read", "wait", "image" };
+static const char *COUNTER_NAMES[NUM_TRACE_COUNTERS] = { "pixels", "bytes read", "rows written" };
+
+// Per-image latency buckets: bucket i holds the latencies in [2^(i-1), 2^i) microseconds
+#define LATENCY_BUCKETS 32
+
+struct TraceEvent {
+	uint64_t start;
+	uint64_t end;
+	int64_t arg;
+	int stage;
+};
+
+// Everything one thread records; only that thread writes to it
+struct ThreadTrace {
+	int threadNb;
+	vector<TraceEvent> ring;
+	uint64_t nbEvents;		// ever recorded; the ring holds the last TRACE_RING_SIZE
+	uint64_t stageTotals[NUM_TRACE_STAGES];
+	uint64_t stageCounts[NUM_TRACE_STAGES];
+	uint64_t counters[NUM_TRACE_COUNTERS];
+	uint64_t latencies[LATENCY_BUCKETS];
+};
+
+// The traces outlive their threads, so that a dump after the workers joined sees them
+static mutex registryMutex;
+static vector<unique_ptr<ThreadTrace> > registry;
+
+static thread_local ThreadTrace *threadTrace = NULL;
+
+static ThreadTrace &CurrentThreadTrace() {
+	if (threadTrace == NULL) {
+		unique_ptr<ThreadTrace> trace(new ThreadTrace());
+		trace->ring.resize(TRACE_RING_SIZE);
+		trace->nbEvents = 0;
+		for (int i = 0; i < NUM_TRACE_STAGES; i++) {
+			trace->stageTotals[i] = trace->stageCounts[i] = 0;
+		}
+		for (int i = 0; i < NUM_TRACE_COUNTERS; i++) {
+			trace->counters[i] = 0;
+		}
+		for (int i = 0; i < LATENCY_BUCKETS; i++) {
+			trace->latencies[i] = 0;
+		}
+
+		lock_guard<mutex> lock(registryMutex);
+		trace->threadNb = (int)registry.size();
+		threadTrace = trace.get();
+		registry.push_back(move(trace));
+	}
+	return *threadTrace;
+}
+
+void EnableTracing(bool enabled) {
+	// The thread switching tracing on is the main one: it gets the first trace
+	if (enabled) {
+		CurrentThreadTrace();
+	}
+	tracingEnabled.store(enabled, memory_order_relaxed);
+}
+
+uint64_t TraceNow() {
+	// Never 0, which TraceScope uses for "not traced"
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count() | 1;
+}
+
+void TraceSpan(TraceStage stage, uint64_t start, uint64_t end, int64_t arg) {
+	ThreadTrace &trace = CurrentThreadTrace();
+
+	TraceEvent &event = trace.ring[trace.nbEvents % TRACE_RING_SIZE];
+	event.start = start;
+	event.end = end;
+	event.arg = arg;
+	event.stage = stage;
+	trace.nbEvents++;
+
+	uint64_t duration = end > start ? end - start : 0;
+	trace.stageTotals[stage] += duration;
+	trace.stageCounts[stage]++;
+
+	if (stage == STAGE_IMAGE) {
+		int bucket = 0;
+		for (uint64_t micros = duration / 1000; micros != 0 && bucket < LATENCY_BUCKETS - 1; micros >>= 1) {
+			bucket++;
+		}
+		trace.latencies[bucket]++;
+	}
+}
+
+void TraceCount(TraceCounter counter, uint64_t amount) {
+	if (TracingEnabled()) {
+		CurrentThreadTrace().counters[counter] += amount;
+	}
+}
+
+bool WriteChromeTrace(const char *fileName) {
+	FILE *fp = fopen(fileName, "w");
+
+	if (fp == NULL) {
+		perror(fileName);
+		return false;
+	}
+
+	lock_guard<mutex> lock(registryMutex);
+
+	// Timestamps are relative to the first span kept
+	uint64_t origin = 0;
+	uint64_t last = 0;
+	for (size_t t = 0; t < registry.size(); t++) {
+		const ThreadTrace &trace = *registry[t];
+		uint64_t nbKept = trace.nbEvents < TRACE_RING_SIZE ? trace.nbEvents : TRACE_RING_SIZE;
+		for (uint64_t i = trace.nbEvents - nbKept; i < trace.nbEvents; i++) {
+			const TraceEvent &event = trace.ring[i % TRACE_RING_SIZE];
+			origin = origin == 0 || event.start < origin ? event.start : origin;
+			last = event.end > last ? event.end : last;
+		}
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	fprintf(fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"LabPrimitive\"}}");
+
+	uint64_t counters[NUM_TRACE_COUNTERS] = { 0 };
+
+	for (size_t t = 0; t < registry.size(); t++) {
+		const ThreadTrace &trace = *registry[t];
+
+		char threadName[32];
+		sprintf(threadName, trace.threadNb == 0 ? "main" : "worker %d", trace.threadNb);
+		fprintf(fp, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+			trace.threadNb, threadName);
+
+		uint64_t nbKept = trace.nbEvents < TRACE_RING_SIZE ? trace.nbEvents : TRACE_RING_SIZE;
+		for (uint64_t i = trace.nbEvents - nbKept; i < trace.nbEvents; i++) {
+			const TraceEvent &event = trace.ring[i % TRACE_RING_SIZE];
+			fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+				STAGE_NAMES[event.stage], trace.threadNb, (event.start - origin) / 1000.0, (event.end - event.start) / 1000.0);
+			if (event.arg >= 0) {
+				fprintf(fp, ", \"args\": {\"sample\": %lld}", (long long)event.arg);
+			}
+			fprintf(fp, "}");
+		}
+
+		for (int c = 0; c < NUM_TRACE_COUNTERS; c++) {
+			counters[c] += trace.counters[c];
+		}
+	}
+
+	// Totals of the counters, at the end of the run
+	for (int c = 0; c < NUM_TRACE_COUNTERS; c++) {
+		fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"total\": %llu}}",
+			COUNTER_NAMES[c], (last - origin) / 1000.0, (unsigned long long)counters[c]);
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	if (fclose(fp) != 0) {
+		perror(fileName);
+		return false;
+	}
+	return true;
+}
+
+void PrintTraceSummary(FILE *out) {
+	uint64_t stageTotals[NUM_TRACE_STAGES] = { 0 };
+	uint64_t stageCounts[NUM_TRACE_STAGES] = { 0 };
+	uint64_t counters[NUM_TRACE_COUNTERS] = { 0 };
+	uint64_t latencies[LATENCY_BUCKETS] = { 0 };
+	uint64_t nbDropped = 0;
+
+	{
+		lock_guard<mutex> lock(registryMutex);
+		for (size_t t = 0; t < registry.size(); t++) {
+			const ThreadTrace &trace = *registry[t];
+			for (int s = 0; s < NUM_TRACE_STAGES; s++) {
+				stageTotals[s] += trace.stageTotals[s];
+				stageCounts[s] += trace.stageCounts[s];
+			}
+			for (int c = 0; c < NUM_TRACE_COUNTERS; c++) {
+				counters[c] += trace.counters[c];
+			}
+			for (int b = 0; b < LATENCY_BUCKETS; b++) {
+				latencies[b] += trace.latencies[b];
+			}
+			nbDropped += trace.nbEvents > TRACE_RING_SIZE ? trace.nbEvents - TRACE_RING_SIZE : 0;
+		}
+	}
+
+	fprintf(out, "stage          spans     total ms    mean us\n");
+	for (int s = 0; s < NUM_TRACE_STAGES; s++) {
+		if (stageCounts[s] > 0) {
+			fprintf(out, "%-10s %9llu %12.3f %10.1f\n", STAGE_NAMES[s], (unsigned long long)stageCounts[s],
+				stageTotals[s] / 1e6, stageTotals[s] / 1e3 / stageCounts[s]);
+		}
+	}
+	for (int c = 0; c < NUM_TRACE_COUNTERS; c++) {
+		fprintf(out, "%s: %llu\n", COUNTER_NAMES[c], (unsigned long long)counters[c]);
+	}
+	if (nbDropped > 0) {
+		fprintf(out, "%llu oldest spans not kept in the trace (ring of %d per thread)\n", (unsigned long long)nbDropped, TRACE_RING_SIZE);
+	}
+
+	uint64_t nbImages = stageCounts[STAGE_IMAGE];
+	if (nbImages == 0) {
+		return;
+	}
+
+	// Percentiles are given as the upper bound of their bucket
+	const double quantiles[3] = { 0.5, 0.9, 0.99 };
+	const char *quantileNames[3] = { "p50", "p90", "p99" };
+	uint64_t seen = 0;
+	int q = 0;
+	uint64_t largest = 0;
+
+	fprintf(out, "per-image latency:");
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		seen += latencies[b];
+		while (q < 3 && seen >= (uint64_t)(quantiles[q] * nbImages + 0.5) && seen > 0) {
+			fprintf(out, " %s < %llu us", quantileNames[q], 1ull << b);
+			q++;
+		}
+		largest = latencies[b] > largest ? latencies[b] : largest;
+	}
+	fprintf(out, "\n");
+
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		if (latencies[b] == 0) {
+			continue;
+		}
+
+		char range[32];
+		sprintf(range, "%llu-%llu us", b == 0 ? 0ull : 1ull << (b - 1), 1ull << b);
+		int barLength = (int)(40 * latencies[b] / largest);
+		fprintf(out, "  %16s %8llu ", range, (unsigned long long)latencies[b]);
+		for (int i = 0; i < barLength; i++) {
+			fputc('#', out);
+		}
+		fputc('\n', out);
+	}
+}
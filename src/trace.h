@@ -0,0 +1,80 @@
+#ifndef LABPRIMITIVE_TRACE_H
+#define LABPRIMITIVE_TRACE_H
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+
+// Timing of the stages of the extraction, always compiled in and switched on at run
+// time (--trace). Each thread records its spans in its own ring buffer, without lock
+// or allocation after its first event; when tracing is off, a probe costs one relaxed
+// atomic load. The rings keep the last TRACE_RING_SIZE spans of each thread, while
+// the stage totals, the counters and the per-image latency histogram cover the whole run.
+
+#define TRACE_RING_SIZE (1 << 16)
+
+enum TraceStage {
+	STAGE_DECODE,		// file to pixels: cvLoadImage, or mapping and parsing a BMP
+	STAGE_COPY,			// copy of the image for the viewer
+	STAGE_EXTRACT,		// colour counting
+	STAGE_NORMALIZE,	// counts to features
+	STAGE_WRITE,		// output file
+	STAGE_READ,			// file read ahead of the workers (on a reader thread)
+	STAGE_WAIT,			// worker waiting for the file read ahead for it
+	STAGE_IMAGE,		// one whole image, from its file name to its features
+	NUM_TRACE_STAGES
+};
+
+enum TraceCounter {
+	COUNTER_PIXELS,			// pixels classified
+	COUNTER_BYTES_READ,		// bytes of the image files read in place
+	COUNTER_ROWS_WRITTEN,	// feature rows written out
+	NUM_TRACE_COUNTERS
+};
+
+extern std::atomic<bool> tracingEnabled;
+
+inline bool TracingEnabled() {
+	return tracingEnabled.load(std::memory_order_relaxed);
+}
+
+void EnableTracing(bool enabled);
+
+// Nanoseconds on a monotonic clock
+uint64_t TraceNow();
+
+// Records a span of the calling thread; arg is shown with it (the sample, or -1)
+void TraceSpan(TraceStage stage, uint64_t start, uint64_t end, int64_t arg);
+
+// Adds amount to a counter of the calling thread
+void TraceCount(TraceCounter counter, uint64_t amount);
+
+// Span covering the lifetime of the object, when tracing is on at its construction
+class TraceScope {
+public:
+	explicit TraceScope(TraceStage stage, int64_t arg = -1) : stage(stage), arg(arg), start(TracingEnabled() ? TraceNow() : 0) {
+	}
+
+	~TraceScope() {
+		if (start != 0) {
+			TraceSpan(stage, start, TraceNow(), arg);
+		}
+	}
+
+private:
+	TraceScope(const TraceScope &);
+	TraceScope &operator=(const TraceScope &);
+
+	TraceStage stage;
+	int64_t arg;
+	uint64_t start;
+};
+
+// Writes the spans of every thread in the Chrome trace-event format (chrome://tracing,
+// Perfetto). Must not run while other threads are tracing.
+bool WriteChromeTrace(const char *fileName);
+
+// Time per stage, counters and histogram of the per-image latency
+void PrintTraceSummary(FILE *out);
+
+#endif
@@ -0,0 +1,245 @@
+#include "color_classifier.h"
+#include "color_table.h"
+#include "commands.h"
+#include "dataset.h"
+#include "extraction.h"
+#include "feature_store.h"
+#include "histogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+// Added to the variances of the Fisher score: a standard deviation of 1 % of the
+// image, so that boxes which almost no image reaches do not win on a zero variance
+#define TUNE_VARIANCE_FLOOR 1e-4
+
+// Best box found for a class
+struct TunedBox {
+	double score;		// 0 = none yet
+	int lo[3];			// bins, B, G, R
+	int hi[3];
+	double classMean;	// mean fraction of the images of the class
+	double restMean;	// and of the others
+};
+
+// Higher score first; of equal scores, the first box in search order, so that the
+// result does not depend on the number of threads
+static bool Better(const TunedBox &a, const TunedBox &b) {
+	if (a.score != b.score) {
+		return a.score > b.score;
+	}
+	for (int c = 0; c < 3; c++) {
+		if (a.lo[c] != b.lo[c]) {
+			return a.lo[c] < b.lo[c];
+		}
+		if (a.hi[c] != b.hi[c]) {
+			return a.hi[c] < b.hi[c];
+		}
+	}
+	return false;
+}
+
+// Scores every box whose blue bins are lo..hi, for every class (one against the rest)
+static void SearchBlueRange(const ColorBoxTable &table, const vector<int> &classes, int nbClasses, int loB, int hiB, vector<TunedBox> &best) {
+	int bins = table.BinsPerChannel();
+	size_t nbImages = table.NbImages();
+	vector<double> fractions(nbImages);
+	vector<double> sums(nbClasses), squares(nbClasses);
+	vector<int> sizes(nbClasses, 0);
+
+	for (size_t i = 0; i < nbImages; i++) {
+		sizes[classes[i]]++;
+	}
+
+	int lo[3] = { loB, 0, 0 };
+	int hi[3] = { hiB, 0, 0 };
+	for (lo[1] = 0; lo[1] < bins; lo[1]++) {
+		for (hi[1] = lo[1]; hi[1] < bins; hi[1]++) {
+			for (lo[2] = 0; lo[2] < bins; lo[2]++) {
+				for (hi[2] = lo[2]; hi[2] < bins; hi[2]++) {
+					table.BoxFractions(lo, hi, &fractions[0]);
+
+					double totalSum = 0.0, totalSquares = 0.0;
+					for (int c = 0; c < nbClasses; c++) {
+						sums[c] = squares[c] = 0.0;
+					}
+					for (size_t i = 0; i < nbImages; i++) {
+						double x = fractions[i];
+						sums[classes[i]] += x;
+						squares[classes[i]] += x * x;
+					}
+					for (int c = 0; c < nbClasses; c++) {
+						totalSum += sums[c];
+						totalSquares += squares[c];
+					}
+
+					for (int c = 0; c < nbClasses; c++) {
+						int nbRest = (int)nbImages - sizes[c];
+						if (sizes[c] == 0 || nbRest == 0) {
+							continue;
+						}
+
+						double classMean = sums[c] / sizes[c];
+						double restMean = (totalSum - sums[c]) / nbRest;
+						// Only boxes whose colour is more frequent in the class describe it
+						if (classMean <= restMean) {
+							continue;
+						}
+						double classVariance = squares[c] / sizes[c] - classMean * classMean;
+						double restVariance = (totalSquares - squares[c]) / nbRest - restMean * restMean;
+						double gap = classMean - restMean;
+
+						TunedBox box;
+						box.score = gap * gap / (classVariance + restVariance + TUNE_VARIANCE_FLOOR);
+						for (int k = 0; k < 3; k++) {
+							box.lo[k] = lo[k];
+							box.hi[k] = hi[k];
+						}
+						box.classMean = classMean;
+						box.restMean = restMean;
+						if (Better(box, best[c])) {
+							best[c] = box;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+int RunTune(const char *outputFileName, const DatasetOptions &dataset, const ExtractionOptions &options) {
+
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	// The histograms need every pixel
+	ExtractionOptions histogramOptions = options;
+	histogramOptions.sampling = NULL;
+	histogramOptions.components = false;
+	histogramOptions.cache = NULL;
+	if (histogramOptions.histogramBins == 0) {
+		histogramOptions.histogramBins = MAX_HISTOGRAM_BINS;
+	}
+	int bins = histogramOptions.histogramBins;
+
+	// Images that cannot be loaded are reported and left out of the tables
+	FeatureStore store(ImageFeatureNames(histogramOptions));
+	if (!AddDatasetImages(store, true, dataset)) {
+		return EXIT_FAILURE;
+	}
+	int nbFailed = 0;
+	ProcessImageBatch(store, histogramOptions, nbFailed);
+
+	if (store.NbExtracted() == 0) {
+		fprintf(stderr, "The training set is empty\n");
+		return EXIT_FAILURE;
+	}
+
+	vector<size_t> samples;
+	for (size_t i = 0; i < store.NbSamples(); i++) {
+		if (store.Extracted(i)) {
+			samples.push_back(i);
+		}
+	}
+
+	int nbClasses = (int)store.Labels().size();
+	int firstBin = options.classifier->NbFeatures();
+	int nbBins = bins * bins * bins;
+
+	ColorBoxTable table(bins, samples.size());
+	vector<int> classes(samples.size());
+	vector<float> fractions(samples.size());
+	for (size_t i = 0; i < samples.size(); i++) {
+		classes[i] = store.LabelIndex(samples[i]);
+	}
+	for (int bin = 0; bin < nbBins; bin++) {
+		for (size_t i = 0; i < samples.size(); i++) {
+			fractions[i] = store.Value(samples[i], firstBin + bin);
+		}
+		table.SetBin(bin, &fractions[0]);
+	}
+	table.Build();
+
+	double loadTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	printf("%d training images, %d classes, %d bins per channel (%.3f s)\n", (int)samples.size(), nbClasses, bins, loadTime);
+
+	// Each worker takes the next blue range and keeps its own best boxes
+	startTime = chrono::steady_clock::now();
+	vector<pair<int, int> > blueRanges;
+	for (int loB = 0; loB < bins; loB++) {
+		for (int hiB = loB; hiB < bins; hiB++) {
+			blueRanges.push_back(make_pair(loB, hiB));
+		}
+	}
+
+	int nbThreads = ResolveThreadCount(options.threads);
+	TunedBox none = { 0.0, { 0, 0, 0 }, { 0, 0, 0 }, 0.0, 0.0 };
+	vector<vector<TunedBox> > workerBest(nbThreads, vector<TunedBox>(nbClasses, none));
+	atomic<size_t> nextRange(0);
+	vector<thread> workers;
+
+	for (int t = 0; t < nbThreads; t++) {
+		workers.push_back(thread([&, t]() {
+			for (size_t r = nextRange++; r < blueRanges.size(); r = nextRange++) {
+				SearchBlueRange(table, classes, nbClasses, blueRanges[r].first, blueRanges[r].second, workerBest[t]);
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+
+	vector<TunedBox> best(nbClasses, none);
+	for (int t = 0; t < nbThreads; t++) {
+		for (int c = 0; c < nbClasses; c++) {
+			if (Better(workerBest[t][c], best[c])) {
+				best[c] = workerBest[t][c];
+			}
+		}
+	}
+
+	size_t nbBoxes = blueRanges.size() * blueRanges.size() * blueRanges.size();
+	double searchTime = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+	printf("%zu boxes searched in %.3f s (%.1f million boxes/s)\n", nbBoxes, searchTime, searchTime > 0.0 ? nbBoxes / searchTime / 1e6 : 0.0);
+
+	FILE *fp = fopen(outputFileName, "w");
+	if (fp == NULL) {
+		perror(outputFileName);
+		return EXIT_FAILURE;
+	}
+
+	// In the format of LoadColorRules, one rule per class, with its score as a comment
+	int step = 256 / bins;
+	fprintf(fp, "# Tuned on %d training images, %d bins per channel: each box separates one class\n", (int)samples.size(), bins);
+	fprintf(fp, "# from the others (Fisher score, and mean pixel ratio in the class and outside)\n");
+	printf("class        blue     green    red        score  class %%  rest %%\n");
+	for (int c = 0; c < nbClasses; c++) {
+		const TunedBox &box = best[c];
+		const string &label = store.Labels()[c];
+		if (box.score <= 0.0) {
+			printf("%-12s no box is more frequent in the class than outside\n", label.c_str());
+			continue;
+		}
+
+		char ranges[3][16];
+		for (int k = 0; k < 3; k++) {
+			sprintf(ranges[k], "%d-%d", box.lo[k] * step, box.hi[k] * step + step - 1);
+		}
+		fprintf(fp, "%s\t%s\t%s\t%s\t# score %.3f, %.2f %% vs %.2f %%\n", label.c_str(), ranges[0], ranges[1], ranges[2],
+			box.score, box.classMean * 100.0, box.restMean * 100.0);
+		printf("%-12s %-8s %-8s %-8s %8.3f %7.2f %7.2f\n", label.c_str(), ranges[0], ranges[1], ranges[2],
+			box.score, box.classMean * 100.0, box.restMean * 100.0);
+	}
+
+	if (fclose(fp) != 0) {
+		perror(outputFileName);
+		return EXIT_FAILURE;
+	}
+	printf("rules written to %s\n", outputFileName);
+
+	return EXIT_SUCCESS;
+}
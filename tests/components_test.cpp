@@ -0,0 +1,163 @@
+#include "test.h"
+#include "../src/color_classifier.h"
+#include "../src/components.h"
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// Three rules on the blue channel, two of them overlapping, so that a pixel can be in
+// several blobs at once
+static vector<ColorRule> TestRules() {
+	static const unsigned char BLUE_RANGES[3][2] = { { 0, 99 }, { 60, 159 }, { 200, 255 } };
+	vector<ColorRule> rules;
+
+	for (int r = 0; r < 3; r++) {
+		ColorRule rule;
+		rule.name = string(1, (char)('A' + r));
+		rule.box.loB = BLUE_RANGES[r][0];
+		rule.box.hiB = BLUE_RANGES[r][1];
+		rule.box.loG = rule.box.loR = 0;
+		rule.box.hiG = rule.box.hiR = 255;
+		rule.highlight = false;
+		rules.push_back(rule);
+	}
+	return rules;
+}
+
+// BGR pixels with blue 0, 70, 140 or 210 at random: blobs of every shape
+static vector<unsigned char> RandomImage(int width, int height, uint32_t seed) {
+	vector<unsigned char> pixels((size_t)width * height * 3, 0);
+	uint32_t state = seed * 2654435761u + 12345;
+
+	for (size_t i = 0; i < pixels.size(); i += 3) {
+		state = state * 1664525u + 1013904223u;
+		pixels[i] = (unsigned char)((state >> 24) % 4 * 70);
+	}
+	return pixels;
+}
+
+// Component features of each rule by flood fill of its 8-connected pixels, in raster
+// order: the first blob found of the largest area is the one ComponentLabeler keeps
+static void NaiveComponentFeatures(const ColorClassifier &classifier, const vector<unsigned char> &pixels, int width, int height,
+	uint64_t *counts, float *features) {
+
+	for (int r = 0; r < classifier.NbFeatures(); r++) {
+		vector<char> visited((size_t)width * height, 0);
+		float *f = features + r * NUM_COMPONENT_FEATURES;
+		uint64_t bestArea = 0, bestSumX = 0, bestSumY = 0;
+		int bestMinX = 0, bestMaxX = 0, bestMinY = 0, bestMaxY = 0;
+		int nbBlobs = 0;
+		counts[r] = 0;
+
+		for (int start = 0; start < width * height; start++) {
+			const unsigned char *pixel = &pixels[(size_t)start * 3];
+			if (visited[start] || ((classifier.Classify(pixel[0], pixel[1], pixel[2]) >> r) & 1) == 0) {
+				continue;
+			}
+
+			uint64_t area = 0, sumX = 0, sumY = 0;
+			int minX = width, maxX = -1, minY = height, maxY = -1;
+			vector<int> stack(1, start);
+			visited[start] = 1;
+			while (!stack.empty()) {
+				int p = stack.back();
+				stack.pop_back();
+				int x = p % width, y = p / width;
+				area++;
+				sumX += (uint64_t)x;
+				sumY += (uint64_t)y;
+				minX = x < minX ? x : minX;
+				maxX = x > maxX ? x : maxX;
+				minY = y < minY ? y : minY;
+				maxY = y > maxY ? y : maxY;
+
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						int nx = x + dx, ny = y + dy;
+						if (nx < 0 || nx >= width || ny < 0 || ny >= height || visited[ny * width + nx]) {
+							continue;
+						}
+						const unsigned char *next = &pixels[(size_t)(ny * width + nx) * 3];
+						if ((classifier.Classify(next[0], next[1], next[2]) >> r) & 1) {
+							visited[ny * width + nx] = 1;
+							stack.push_back(ny * width + nx);
+						}
+					}
+				}
+			}
+
+			nbBlobs++;
+			counts[r] += area;
+			if (area > bestArea) {
+				bestArea = area;
+				bestSumX = sumX;
+				bestSumY = sumY;
+				bestMinX = minX;
+				bestMaxX = maxX;
+				bestMinY = minY;
+				bestMaxY = maxY;
+			}
+		}
+
+		f[COMPONENT_BLOBS] = (float)nbBlobs;
+		if (bestArea == 0) {
+			for (int k = COMPONENT_LARGEST; k < NUM_COMPONENT_FEATURES; k++) {
+				f[k] = 0.0f;
+			}
+			continue;
+		}
+		f[COMPONENT_LARGEST] = (float)((double)bestArea / ((double)width * height));
+		f[COMPONENT_CENTER_X] = (float)(((double)bestSumX / bestArea + 0.5) / width);
+		f[COMPONENT_CENTER_Y] = (float)(((double)bestSumY / bestArea + 0.5) / height);
+		f[COMPONENT_WIDTH] = (float)(bestMaxX - bestMinX + 1) / width;
+		f[COMPONENT_HEIGHT] = (float)(bestMaxY - bestMinY + 1) / height;
+	}
+}
+
+// The labeler gives the flood fill's features, with the rows added top-down and
+// bottom-up, on images from one pixel to a few hundred
+static bool TestAgainstFloodFill() {
+	ColorClassifier classifier(TestRules());
+	int nbRules = classifier.NbFeatures();
+
+	for (int width = 1; width <= 37; width += 4) {
+		for (int height = 1; height <= 29; height += 4) {
+			for (uint32_t seed = 1; seed <= 3; seed++) {
+				vector<unsigned char> pixels = RandomImage(width, height, seed);
+
+				uint64_t expectedCounts[MAX_COLOR_RULES];
+				vector<float> expected(nbRules * NUM_COMPONENT_FEATURES);
+				NaiveComponentFeatures(classifier, pixels, width, height, expectedCounts, &expected[0]);
+
+				for (int bottomUp = 0; bottomUp < 2; bottomUp++) {
+					ComponentLabeler labeler(classifier, width, height, 3, NULL, 0);
+					for (int h = 0; h < height; h++) {
+						int y = bottomUp ? height - 1 - h : h;
+						labeler.AddRow(&pixels[(size_t)y * width * 3], y);
+					}
+
+					uint64_t counts[MAX_COLOR_RULES];
+					vector<float> features(nbRules * NUM_COMPONENT_FEATURES);
+					labeler.Finish(counts, &features[0]);
+
+					for (int r = 0; r < nbRules; r++) {
+						CHECK(counts[r] == expectedCounts[r]);
+					}
+					for (size_t k = 0; k < features.size(); k++) {
+						CHECK(features[k] == expected[k]);
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+int main() {
+	static const TestCase tests[] = {
+		{ "components against flood fill", TestAgainstFloodFill }
+	};
+	return TestMain(tests, sizeof(tests) / sizeof(tests[0]));
+}
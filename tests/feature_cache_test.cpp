@@ -0,0 +1,177 @@
+#include "test.h"
+#include "../src/feature_cache.h"
+
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+using namespace std;
+
+#define TEST_CONFIG 0x1234
+#define TEST_FEATURES 3
+
+static const char *CACHE_FILE = "feature_cache_test.lpc";
+static const char *IMAGE_FILE = "feature_cache_test.bin";
+
+// Writes an image file of 64 bytes of value, dated modified (seconds since 1970)
+static bool WriteImageFile(unsigned char value, long modified) {
+	unsigned char bytes[64];
+	for (size_t i = 0; i < sizeof(bytes); i++) {
+		bytes[i] = value;
+	}
+
+	FILE *fp = fopen(IMAGE_FILE, "wb");
+	if (fp == NULL) {
+		return false;
+	}
+	bool written = fwrite(bytes, 1, sizeof(bytes), fp) == sizeof(bytes);
+	if (fclose(fp) != 0) {
+		written = false;
+	}
+
+	struct utimbuf times;
+	times.actime = (time_t)modified;
+	times.modtime = (time_t)modified;
+	return written && utime(IMAGE_FILE, &times) == 0;
+}
+
+// Looks the image up as ProcessImageBatch does; extracted tells whether it had to be
+// extracted, in which case fVector is recorded as its features
+static bool Lookup(FeatureCache &cache, float *fVector, bool &extracted) {
+	extracted = false;
+	if (cache.FindUnchanged(IMAGE_FILE, fVector)) {
+		return true;
+	}
+
+	FeatureCache::FileVersion version;
+	if (!cache.HashFile(IMAGE_FILE, version)) {
+		return false;
+	}
+	if (!cache.FindContents(IMAGE_FILE, version, fVector)) {
+		cache.Add(IMAGE_FILE, version, fVector);
+		extracted = true;
+	}
+	return true;
+}
+
+// Rows are found again by a later run, and dropped when the file changes, even with
+// the same size
+static bool TestInvalidation() {
+	remove(CACHE_FILE);
+	CHECK(WriteImageFile(1, 1000000000));
+
+	float first[TEST_FEATURES] = { 0.25f, 0.5f, 0.75f };
+	float second[TEST_FEATURES] = { 0.125f, 0.375f, 0.625f };
+	float found[TEST_FEATURES];
+	bool extracted;
+
+	{
+		FeatureCache cache(TEST_CONFIG, TEST_FEATURES);
+		CHECK(cache.Open(CACHE_FILE));
+		float fVector[TEST_FEATURES] = { first[0], first[1], first[2] };
+		CHECK(Lookup(cache, fVector, extracted) && extracted);
+		CHECK(cache.Save());
+	}
+
+	// Unchanged: answered from the file record, without hashing
+	{
+		FeatureCache cache(TEST_CONFIG, TEST_FEATURES);
+		CHECK(cache.Open(CACHE_FILE));
+		CHECK(cache.FindUnchanged(IMAGE_FILE, found));
+		for (int f = 0; f < TEST_FEATURES; f++) {
+			CHECK(found[f] == first[f]);
+		}
+	}
+
+	// Another configuration does not see the row
+	{
+		FeatureCache cache(TEST_CONFIG + 1, TEST_FEATURES);
+		CHECK(cache.Open(CACHE_FILE));
+		CHECK(!cache.FindUnchanged(IMAGE_FILE, found));
+	}
+
+	// Rewritten with other contents of the same size: extracted again
+	CHECK(WriteImageFile(2, 1000000001));
+	{
+		FeatureCache cache(TEST_CONFIG, TEST_FEATURES);
+		CHECK(cache.Open(CACHE_FILE));
+		CHECK(!cache.FindUnchanged(IMAGE_FILE, found));
+		float fVector[TEST_FEATURES] = { second[0], second[1], second[2] };
+		CHECK(Lookup(cache, fVector, extracted) && extracted);
+		CHECK(cache.Save());
+	}
+
+	// The first contents back under a new date: found by their hash, not extracted
+	CHECK(WriteImageFile(1, 1000000002));
+	{
+		FeatureCache cache(TEST_CONFIG, TEST_FEATURES);
+		CHECK(cache.Open(CACHE_FILE));
+		CHECK(Lookup(cache, found, extracted) && !extracted);
+		for (int f = 0; f < TEST_FEATURES; f++) {
+			CHECK(found[f] == first[f]);
+		}
+		CHECK(cache.Save());
+	}
+
+	remove(IMAGE_FILE);
+	remove(CACHE_FILE);
+	return true;
+}
+
+// A record cut short by a crash is dropped, and the complete ones are kept
+static bool TestCutRecord() {
+	remove(CACHE_FILE);
+	CHECK(WriteImageFile(3, 1000000000));
+
+	float features[TEST_FEATURES] = { 1.0f, 2.0f, 3.0f };
+	float found[TEST_FEATURES];
+	bool extracted;
+	{
+		FeatureCache cache(TEST_CONFIG, TEST_FEATURES);
+		CHECK(cache.Open(CACHE_FILE));
+		CHECK(Lookup(cache, features, extracted) && extracted);
+		CHECK(cache.Save());
+	}
+
+	// The start of a row record
+	FILE *fp = fopen(CACHE_FILE, "ab");
+	CHECK(fp != NULL);
+	const unsigned char partial[5] = { 2, 0x34, 0x12, 0, 0 };
+	CHECK(fwrite(partial, 1, sizeof(partial), fp) == sizeof(partial));
+	CHECK(fclose(fp) == 0);
+
+	{
+		FeatureCache cache(TEST_CONFIG, TEST_FEATURES);
+		CHECK(cache.Open(CACHE_FILE));
+		CHECK(cache.FindUnchanged(IMAGE_FILE, found));
+		CHECK(found[2] == features[2]);
+	}
+
+	// A file that is not a cache is refused
+	fp = fopen(CACHE_FILE, "wb");
+	CHECK(fp != NULL);
+	CHECK(fwrite("not a cache", 1, 11, fp) == 11);
+	CHECK(fclose(fp) == 0);
+	{
+		FeatureCache cache(TEST_CONFIG, TEST_FEATURES);
+		CHECK(!cache.Open(CACHE_FILE));
+	}
+
+	remove(IMAGE_FILE);
+	remove(CACHE_FILE);
+	return true;
+}
+
+int main() {
+	static const TestCase tests[] = {
+		{ "cache invalidation", TestInvalidation },
+		{ "cache cut record", TestCutRecord }
+	};
+	return TestMain(tests, sizeof(tests) / sizeof(tests[0]));
+}
@@ -0,0 +1,70 @@
+#include "test.h"
+#include "../src/feature_store.h"
+#include "../src/feature_writer.h"
+#include "../src/histogram.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A store of nbSamples samples with the features of the largest histogram, each value
+// a multiple of 1/1000 so that the six decimals of the .arff file are exact
+static FeatureStore HistogramStore(size_t nbSamples) {
+	vector<string> names;
+	AddHistogramFeatureNames(MAX_HISTOGRAM_BINS, names);
+
+	FeatureStore store(names);
+	store.AddLabel("homer");
+	store.AddLabel("bart");
+	store.AddLabel("lisa");
+
+	vector<float> fVector(names.size());
+	for (size_t i = 0; i < nbSamples; i++) {
+		for (size_t f = 0; f < fVector.size(); f++) {
+			fVector[f] = (float)((i * 7919 + f * 31) % 1000) / 1000.0f;
+		}
+		size_t sample = store.AddSample("", store.Labels()[i % 3], (int)i + 1);
+		store.SetFeatures(sample, &fVector[0]);
+	}
+	return store;
+}
+
+// Rows of MAX_HISTOGRAM_FEATURES values, about 9 KB each, are read back whole
+static bool TestArffRoundTrip() {
+	const char *fileName = "feature_writer_test.arff";
+	FeatureStore written = HistogramStore(7);
+	CHECK(written.NbFeatures() == MAX_HISTOGRAM_FEATURES);
+
+	FILE *fp = fopen(fileName, "wb");
+	CHECK(fp != NULL);
+	bool ok = WriteArffFeatures(written, fp, fileName);
+	CHECK(fclose(fp) == 0 && ok);
+
+	FeatureStore read;
+	ok = LoadFeatures(fileName, read);
+	remove(fileName);
+	CHECK(ok);
+
+	CHECK(read.NbFeatures() == written.NbFeatures());
+	CHECK(read.Labels() == written.Labels());
+	CHECK(read.NbSamples() == written.NbSamples());
+	for (int f = 0; f < read.NbFeatures(); f++) {
+		CHECK(read.FeatureName(f) == written.FeatureName(f));
+	}
+	for (size_t i = 0; i < read.NbSamples(); i++) {
+		CHECK(read.Extracted(i));
+		CHECK(read.Label(i) == written.Label(i));
+		for (int f = 0; f < read.NbFeatures(); f++) {
+			CHECK(read.Value(i, f) == written.Value(i, f));
+		}
+	}
+	return true;
+}
+
+int main() {
+	static const TestCase tests[] = {
+		{ "arff round trip", TestArffRoundTrip }
+	};
+	return TestMain(tests, sizeof(tests) / sizeof(tests[0]));
+}
@@ -0,0 +1,169 @@
+#include "test.h"
+#include "../src/commands.h"
+#include "../src/feature_store.h"
+#include "../src/feature_writer.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define NB_SAMPLES 11
+#define NB_SHARDS 3
+
+// The list of a run, every sample extracted, as ProcessImageBatch leaves it
+static FeatureStore RunStore(const char *firstPath) {
+	vector<string> names;
+	names.push_back("Orange");
+	names.push_back("White");
+	names.push_back("Brown");
+
+	FeatureStore store(names);
+	store.AddLabel("homer");
+	store.AddLabel("bart");
+	store.AddLabel("lisa");
+
+	for (int i = 0; i < NB_SAMPLES; i++) {
+		char path[64];
+		sprintf(path, "Train/%s%d.bmp", i == 0 ? firstPath : store.Labels()[i % 3].c_str(), i + 1);
+		size_t sample = store.AddSample(path, store.Labels()[i % 3], i + 1);
+
+		float fVector[3] = { (float)i / 16.0f, (float)(NB_SAMPLES - i) / 32.0f, 0.5f };
+		store.SetFeatures(sample, fVector);
+	}
+	return store;
+}
+
+// Extracts shard index of all, as a --shard run would, into fileName
+static bool WriteShard(const FeatureStore &all, uint32_t index, const string &fileName) {
+	ShardInfo shard = { index, NB_SHARDS, 0, 0, false };
+	FeatureStore store;
+	vector<uint64_t> positions;
+	SelectShard(all, true, shard, store, positions);
+
+	vector<float> fVector(all.NbFeatures());
+	for (size_t i = 0; i < store.NbSamples(); i++) {
+		for (int f = 0; f < all.NbFeatures(); f++) {
+			fVector[f] = all.Value((size_t)positions[i], f);
+		}
+		store.SetFeatures(i, &fVector[0]);
+	}
+
+	FILE *fp = fopen(fileName.c_str(), "wb");
+	if (fp == NULL) {
+		return false;
+	}
+	bool written = WriteShardFeatures(store, shard, positions, fp, fileName.c_str());
+	return fclose(fp) == 0 && written;
+}
+
+static bool ReadFile(const char *fileName, string &contents) {
+	FILE *fp = fopen(fileName, "rb");
+	if (fp == NULL) {
+		return false;
+	}
+	contents.clear();
+	char chunk[4096];
+	size_t nbRead;
+	while ((nbRead = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+		contents.append(chunk, nbRead);
+	}
+	fclose(fp);
+	return true;
+}
+
+static string ShardName(uint32_t index) {
+	char name[64];
+	sprintf(name, "shard_merge_test.%u-of-%u.shard", index, NB_SHARDS);
+	return name;
+}
+
+// The shards merged in any order give the file of the unsharded run, in every format
+static bool TestMergeMatchesUnsharded() {
+	FeatureStore all = RunStore("homer");
+	for (uint32_t s = 0; s < NB_SHARDS; s++) {
+		CHECK(WriteShard(all, s, ShardName(s)));
+	}
+
+	vector<string> shards;
+	shards.push_back(ShardName(2));
+	shards.push_back(ShardName(0));
+	shards.push_back(ShardName(1));
+
+	const char *formats[] = { "arff", "raw" };
+	for (int k = 0; k < 2; k++) {
+		const FeatureFormat *format = FindFeatureFormat(formats[k]);
+		CHECK(format != NULL);
+
+		FILE *fp = fopen("shard_merge_test.unsharded", "wb");
+		CHECK(fp != NULL);
+		bool written = format->write(all, fp, "shard_merge_test.unsharded");
+		CHECK(fclose(fp) == 0 && written);
+
+		CHECK(RunMerge("shard_merge_test.merged", *format, shards) == EXIT_SUCCESS);
+
+		string unsharded, merged;
+		CHECK(ReadFile("shard_merge_test.unsharded", unsharded));
+		CHECK(ReadFile("shard_merge_test.merged", merged));
+		CHECK(merged == unsharded);
+	}
+
+	remove("shard_merge_test.unsharded");
+	remove("shard_merge_test.merged");
+	for (uint32_t s = 0; s < NB_SHARDS; s++) {
+		remove(ShardName(s).c_str());
+	}
+	return true;
+}
+
+// A missing shard, a shard given twice, a shard of another run or a truncated shard
+// file are refused
+static bool TestMergeRefusesBadSets() {
+	FeatureStore all = RunStore("homer");
+	FeatureStore other = RunStore("marge");
+	for (uint32_t s = 0; s < NB_SHARDS; s++) {
+		CHECK(WriteShard(all, s, ShardName(s)));
+	}
+	CHECK(WriteShard(other, 1, "shard_merge_test.other.shard"));
+	const FeatureFormat *arff = FindFeatureFormat("arff");
+
+	vector<string> missing;
+	missing.push_back(ShardName(0));
+	missing.push_back(ShardName(2));
+	CHECK(RunMerge("shard_merge_test.merged", *arff, missing) == EXIT_FAILURE);
+
+	vector<string> twice = missing;
+	twice.push_back(ShardName(1));
+	twice.push_back(ShardName(0));
+	CHECK(RunMerge("shard_merge_test.merged", *arff, twice) == EXIT_FAILURE);
+
+	vector<string> otherRun = missing;
+	otherRun.push_back("shard_merge_test.other.shard");
+	CHECK(RunMerge("shard_merge_test.merged", *arff, otherRun) == EXIT_FAILURE);
+
+	// Shard 1 without its last bytes
+	string contents;
+	CHECK(ReadFile(ShardName(1).c_str(), contents));
+	FILE *fp = fopen(ShardName(1).c_str(), "wb");
+	CHECK(fp != NULL);
+	CHECK(fwrite(contents.data(), 1, contents.size() - 3, fp) == contents.size() - 3);
+	CHECK(fclose(fp) == 0);
+	vector<string> truncated = missing;
+	truncated.push_back(ShardName(1));
+	CHECK(RunMerge("shard_merge_test.merged", *arff, truncated) == EXIT_FAILURE);
+
+	remove("shard_merge_test.merged");
+	remove("shard_merge_test.other.shard");
+	for (uint32_t s = 0; s < NB_SHARDS; s++) {
+		remove(ShardName(s).c_str());
+	}
+	return true;
+}
+
+int main() {
+	static const TestCase tests[] = {
+		{ "merge matches the unsharded run", TestMergeMatchesUnsharded },
+		{ "merge refuses bad shard sets", TestMergeRefusesBadSets }
+	};
+	return TestMain(tests, sizeof(tests) / sizeof(tests[0]));
+}
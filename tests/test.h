@@ -0,0 +1,37 @@
+#ifndef LABPRIMITIVE_TEST_H
+#define LABPRIMITIVE_TEST_H
+
+#include <cstdio>
+#include <cstdlib>
+
+// Checks of the test programs: a failed CHECK reports its line on stderr and makes the
+// test function return false; TestMain runs the tests and returns the exit code ctest
+// expects.
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			return false; \
+		} \
+	} while (0)
+
+struct TestCase {
+	const char *name;
+	bool (*run)();
+};
+
+inline int TestMain(const TestCase *tests, int nbTests) {
+	int nbFailed = 0;
+
+	for (int i = 0; i < nbTests; i++) {
+		bool passed = tests[i].run();
+		printf("%s %s\n", passed ? "passed" : "FAILED", tests[i].name);
+		if (!passed) {
+			nbFailed++;
+		}
+	}
+
+	return nbFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif